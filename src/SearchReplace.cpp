@@ -1,4 +1,6 @@
 #include "SearchReplace.hpp"
+#include "aho_corasick.hpp"
+#include "file_types.hpp"
 #include <filesystem>
 #include <fstream>
 #include <sstream>
@@ -7,69 +9,201 @@ namespace fs = std::filesystem;
 
 namespace SearchReplace {
 
-static bool is_text_file(const fs::path& p) {
-    auto ext = p.extension().string();
-    return ext == ".txt" || ext == ".cpp" || ext == ".hpp" ||
-           ext == ".c"   || ext == ".h";
+// Classified by name, as the file tree does, without copying the path
+// where it is already narrow
+static FileType file_type_of(const fs::path& p) {
+#ifdef _WIN32
+    return classify_file(p.filename().string());
+#else
+    std::string_view path = p.native();
+    return classify_file(path.substr(path.rfind('/') + 1));
+#endif
 }
 
-int findInBuffer(Fl_Text_Buffer* buffer, const std::string& keyword) {
-    if (!buffer || keyword.empty()) return 0;
-    char* raw = buffer->text();
-    std::string text = raw ? raw : "";
+// Whether the search covers the entry `it` is on: the files the file tree
+// lists. Ignored directories, such as .git or node_modules, are skipped whole.
+static bool search_covers(fs::recursive_directory_iterator& it) {
+    FileType type = file_type_of(it->path());
+    if (type.ignored) {
+        if (it->is_directory()) it.disable_recursion_pending();
+        return false;
+    }
+    return type.source && it->is_regular_file();
+}
+
+std::string overlayKey(const std::string& path) {
+    return fs::path(path).lexically_normal().string();
+}
+
+// Fl_Text_Buffer keeps its text in two runs around the insertion gap.
+// address() is contiguous up to the gap start, so a binary search finds it
+// and both runs can be read in place.
+static void buffer_runs(const Fl_Text_Buffer* buffer, const char** s1, size_t* n1,
+                        const char** s2, size_t* n2) {
+    const int len = buffer->length();
+    const char* base = buffer->address(0);
+    int lo = 0, hi = len + 1;   // address(lo) is contiguous, hi is the first gap-shifted position
+    while (hi - lo > 1) {
+        int mid = lo + (hi - lo) / 2;
+        if (buffer->address(mid) == base + mid) lo = mid;
+        else hi = mid;
+    }
+    const int gap = hi > len ? len : hi;
+    *s1 = base;
+    *n1 = static_cast<size_t>(gap);
+    *s2 = gap < len ? buffer->address(gap) : base + gap;
+    *n2 = static_cast<size_t>(len - gap);
+}
+
+// Matches over text split into two runs. Each run is searched in place; only
+// a few bytes around the seam are copied so straddling matches and word
+// boundaries next to the seam are seen.
+static void scan_runs(const char* s1, size_t n1, const char* s2, size_t n2,
+                      const Matcher& matcher, std::vector<Hit>& hits) {
+    size_t from = 0, pos = 0, mlen = 0;
+    auto add = [&](size_t p, size_t l) {
+        hits.push_back({static_cast<int>(p), static_cast<int>(l)});
+        from = p + l;
+    };
+    if (!n2) {
+        while ((pos = matcher.find(s1, n1, from, &mlen)) != Matcher::npos) add(pos, mlen);
+        return;
+    }
+
+    // First run: keep matches whose following byte is still in the run
+    while ((pos = matcher.find(s1, n1, from, &mlen)) != Matcher::npos && pos + mlen < n1)
+        add(pos, mlen);
+
+    // Seam: matches starting up to and including the first byte of run two
+    const size_t k = matcher.max_match_length() + 2;
+    size_t begin = n1 > k ? n1 - k : 0;
+    if (from > begin) begin = from;
+    const size_t copy_from = begin ? begin - 1 : 0;
+    std::string seam(s1 + copy_from, n1 - copy_from);
+    seam.append(s2, n2 < k ? n2 : k);
+    size_t off = begin - copy_from;
+    while ((pos = matcher.find(seam.data(), seam.size(), off, &mlen)) != Matcher::npos &&
+           copy_from + pos <= n1) {
+        add(copy_from + pos, mlen);
+        off = pos + mlen;
+    }
+
+    // Second run: starting past its first byte keeps the preceding byte in view
+    size_t from2 = (from > n1 + 1 ? from : n1 + 1) - n1;
+    while ((pos = matcher.find(s2, n2, from2, &mlen)) != Matcher::npos) {
+        add(n1 + pos, mlen);
+        from2 = pos + mlen;
+    }
+}
+
+void scanBuffer(const Fl_Text_Buffer* buffer, const Matcher& matcher, std::vector<Hit>& hits) {
+    if (!buffer || matcher.empty() || buffer->length() == 0) return;
+    const char *s1, *s2;
+    size_t n1, n2;
+    buffer_runs(buffer, &s1, &n1, &s2, &n2);
+    scan_runs(s1, n1, s2, n2, matcher, hits);
+}
+
+// Replace [first, last) in one edit; `build` turns the old span into the new one
+template <class Build>
+static void replace_span(Fl_Text_Buffer* buffer, int first, int last, Build build) {
+    char* raw = buffer->text_range(first, last);
+    std::string span = raw ? raw : "";
     free(raw);
-    int count = 0;
-    size_t pos = 0;
-    while ((pos = text.find(keyword, pos)) != std::string::npos) {
-        ++count;
-        pos += keyword.size();
+    buffer->replace(first, last, build(span).c_str());
+}
+
+int replaceHits(Fl_Text_Buffer* buffer, const std::vector<Hit>& hits,
+                const std::string& replacement) {
+    if (!buffer || hits.empty()) return 0;
+    const int first = hits.front().pos;
+    const int last = hits.back().pos + hits.back().len;
+    replace_span(buffer, first, last, [&](const std::string& span) {
+        std::string out;
+        out.reserve(span.size());
+        size_t cursor = 0;
+        for (const Hit& h : hits) {
+            size_t at = static_cast<size_t>(h.pos - first);
+            out.append(span, cursor, at - cursor);
+            out += replacement;
+            cursor = at + h.len;
+        }
+        return out;
+    });
+    return static_cast<int>(hits.size());
+}
+
+int findInBuffer(Fl_Text_Buffer* buffer, const std::string& keyword, const Options& opts) {
+    if (!buffer || keyword.empty()) return 0;
+    std::vector<Hit> hits;
+    scanBuffer(buffer, Matcher(keyword, opts), hits);
+    return static_cast<int>(hits.size());
+}
+
+// Copy of text with every match of `matcher` replaced; *count gets the number
+static std::string replace_all(const std::string& text, const Matcher& matcher,
+                               const std::string& replacement, int* count) {
+    std::string out;
+    size_t last = 0, pos = 0, len = 0;
+    *count = 0;
+    while ((pos = matcher.find(text.data(), text.size(), last, &len)) != Matcher::npos) {
+        if (!*count) out.reserve(text.size());
+        out.append(text, last, pos - last);
+        out += replacement;
+        last = pos + len;
+        ++*count;
     }
-    return count;
+    if (*count) out.append(text, last, std::string::npos);
+    return out;
 }
 
 int replaceInBuffer(Fl_Text_Buffer* buffer, const std::string& keyword,
-                    const std::string& replacement) {
+                    const std::string& replacement, const Options& opts) {
     if (!buffer || keyword.empty()) return 0;
-    char* raw = buffer->text();
-    std::string text = raw ? raw : "";
-    free(raw);
-    int count = 0;
-    size_t pos = 0;
-    while ((pos = text.find(keyword, pos)) != std::string::npos) {
-        text.replace(pos, keyword.size(), replacement);
-        pos += replacement.size();
-        ++count;
-    }
-    if (count > 0) buffer->text(text.c_str());
-    return count;
+    std::vector<Hit> hits;
+    scanBuffer(buffer, Matcher(keyword, opts), hits);
+    return replaceHits(buffer, hits, replacement);
+}
+
+// Open document for a path found on disk, if any
+static OpenDocument* find_open(const Overlay* overlay, const fs::path& path) {
+    if (!overlay || overlay->empty()) return nullptr;
+    auto it = overlay->find(overlayKey(path.string()));
+    return it == overlay->end() ? nullptr : const_cast<OpenDocument*>(&it->second);
 }
 
-static int count_in_file(const fs::path& file, const std::string& keyword,
-                         std::string* content_out = nullptr) {
+static bool read_text_file(const fs::path& file, std::string& content) {
     std::ifstream ifs(file, std::ios::binary);
-    if (!ifs) return 0;
+    if (!ifs) return false;
     std::ostringstream oss;
     oss << ifs.rdbuf();
-    std::string content = oss.str();
-    if (content.find('\0') != std::string::npos) return 0; // skip binary
-    if (content_out) *content_out = content;
-    int count = 0;
-    size_t pos = 0;
-    while ((pos = content.find(keyword, pos)) != std::string::npos) {
-        ++count;
-        pos += keyword.size();
-    }
-    return count;
+    content = oss.str();
+    return content.find('\0') == std::string::npos; // skip binary
+}
+
+static int count_in_file(const fs::path& file, const Matcher& matcher) {
+    std::string content;
+    if (!read_text_file(file, content)) return 0;
+    return matcher.count(content.data(), content.size());
 }
 
 int findInFolder(const std::string& folderPath, const std::string& keyword,
-                 std::string* firstPath) {
+                 std::string* firstPath, const Options& opts, const Overlay* overlay) {
     if (keyword.empty()) return 0;
+    Matcher matcher(keyword, opts);
     int total = 0;
-    for (const auto& entry : fs::recursive_directory_iterator(folderPath)) {
-        if (!entry.is_regular_file()) continue;
-        if (!is_text_file(entry.path())) continue;
-        int found = count_in_file(entry.path(), keyword);
+    std::vector<Hit> hits;
+    for (auto it = fs::recursive_directory_iterator(folderPath); it != fs::recursive_directory_iterator(); ++it) {
+        if (!search_covers(it)) continue;
+        const fs::directory_entry& entry = *it;
+        int found = 0;
+        if (OpenDocument* doc = find_open(overlay, entry.path())) {
+            hits.clear();
+            scanBuffer(doc->buffer, matcher, hits);
+            found = static_cast<int>(hits.size());
+        } else {
+            found = count_in_file(entry.path(), matcher);
+        }
         if (found) {
             if (firstPath && firstPath->empty())
                 *firstPath = entry.path().string();
@@ -80,23 +214,25 @@ int findInFolder(const std::string& folderPath, const std::string& keyword,
 }
 
 int replaceInFolder(const std::string& folderPath, const std::string& keyword,
-                    const std::string& replacement) {
+                    const std::string& replacement, const Options& opts, Overlay* overlay) {
     if (keyword.empty()) return 0;
+    Matcher matcher(keyword, opts);
     int total = 0;
-    for (const auto& entry : fs::recursive_directory_iterator(folderPath)) {
-        if (!entry.is_regular_file()) continue;
-        if (!is_text_file(entry.path())) continue;
-        std::string content;
-        int found = count_in_file(entry.path(), keyword, &content);
-        if (!found) continue;
-        std::string replaced = content;
-        size_t pos = 0;
-        int cnt = 0;
-        while ((pos = replaced.find(keyword, pos)) != std::string::npos) {
-            replaced.replace(pos, keyword.size(), replacement);
-            pos += replacement.size();
-            ++cnt;
+    std::string content;
+    std::vector<Hit> hits;
+    for (auto it = fs::recursive_directory_iterator(folderPath); it != fs::recursive_directory_iterator(); ++it) {
+        if (!search_covers(it)) continue;
+        const fs::directory_entry& entry = *it;
+        if (OpenDocument* doc = find_open(overlay, entry.path())) {
+            hits.clear();
+            scanBuffer(doc->buffer, matcher, hits);
+            if (replaceHits(doc->buffer, hits, replacement)) doc->changed = true;
+            total += static_cast<int>(hits.size());
+            continue;
         }
+        if (!read_text_file(entry.path(), content)) continue;
+        int cnt = 0;
+        std::string replaced = replace_all(content, matcher, replacement, &cnt);
         if (cnt) {
             std::ofstream ofs(entry.path(), std::ios::binary | std::ios::trunc);
             if (ofs) {
@@ -108,4 +244,92 @@ int replaceInFolder(const std::string& folderPath, const std::string& keyword,
     return total;
 }
 
+static AhoCorasick compile_pairs(const ReplacePairs& pairs, const Options& opts) {
+    std::vector<std::string> patterns;
+    patterns.reserve(pairs.size());
+    for (const auto& pair : pairs) patterns.push_back(pair.first);
+    return AhoCorasick(patterns, opts);
+}
+
+// Rebuild text with every match swapped for its replacement
+static std::string apply_matches(const std::string& text, const ReplacePairs& pairs,
+                                 const std::vector<AhoCorasick::Match>& matches) {
+    std::string out;
+    out.reserve(text.size());
+    size_t last = 0;
+    for (const auto& m : matches) {
+        out.append(text, last, m.start - last);
+        out += pairs[m.pattern].second;
+        last = m.start + m.length;
+    }
+    out.append(text, last, std::string::npos);
+    return out;
+}
+
+// Batch matches over a buffer, fed to the scanner run by run
+static void scan_buffer_many(const Fl_Text_Buffer* buffer, const AhoCorasick& ac,
+                             std::vector<AhoCorasick::Match>& matches) {
+    const char *s1, *s2;
+    size_t n1, n2;
+    buffer_runs(buffer, &s1, &n1, &s2, &n2);
+    AhoCorasick::Scanner scanner(ac);
+    scanner.feed(s1, n1, matches);
+    scanner.feed(s2, n2, matches);
+    scanner.finish(matches);
+}
+
+static int replace_many_in(Fl_Text_Buffer* buffer, const AhoCorasick& ac,
+                           const ReplacePairs& pairs) {
+    std::vector<AhoCorasick::Match> matches;
+    scan_buffer_many(buffer, ac, matches);
+    if (matches.empty()) return 0;
+    const size_t first = matches.front().start;
+    const size_t last = matches.back().start + matches.back().length;
+    for (auto& m : matches) m.start -= first;
+    replace_span(buffer, static_cast<int>(first), static_cast<int>(last),
+                 [&](const std::string& span) { return apply_matches(span, pairs, matches); });
+    return static_cast<int>(matches.size());
+}
+
+int replaceManyInBuffer(Fl_Text_Buffer* buffer, const ReplacePairs& pairs,
+                        const Options& opts) {
+    if (!buffer || pairs.empty()) return 0;
+    AhoCorasick ac = compile_pairs(pairs, opts);
+    if (ac.empty()) return 0;
+    return replace_many_in(buffer, ac, pairs);
+}
+
+int replaceManyInFolder(const std::string& folderPath, const ReplacePairs& pairs,
+                        std::vector<std::string>* changedPaths, const Options& opts,
+                        Overlay* overlay) {
+    AhoCorasick ac = compile_pairs(pairs, opts);
+    if (ac.empty()) return 0;
+    int total = 0;
+    std::string content;
+    std::vector<AhoCorasick::Match> matches;
+    for (auto it = fs::recursive_directory_iterator(folderPath); it != fs::recursive_directory_iterator(); ++it) {
+        if (!search_covers(it)) continue;
+        const fs::directory_entry& entry = *it;
+        if (OpenDocument* doc = find_open(overlay, entry.path())) {
+            int n = replace_many_in(doc->buffer, ac, pairs);
+            if (n) doc->changed = true;
+            total += n;
+            continue;
+        }
+        if (!read_text_file(entry.path(), content)) continue;
+        matches.clear();
+        AhoCorasick::Scanner scanner(ac);
+        scanner.feed(content.data(), content.size(), matches);
+        scanner.finish(matches);
+        if (matches.empty()) continue;
+        std::ofstream ofs(entry.path(), std::ios::binary | std::ios::trunc);
+        if (ofs) {
+            ofs << apply_matches(content, pairs, matches);
+            total += static_cast<int>(matches.size());
+            if (changedPaths) changedPaths->push_back(entry.path().string());
+        }
+    }
+    return total;
+}
+
 }
\ No newline at end of file
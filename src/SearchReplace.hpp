@@ -1,18 +1,61 @@
 #pragma once
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <FL/Fl_Text_Buffer.H>
+#include "text_matcher.hpp"
 
 namespace SearchReplace {
+    // Documents open in the editor shadow their files on disk: searches read
+    // the buffer in place and replacements become undoable buffer edits
+    struct OpenDocument {
+        Fl_Text_Buffer* buffer = nullptr;
+        bool changed = false;   // set when a replace edited the buffer
+    };
+    using Overlay = std::unordered_map<std::string, OpenDocument>;
+
+    // Key used for overlay lookups, so "a/./b" and "a/b" meet
+    std::string overlayKey(const std::string& path);
+
+    struct Hit {
+        int pos;
+        int len;
+    };
+
+    // Every match in the buffer, read in place on both sides of the gap
+    void scanBuffer(const Fl_Text_Buffer* buffer, const Matcher& matcher, std::vector<Hit>& hits);
+
+    // Replace all hits with one buffer edit, so a single undo reverts them
+    int replaceHits(Fl_Text_Buffer* buffer, const std::vector<Hit>& hits,
+                    const std::string& replacement);
+
     // Search in current buffer
-    int findInBuffer(Fl_Text_Buffer* buffer, const std::string& keyword);
+    int findInBuffer(Fl_Text_Buffer* buffer, const std::string& keyword,
+                     const Options& opts = Options());
 
     // Replace in current buffer
-    int replaceInBuffer(Fl_Text_Buffer* buffer, const std::string& keyword, const std::string& replacement);
+    int replaceInBuffer(Fl_Text_Buffer* buffer, const std::string& keyword, const std::string& replacement,
+                        const Options& opts = Options());
 
     // Search recursively in all text files under a folder
     int findInFolder(const std::string& folderPath, const std::string& keyword,
-                     std::string* firstPath = nullptr);
+                     std::string* firstPath = nullptr, const Options& opts = Options(),
+                     const Overlay* overlay = nullptr);
 
     // Replace in all text files under a folder
-    int replaceInFolder(const std::string& folderPath, const std::string& keyword, const std::string& replacement);
+    int replaceInFolder(const std::string& folderPath, const std::string& keyword, const std::string& replacement,
+                        const Options& opts = Options(), Overlay* overlay = nullptr);
+
+    // (search, replace) pairs applied together, leftmost-longest match wins
+    using ReplacePairs = std::vector<std::pair<std::string, std::string>>;
+
+    // Apply all pairs to the buffer in a single pass
+    int replaceManyInBuffer(Fl_Text_Buffer* buffer, const ReplacePairs& pairs,
+                            const Options& opts = Options());
+
+    // Apply all pairs to every text file under a folder, one pass per file
+    int replaceManyInFolder(const std::string& folderPath, const ReplacePairs& pairs,
+                            std::vector<std::string>* changedPaths = nullptr,
+                            const Options& opts = Options(), Overlay* overlay = nullptr);
 }
\ No newline at end of file
@@ -0,0 +1,226 @@
+#include "aho_corasick.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace SearchReplace {
+
+AhoCorasick::AhoCorasick(const std::vector<std::string>& patterns, const Options& opts)
+    : opts_(opts) {
+    const bool fold = !opts_.match_case;
+    auto key = [fold](unsigned char c) { return fold ? ascii_lower(c) : c; };
+
+    // Byte classes cannot fold other letters: their cases differ in more
+    // than one byte, or in length
+    bool unicode = false;
+    for (const std::string& p : patterns) {
+        for (unsigned char c : p) unicode |= fold && c >= 0x80;
+    }
+    if (unicode) {
+        memset(byte_class_, 0, sizeof(byte_class_));
+        depth_.push_back(0);
+        for (const std::string& p : patterns) {
+            lengths_.push_back(p.size());
+            max_length_ = std::max(max_length_, p.size());
+            matchers_.emplace_back(p, opts_);
+        }
+        return;
+    }
+
+    // Map every byte used by a pattern to its own class, everything else to 0
+    memset(byte_class_, 0, sizeof(byte_class_));
+    for (const std::string& p : patterns) {
+        for (unsigned char c : p) {
+            c = key(c);
+            if (!byte_class_[c]) byte_class_[c] = static_cast<uint16_t>(num_classes_++);
+        }
+    }
+    if (fold) {
+        for (int c = 'A'; c <= 'Z'; ++c) byte_class_[c] = byte_class_[c + ('a' - 'A')];
+    }
+
+    // Build the trie; -1 marks a missing edge until the BFS below fills it
+    delta_.assign(num_classes_, -1);
+    depth_.push_back(0);
+    out_.push_back(-1);
+    lengths_.reserve(patterns.size());
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        const std::string& p = patterns[i];
+        lengths_.push_back(p.size());
+        if (p.size() > max_length_) max_length_ = p.size();
+        edges_.push_back(p.empty() ? 0 : static_cast<uint8_t>(
+            (is_word_byte(p.front()) ? 1 : 0) | (is_word_byte(p.back()) ? 2 : 0)));
+        if (p.empty()) continue;
+        int32_t s = 0;
+        for (unsigned char c : p) {
+            int32_t& next = delta_[s * num_classes_ + byte_class_[c]];
+            if (next < 0) {
+                next = static_cast<int32_t>(depth_.size());
+                depth_.push_back(depth_[s] + 1);
+                out_.push_back(-1);
+                delta_.resize(delta_.size() + num_classes_, -1);
+            }
+            s = delta_[s * num_classes_ + byte_class_[c]];
+        }
+        if (out_[s] < 0) out_[s] = static_cast<int32_t>(i); // first duplicate wins
+    }
+
+    // Breadth-first: compute failure links and turn the trie into a full DFA
+    const size_t states = depth_.size();
+    std::vector<int32_t> fail(states, 0);
+    dict_.assign(states, -1);
+    std::vector<int32_t> queue;
+    queue.reserve(states);
+    for (int32_t c = 0; c < num_classes_; ++c) {
+        int32_t& next = delta_[c];
+        if (next < 0) {
+            next = 0;
+        } else {
+            fail[next] = 0;
+            queue.push_back(next);
+        }
+    }
+    for (size_t head = 0; head < queue.size(); ++head) {
+        int32_t s = queue[head];
+        int32_t f = fail[s];
+        dict_[s] = out_[f] >= 0 ? f : dict_[f];
+        for (int32_t c = 0; c < num_classes_; ++c) {
+            int32_t& next = delta_[s * num_classes_ + c];
+            if (next < 0) {
+                next = delta_[f * num_classes_ + c];
+            } else {
+                fail[next] = delta_[f * num_classes_ + c];
+                queue.push_back(next);
+            }
+        }
+    }
+}
+
+AhoCorasick::Scanner::Scanner(const AhoCorasick& ac) : ac_(ac) {
+    if (!ac_.opts_.whole_word) return;
+    size_t n = 1;
+    while (n < ac_.max_length_ + 1) n <<= 1;
+    history_.assign(n, 0);
+    history_mask_ = n - 1;
+}
+
+// Is the byte just before `start` a word byte? Bytes before the text are not.
+bool AhoCorasick::Scanner::word_before(size_t start) const {
+    return start > 0 && is_word_byte(history_[(start - 1) & history_mask_]);
+}
+
+// Settle matches that ended one byte ago now that the following byte is known
+void AhoCorasick::Scanner::record_pending(bool word_after) {
+    for (const Match& m : pending_) {
+        if (word_after && (ac_.edges_[m.pattern] & 2)) continue;
+        record(m.start, m.length, m.pattern);
+    }
+    pending_.clear();
+}
+
+void AhoCorasick::Scanner::record(size_t start, size_t length, int pattern) {
+    // Candidates arrive nearly sorted; scan from the back
+    auto it = candidates_.end();
+    while (it != candidates_.begin() && (it - 1)->start > start) --it;
+    if (it != candidates_.begin() && (it - 1)->start == start) {
+        if ((it - 1)->length < length) *(it - 1) = {start, length, pattern};
+        return;
+    }
+    candidates_.insert(it, {start, length, pattern});
+}
+
+void AhoCorasick::Scanner::commit_before(size_t limit, std::vector<Match>& out) {
+    while (!candidates_.empty() && candidates_.front().start < limit) {
+        const Match& m = candidates_.front();
+        if (m.start >= emitted_) {
+            out.push_back(m);
+            emitted_ = m.start + m.length;
+        }
+        candidates_.pop_front();
+    }
+}
+
+void AhoCorasick::Scanner::feed(const char* data, size_t len, std::vector<Match>& out) {
+    if (!ac_.matchers_.empty()) {
+        text_.append(data, len);
+        return;
+    }
+    const int32_t* delta = ac_.delta_.data();
+    const int32_t nc = ac_.num_classes_;
+    const bool whole_word = ac_.opts_.whole_word;
+    int32_t s = state_;
+    size_t pos = pos_;
+    for (size_t i = 0; i < len; ++i) {
+        const unsigned char c = static_cast<unsigned char>(data[i]);
+        s = delta[s * nc + ac_.byte_class_[c]];
+        if (whole_word) {
+            if (!pending_.empty()) record_pending(is_word_byte(c));
+            history_[pos & history_mask_] = c;
+        }
+        ++pos;
+
+        // Every match ending here, longest (leftmost) first
+        for (int32_t st = ac_.out_[s] >= 0 ? s : ac_.dict_[s]; st >= 0; st = ac_.dict_[st]) {
+            int pat = ac_.out_[st];
+            size_t start = pos - ac_.lengths_[pat];
+            if (start < emitted_) continue;
+            if (!whole_word) {
+                record(start, ac_.lengths_[pat], pat);
+            } else if (!((ac_.edges_[pat] & 1) && word_before(start))) {
+                pending_.push_back({start, ac_.lengths_[pat], pat});
+            }
+        }
+
+        // No future match can start before pos - depth, so those starts are final
+        if (!candidates_.empty()) commit_before(pos - ac_.depth_[s], out);
+    }
+    state_ = s;
+    pos_ = pos;
+}
+
+void AhoCorasick::Scanner::finish(std::vector<Match>& out) {
+    if (!ac_.matchers_.empty()) {
+        ac_.find_folded(text_.data(), text_.size(), out);
+        text_.clear();
+        return;
+    }
+    record_pending(false);
+    commit_before(static_cast<size_t>(-1), out);
+    state_ = 0;
+}
+
+// The same leftmost-longest, non-overlapping matches as the automaton: the
+// earliest start wins, then the longest match, then the lower pattern
+void AhoCorasick::find_folded(const char* text, size_t len, std::vector<Match>& out) const {
+    struct Next {
+        size_t pos = 0, length = 0;
+        bool found = false;  // pos is a match at or after `from`, or npos
+    };
+    std::vector<Next> next(matchers_.size());
+    size_t from = 0;
+    for (;;) {
+        int best = -1;
+        for (size_t i = 0; i < matchers_.size(); ++i) {
+            Next& n = next[i];
+            if (!n.found || (n.pos != Matcher::npos && n.pos < from)) {
+                n.pos = matchers_[i].find(text, len, from, &n.length);
+                n.found = true;
+            }
+            if (n.pos == Matcher::npos) continue;
+            if (best < 0 || n.pos < next[best].pos || (n.pos == next[best].pos && n.length > next[best].length))
+                best = static_cast<int>(i);
+        }
+        if (best < 0) return;
+        out.push_back({next[best].pos, next[best].length, best});
+        from = next[best].pos + next[best].length;
+    }
+}
+
+std::vector<AhoCorasick::Match> AhoCorasick::find_all(std::string_view text) const {
+    std::vector<Match> matches;
+    Scanner scanner(*this);
+    scanner.feed(text.data(), text.size(), matches);
+    scanner.finish(matches);
+    return matches;
+}
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "text_matcher.hpp"
+
+namespace SearchReplace {
+
+// Multi-pattern matcher compiled into a dense Aho-Corasick automaton.
+// Bytes that never occur in a pattern share one input class, so the
+// transition table stays small no matter how many patterns are added.
+// Ignoring case folds ASCII letters into shared classes; whole-word checks
+// the bytes on either side of a match before it becomes a candidate. When
+// case is ignored and a pattern has non-ASCII bytes, every pattern is found
+// with its own Matcher instead, so letters fold as in a single search.
+class AhoCorasick {
+public:
+    struct Match {
+        size_t start;
+        size_t length;
+        int pattern;
+    };
+
+    explicit AhoCorasick(const std::vector<std::string>& patterns,
+                         const Options& opts = Options());
+
+    bool empty() const { return matchers_.empty() && depth_.size() <= 1; }
+    size_t size() const { return lengths_.size(); }
+
+    // Incremental scanner: feed consecutive chunks of one text and collect
+    // leftmost-longest, non-overlapping matches in increasing start order.
+    class Scanner {
+    public:
+        explicit Scanner(const AhoCorasick& ac);
+        void feed(const char* data, size_t len, std::vector<Match>& out);
+        void finish(std::vector<Match>& out);
+
+    private:
+        void record(size_t start, size_t length, int pattern);
+        void commit_before(size_t limit, std::vector<Match>& out);
+        bool word_before(size_t start) const;
+        void record_pending(bool word_after);
+
+        const AhoCorasick& ac_;
+        int32_t state_ = 0;
+        size_t pos_ = 0;
+        size_t emitted_ = 0;
+        std::deque<Match> candidates_; // longest match per start, sorted by start
+        std::vector<Match> pending_;   // whole-word: matches waiting for the next byte
+        std::vector<unsigned char> history_; // whole-word: recent bytes, ring buffer
+        size_t history_mask_ = 0;
+        std::string text_;             // Unicode folding: everything fed, matched at finish
+    };
+
+    std::vector<Match> find_all(std::string_view text) const;
+
+private:
+    void find_folded(const char* text, size_t len, std::vector<Match>& out) const;
+
+    Options opts_;
+    uint16_t byte_class_[256];     // up to 257 classes: 0 plus every byte
+    int32_t num_classes_ = 1;
+    std::vector<int32_t> delta_;   // states * num_classes_
+    std::vector<int32_t> depth_;   // length of the prefix a state spells
+    std::vector<int32_t> out_;     // longest pattern ending here, or -1
+    std::vector<int32_t> dict_;    // nearest suffix state with an output, or -1
+    std::vector<size_t> lengths_;  // pattern index -> pattern length
+    std::vector<uint8_t> edges_;   // bit 0/1: pattern starts/ends with a word byte
+    size_t max_length_ = 0;
+    std::vector<Matcher> matchers_; // Unicode folding: one per pattern, no automaton
+};
+
+}
@@ -0,0 +1,42 @@
+#include "background_jobs.hpp"
+#include <FL/Fl.H>
+#include <algorithm>
+#include <thread>
+
+namespace {
+// What the worker hands back to the main thread
+struct Finished {
+    BackgroundJobs* jobs;
+    std::shared_ptr<BackgroundJob> job;
+};
+}
+
+void BackgroundJobs::progress_tick(void* self) {
+    BackgroundJobs* jobs = static_cast<BackgroundJobs*>(self);
+    if (jobs->running_.empty()) return;
+    for (const auto& job : jobs->running_) job->report_progress();
+    Fl::repeat_timeout(PROGRESS_INTERVAL, progress_tick, self);
+}
+
+// Runs on the main thread once a worker is finished
+void BackgroundJobs::job_finished(void* data) {
+    std::unique_ptr<Finished> finished(static_cast<Finished*>(data));
+    std::vector<std::shared_ptr<BackgroundJob>>& running = finished->jobs->running_;
+    running.erase(std::remove(running.begin(), running.end(), finished->job), running.end());
+    if (running.empty()) Fl::remove_timeout(progress_tick, finished->jobs);
+    finished->job->report_done();
+}
+
+void BackgroundJobs::start(std::shared_ptr<BackgroundJob> job) {
+    if (running_.empty()) Fl::add_timeout(PROGRESS_INTERVAL, progress_tick, this);
+    running_.push_back(job);
+
+    std::thread([this, job]() {
+        job->run();
+        Fl::awake(job_finished, new Finished{this, job});
+    }).detach();
+}
+
+void BackgroundJobs::cancel_all() {
+    for (const auto& job : running_) job->cancelled = true;
+}
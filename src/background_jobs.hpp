@@ -0,0 +1,39 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A file operation run on a worker thread of its own. The worker touches
+// only what run() updates, `cancelled` and, before it returns, `error`.
+struct BackgroundJob {
+    virtual ~BackgroundJob() = default;
+
+    // Worker thread: the whole operation
+    virtual void run() = 0;
+    // Main thread: while the job runs, every BackgroundJobs::PROGRESS_INTERVAL
+    virtual void report_progress() {}
+    // Main thread: once run() has returned
+    virtual void report_done() = 0;
+
+    std::atomic<bool> cancelled{false};
+    std::string error;  // the first entry that failed
+};
+
+// The running jobs of one kind. Their progress is reported on one timer,
+// and each is reported done through Fl::awake.
+class BackgroundJobs {
+public:
+    static constexpr double PROGRESS_INTERVAL = 0.1;
+
+    void start(std::shared_ptr<BackgroundJob> job);
+    // Stop every running job at its next step
+    void cancel_all();
+    bool pending() const { return !running_.empty(); }
+
+private:
+    static void progress_tick(void* self);
+    static void job_finished(void* data);
+
+    std::vector<std::shared_ptr<BackgroundJob>> running_;  // main thread only
+};
@@ -0,0 +1,482 @@
+#include "diff_gutter.hpp"
+#include "globals.hpp"
+#include "editor_window.hpp"
+#include "line_layout.hpp"
+#include <FL/Fl.H>
+#include <FL/Fl_Text_Buffer.H>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// A run of lines that differs: base lines [base_start, +base_count) of the
+// file became current lines [cur_start, +cur_count) of the document
+struct Hunk {
+    int cur_start, cur_count;
+    int base_start, base_count;
+};
+
+// ======================
+// Line Diff
+// ======================
+
+typedef std::vector<uint64_t> LineHashes;
+
+// Myers gives up beyond this many inserted and deleted lines
+static const int MAX_EDIT_COST = 1024;
+// Larger stretches are first split at lines found once on each side
+static const int PATIENCE_ABOVE = 4096;
+
+static void hash_lines(const char* text, size_t length, LineHashes& out) {
+    uint64_t h = 1469598103934665603ull;  // FNV-1a, line by line
+    for (size_t i = 0; i < length; ++i) {
+        if (text[i] == '\n') {
+            out.push_back(h);
+            h = 1469598103934665603ull;
+        } else {
+            h = (h ^ (unsigned char)text[i]) * 1099511628211ull;
+        }
+    }
+    out.push_back(h);
+}
+
+static void diff_range(const LineHashes& a, int a0, int a1, const LineHashes& b, int b0, int b1,
+                       std::vector<Hunk>& out);
+
+// Runs of matching lines, as (a, b, length) in order, turned into the
+// hunks between them
+struct Match {
+    int a, b, length;
+};
+
+static void hunks_between(const std::vector<Match>& matches, int a0, int a1, int b0, int b1,
+                          std::vector<Hunk>& out) {
+    int a = a0, b = b0;
+    for (const Match& m : matches) {
+        if (m.a > a || m.b > b) out.push_back({b, m.b - b, a, m.a - a});
+        a = m.a + m.length;
+        b = m.b + m.length;
+    }
+    if (a < a1 || b < b1) out.push_back({b, b1 - b, a, a1 - a});
+}
+
+// Greedy Myers, keeping each round's furthest reaching paths to walk back
+// along. False if the shortest script costs more than MAX_EDIT_COST.
+static bool myers(const LineHashes& a, int a0, int a1, const LineHashes& b, int b0, int b1,
+                  std::vector<Hunk>& out) {
+    const int n = a1 - a0, m = b1 - b0;
+    const int max = std::min(n + m, MAX_EDIT_COST);
+    const int offset = max + 1;
+    std::vector<int> v(2 * max + 3, 0);
+    // rounds[d][(k + d) / 2]: furthest x on diagonal k after round d
+    std::vector<std::vector<int>> rounds;
+    int cost = -1;
+    for (int d = 0; d <= max && cost < 0; ++d) {
+        for (int k = -d; k <= d; k += 2) {
+            int x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) ? v[offset + k + 1]
+                                                                                  : v[offset + k - 1] + 1;
+            int y = x - k;
+            while (x < n && y < m && a[a0 + x] == b[b0 + y]) ++x, ++y;
+            v[offset + k] = x;
+            if (x >= n && y >= m) {
+                cost = d;
+                break;
+            }
+        }
+        if (cost >= 0) break;
+        std::vector<int> round;
+        round.reserve(d + 1);
+        for (int k = -d; k <= d; k += 2) round.push_back(v[offset + k]);
+        rounds.push_back(std::move(round));
+    }
+    if (cost < 0) return false;
+
+    auto furthest = [&rounds](int d, int k) { return rounds[d][(k + d) / 2]; };
+    std::vector<Match> matches;
+    int x = n, y = m;
+    for (int d = cost; d > 0; --d) {
+        int k = x - y;
+        bool down = k == -d || (k != d && furthest(d - 1, k - 1) < furthest(d - 1, k + 1));
+        int prev_k = down ? k + 1 : k - 1;
+        int prev_x = furthest(d - 1, prev_k);
+        int mid_x = down ? prev_x : prev_x + 1;
+        if (x > mid_x) matches.push_back({a0 + mid_x, b0 + mid_x - k, x - mid_x});
+        x = prev_x;
+        y = prev_x - prev_k;
+    }
+    if (x > 0) matches.push_back({a0, b0, x});
+    std::reverse(matches.begin(), matches.end());
+    hunks_between(matches, a0, a1, b0, b1, out);
+    return true;
+}
+
+// Patience: lines found exactly once on each side, kept in the longest
+// order both sides agree on, anchor the stretches diffed in between.
+// False if no line is unique on both sides.
+static bool patience(const LineHashes& a, int a0, int a1, const LineHashes& b, int b0, int b1,
+                     std::vector<Hunk>& out) {
+    struct Seen {
+        int in_a = 0, in_b = 0;
+        int at_a = 0, at_b = 0;
+    };
+    std::unordered_map<uint64_t, Seen> seen;
+    for (int i = a0; i < a1; ++i) {
+        Seen& s = seen[a[i]];
+        ++s.in_a;
+        s.at_a = i;
+    }
+    for (int i = b0; i < b1; ++i) {
+        auto it = seen.find(b[i]);
+        if (it == seen.end()) continue;
+        ++it->second.in_b;
+        it->second.at_b = i;
+    }
+    std::vector<std::pair<int, int>> unique;  // (a, b), by a
+    for (int i = a0; i < a1; ++i) {
+        const Seen& s = seen[a[i]];
+        if (s.in_a == 1 && s.in_b == 1) unique.emplace_back(i, s.at_b);
+    }
+    if (unique.empty()) return false;
+
+    // Longest increasing run of b positions, by patience sorting
+    std::vector<int> tails, back(unique.size(), -1), tail_of;
+    for (size_t i = 0; i < unique.size(); ++i) {
+        auto pos = std::lower_bound(tails.begin(), tails.end(), unique[i].second);
+        size_t pile = pos - tails.begin();
+        if (pile > 0) back[i] = tail_of[pile - 1];
+        if (pos == tails.end()) {
+            tails.push_back(unique[i].second);
+            tail_of.push_back((int)i);
+        } else {
+            *pos = unique[i].second;
+            tail_of[pile] = (int)i;
+        }
+    }
+    std::vector<int> anchors;
+    for (int i = tail_of.back(); i >= 0; i = back[i]) anchors.push_back(i);
+    std::reverse(anchors.begin(), anchors.end());
+
+    int pa = a0, pb = b0;
+    for (int i : anchors) {
+        diff_range(a, pa, unique[i].first, b, pb, unique[i].second, out);
+        pa = unique[i].first + 1;
+        pb = unique[i].second + 1;
+    }
+    diff_range(a, pa, a1, b, pb, b1, out);
+    return true;
+}
+
+// Append the hunks turning a[a0, a1) into b[b0, b1)
+static void diff_range(const LineHashes& a, int a0, int a1, const LineHashes& b, int b0, int b1,
+                       std::vector<Hunk>& out) {
+    while (a0 < a1 && b0 < b1 && a[a0] == b[b0]) ++a0, ++b0;
+    while (a0 < a1 && b0 < b1 && a[a1 - 1] == b[b1 - 1]) --a1, --b1;
+    if (a0 == a1 && b0 == b1) return;
+    if (a0 == a1 || b0 == b1) {
+        out.push_back({b0, b1 - b0, a0, a1 - a0});
+        return;
+    }
+    bool large = (a1 - a0) + (b1 - b0) > PATIENCE_ABOVE;
+    if (large && patience(a, a0, a1, b, b0, b1, out)) return;
+    if (myers(a, a0, a1, b, b0, b1, out)) return;
+    if (!large && patience(a, a0, a1, b, b0, b1, out)) return;
+    out.push_back({b0, b1 - b0, a0, a1 - a0});  // too far apart to be worth lining up
+}
+
+// ======================
+// Worker
+// ======================
+
+struct DiffRequest {
+    enum Kind { OPEN, EDIT, BASE } kind;
+    unsigned long session;
+    std::string path;  // OPEN
+    std::string text;  // OPEN: the whole document; EDIT: the lines now in place
+    int line;          // EDIT: first line replaced
+    int old_lines;     // EDIT: how many
+};
+
+// Never destroyed: the worker may still be waiting on it at exit
+struct DiffShared {
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<DiffRequest> requests;
+    unsigned long session = 0;
+    bool running = false;
+    // Latest result, for the main thread
+    std::vector<Hunk> hunks;
+    int lines = 0;
+    bool fresh = false;
+};
+
+static DiffShared& shared() {
+    static DiffShared* s = new DiffShared;
+    return *s;
+}
+
+// The document as the worker knows it; worker thread only
+struct DiffState {
+    unsigned long session = 0;
+    std::string path;
+    LineHashes base;
+    LineHashes lines;
+    std::vector<Hunk> hunks;  // by cur_start
+};
+
+static void load_base(DiffState& state) {
+    state.base.clear();
+    FILE* fp = fopen(state.path.c_str(), "rb");
+    if (!fp) return;  // not written yet: every line is new
+    std::string data;
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) data.append(buf, n);
+    fclose(fp);
+    hash_lines(data.data(), data.size(), state.base);
+}
+
+static void diff_all(DiffState& state) {
+    state.hunks.clear();
+    diff_range(state.base, 0, (int)state.base.size(), state.lines, 0, (int)state.lines.size(), state.hunks);
+}
+
+// Base line that current line `cur` stands for, where `before` is the last
+// hunk ending at or before it (-1 for none)
+static int base_line(const std::vector<Hunk>& hunks, int before, int cur) {
+    if (before < 0) return cur;
+    const Hunk& h = hunks[before];
+    return h.base_start + h.base_count + (cur - (h.cur_start + h.cur_count));
+}
+
+// Lines [line, line + old_lines) became `text`. Only the stretch from the
+// unchanged line before the edit, and any hunk it touches, to the
+// unchanged line after it is diffed again.
+static void apply_edit(DiffState& state, int line, int old_lines, const std::string& text) {
+    LineHashes fresh;
+    hash_lines(text.data(), text.size(), fresh);
+    int size = (int)state.lines.size();
+    line = std::min(std::max(line, 0), size);
+    old_lines = std::min(std::max(old_lines, 0), size - line);
+    state.lines.erase(state.lines.begin() + line, state.lines.begin() + line + old_lines);
+    state.lines.insert(state.lines.begin() + line, fresh.begin(), fresh.end());
+    int delta = (int)fresh.size() - old_lines;
+
+    std::vector<Hunk>& hunks = state.hunks;
+    int lo = line, hi = line + old_lines;
+    size_t first = std::lower_bound(hunks.begin(), hunks.end(), lo,
+                                    [](const Hunk& h, int at) { return h.cur_start + h.cur_count < at; }) -
+                   hunks.begin();
+    size_t last = first;
+    for (; last < hunks.size() && hunks[last].cur_start <= hi; ++last) {
+        lo = std::min(lo, hunks[last].cur_start);
+        hi = std::max(hi, hunks[last].cur_start + hunks[last].cur_count);
+    }
+    int base_lo = base_line(hunks, (int)first - 1, lo);
+    int base_hi = base_line(hunks, (int)last - 1, hi);
+
+    std::vector<Hunk> redone;
+    diff_range(state.base, base_lo, base_hi, state.lines, lo, hi + delta, redone);
+    for (size_t i = last; i < hunks.size(); ++i) hunks[i].cur_start += delta;
+    hunks.erase(hunks.begin() + first, hunks.begin() + last);
+    hunks.insert(hunks.begin() + first, redone.begin(), redone.end());
+}
+
+static void diff_ready(void*) {
+    if (editor) editor->damage(FL_DAMAGE_USER1);
+}
+
+static void diff_main() {
+    DiffShared& s = shared();
+    DiffState state;
+    std::unique_lock<std::mutex> lock(s.mutex);
+    for (;;) {
+        s.wake.wait(lock, [&s] { return !s.requests.empty(); });
+        // Everything queued is applied before the result is handed over
+        std::deque<DiffRequest> batch;
+        batch.swap(s.requests);
+        lock.unlock();
+
+        for (DiffRequest& request : batch) {
+            if (request.kind == DiffRequest::OPEN) {
+                state.session = request.session;
+                state.path = request.path;
+                state.lines.clear();
+                hash_lines(request.text.data(), request.text.size(), state.lines);
+                load_base(state);
+                diff_all(state);
+            } else if (request.session != state.session) {
+                continue;
+            } else if (request.kind == DiffRequest::BASE) {
+                load_base(state);
+                diff_all(state);
+            } else {
+                apply_edit(state, request.line, request.old_lines, request.text);
+            }
+        }
+
+        lock.lock();
+        if (state.session != s.session) continue;
+        s.hunks = state.hunks;
+        s.lines = (int)state.lines.size();
+        if (s.fresh) continue;
+        s.fresh = true;
+        lock.unlock();
+        Fl::awake(diff_ready, nullptr);
+        lock.lock();
+    }
+}
+
+static void queue_diff_request(DiffRequest&& request) {
+    DiffShared& s = shared();
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!s.running) {
+            s.running = true;
+            std::thread(diff_main).detach();
+        }
+        s.requests.push_back(std::move(request));
+    }
+    s.wake.notify_one();
+}
+
+// ======================
+// Shown Document
+// ======================
+
+// In long-line mode an edited line is too long to copy on every keystroke;
+// the document is sent again once typing has paused this long
+static const double LONG_LINE_CATCH_UP = 1.0;
+
+static Fl_Text_Buffer* followed_doc = nullptr;  // reporting edits to diff_modified
+static std::string followed_path;
+static bool synced = false;     // the worker has followed_doc as it is now
+static bool catching_up = false;  // edits in long-line mode wait for a pause
+static unsigned long session = 0;
+// Start of a line and its number, so an edit's line is counted from nearby
+static int anchor_pos = 0, anchor_line = 0;
+// Result drawn, taken from the worker
+static std::vector<Hunk> shown_hunks;
+static int shown_lines = 0;
+
+static void sync_diff(void*);
+
+// The document or its file changed: start over once the edit in progress,
+// if any, is done
+static void unsync_diff() {
+    synced = false;
+    catching_up = false;
+    Fl::remove_timeout(sync_diff);
+    Fl::add_timeout(0.0, sync_diff);
+}
+
+// The same document again once typing pauses, keeping its marks till then
+static void catch_up_later() {
+    synced = false;
+    catching_up = true;
+    Fl::remove_timeout(sync_diff);
+    Fl::add_timeout(LONG_LINE_CATCH_UP, sync_diff);
+}
+
+static void diff_modified(int pos, int inserted, int deleted, int, const char* deleted_text, void*) {
+    if (!inserted && !deleted) return;  // restyled only
+    if (catching_up || (synced && long_line_mode() && followed_path == current_file)) {
+        catch_up_later();
+        return;
+    }
+    if (!synced || followed_path != current_file) {
+        unsync_diff();
+        return;
+    }
+    if (followed_path.empty()) return;
+
+    Fl_Text_Buffer* doc = followed_doc;
+    int start = doc->line_start(pos);
+    int line = anchor_pos <= start ? anchor_line + doc->count_lines(anchor_pos, start) : doc->count_lines(0, start);
+    anchor_pos = start;
+    anchor_line = line;
+
+    int old_lines = 1;
+    for (int i = 0; deleted_text && i < deleted; ++i) old_lines += deleted_text[i] == '\n';
+    char* now = doc->text_range(start, doc->line_end(pos + inserted));
+    DiffRequest request{DiffRequest::EDIT, session, std::string(), std::string(now ? now : ""), line, old_lines};
+    free(now);
+    queue_diff_request(std::move(request));
+}
+
+static void sync_diff(void*) {
+    if (synced || !followed_doc) return;
+    bool same_document = catching_up && followed_path == current_file;
+    synced = true;
+    catching_up = false;
+    followed_path = current_file;
+    anchor_pos = anchor_line = 0;
+    {
+        DiffShared& s = shared();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        session = ++s.session;
+        s.hunks.clear();
+        s.lines = 0;
+    }
+    if (!same_document) {
+        shown_hunks.clear();
+        shown_lines = 0;
+        if (editor) editor->damage(FL_DAMAGE_USER1);
+    }
+    if (followed_path.empty()) return;  // untitled: nothing to compare with
+
+    char* text = followed_doc->text();
+    queue_diff_request(DiffRequest{DiffRequest::OPEN, session, followed_path, std::string(text ? text : ""), 0, 0});
+    free(text);
+}
+
+void diff_gutter_attach(Fl_Text_Buffer* doc) {
+    if (followed_doc == doc) return;
+    if (followed_doc) followed_doc->remove_modify_callback(diff_modified, nullptr);
+    doc->add_modify_callback(diff_modified, nullptr);
+    followed_doc = doc;
+    unsync_diff();
+}
+
+void diff_gutter_follow() {
+    if (synced && followed_path != current_file) unsync_diff();
+}
+
+void diff_gutter_base_changed(const std::string& path) {
+    if (!synced || path != followed_path) return;
+    queue_diff_request(DiffRequest{DiffRequest::BASE, session, std::string(), std::string(), 0, 0});
+}
+
+void diff_gutter_marks(int first, int count, std::vector<unsigned char>& out) {
+    {
+        DiffShared& s = shared();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (s.fresh) {
+            s.fresh = false;
+            if (s.session == session) {
+                shown_hunks.swap(s.hunks);
+                shown_lines = s.lines;
+            }
+        }
+    }
+    out.assign(count > 0 ? count : 0, DIFF_NONE);
+    int end = first + count;
+    auto it = std::lower_bound(shown_hunks.begin(), shown_hunks.end(), first,
+                               [](const Hunk& h, int at) { return h.cur_start + h.cur_count < at; });
+    for (; it != shown_hunks.end() && it->cur_start <= end; ++it) {
+        if (it->cur_count == 0) {
+            if (it->cur_start >= first && it->cur_start < end) out[it->cur_start - first] |= DIFF_DELETED_ABOVE;
+            else if (it->cur_start == shown_lines && shown_lines - 1 >= first && shown_lines - 1 < end)
+                out[shown_lines - 1 - first] |= DIFF_DELETED_BELOW;
+            continue;
+        }
+        unsigned char mark = it->base_count ? DIFF_MODIFIED : DIFF_ADDED;
+        for (int l = std::max(it->cur_start, first); l < std::min(it->cur_start + it->cur_count, end); ++l)
+            out[l - first] |= mark;
+    }
+}
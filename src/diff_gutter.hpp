@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <vector>
+
+class Fl_Text_Buffer;
+
+// Marks beside the line numbers for lines that differ from the saved file.
+// The shown document's lines are hashed and diffed against the file on a
+// worker thread; edits are sent as the lines they replaced, and only the
+// stretch between the unchanged lines around them is diffed again. In
+// long-line mode the document is compared afresh once typing pauses.
+
+// How a line differs from the file
+enum DiffMark : unsigned char {
+    DIFF_NONE          = 0,
+    DIFF_ADDED         = 1,
+    DIFF_MODIFIED      = 2,
+    DIFF_DELETED_ABOVE = 4,  // lines of the file were removed just above it
+    DIFF_DELETED_BELOW = 8   // last line: lines were removed at the end
+};
+
+// The editor now shows `doc`. It is compared once the file it belongs to
+// is known, through diff_gutter_follow.
+void diff_gutter_attach(Fl_Text_Buffer* doc);
+// Compare the shown document with current_file, if that is not the file
+// compared already. Cheap otherwise; call whenever current_file may change.
+void diff_gutter_follow();
+// The file at `path` was written or read again: compare with what it holds now
+void diff_gutter_base_changed(const std::string& path);
+
+// Marks of lines [first, first + count) of the shown document, 0-based
+void diff_gutter_marks(int first, int count, std::vector<unsigned char>& out);
@@ -0,0 +1,399 @@
+#include "dir_scanner.hpp"
+#include "file_io.hpp"
+#include <FL/Fl.H>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct ScanRequest {
+    unsigned long job;
+    std::string dir;
+    bool subdirs;
+    ScanFilter filter;
+    ScanReady ready;
+    std::vector<DirStamp> stamps;  // a revalidation: only these directories
+};
+
+// One prefetch_directories or read_directories call, shared by the pool
+// threads under the state's mutex
+struct Prefetch {
+    unsigned long job = 0;
+    unsigned long epoch = 0;
+    ScanFilter filter = nullptr;
+    ScanReady ready = nullptr;  // none for read_directories: kept in slots
+    int depth = 0;
+    size_t max_entries = 0;
+    struct Slot {
+        std::string dir;
+        int depth;
+        DirListing listing;
+        bool done;
+    };
+    std::deque<Slot> slots;  // directories below are added as each is handed over
+    size_t taken = 0;        // slots a thread has started on
+    size_t finished = 0;
+    size_t published = 0;    // slots handed over, in order
+    size_t entries = 0;
+    std::condition_variable all_read;  // read_directories waits on it
+};
+
+// Shared with the scanner thread. Never destroyed: the thread may still be
+// waiting on it while the program exits.
+struct ScanState {
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<ScanRequest> requests;
+    std::deque<DirListing> listings;
+    unsigned long epoch = 0;  // bumped by cancel_dir_scans
+    bool notified = false;    // an Fl::awake is on its way
+    bool running = false;
+    std::deque<std::shared_ptr<Prefetch>> prefetches;
+    std::condition_variable prefetch_wake;
+    bool pool_running = false;
+};
+
+static ScanState& state() {
+    static ScanState* s = new ScanState;
+    return *s;
+}
+
+DIR* open_dir_at(int at, const char* name) {
+    int fd = openat(at, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+    DIR* d = fdopendir(fd);
+    if (!d) close(fd);
+    return d;
+}
+
+long long dir_mtime(DIR* d) {
+    struct stat st;
+    return fstat(dirfd(d), &st) == 0 ? stat_mtime_ns(st) : -1;
+}
+
+int dir_entry_is_dir(DIR* d, const struct dirent* e, bool follow_links) {
+#ifdef _DIRENT_HAVE_D_TYPE
+    if (e->d_type == DT_DIR) return 1;
+    if (e->d_type != DT_UNKNOWN && (e->d_type != DT_LNK || !follow_links)) return 0;
+#endif
+    struct stat st;
+    if (fstatat(dirfd(d), e->d_name, &st, follow_links ? 0 : AT_SYMLINK_NOFOLLOW) != 0) return -1;
+    return S_ISDIR(st.st_mode) ? 1 : 0;
+}
+
+static bool is_dot(const char* name) {
+    return !strcmp(name, ".") || !strcmp(name, "..");
+}
+
+bool dir_may_list(int at, const char* name, ScanFilter filter) {
+    DIR* sub = open_dir_at(at, name);
+    if (!sub) return true;  // be optimistic; expanding will tell
+    bool found = false;
+    while (struct dirent* e = readdir(sub)) {
+        if (is_dot(e->d_name)) continue;
+        bool is_dir = true;
+#ifdef _DIRENT_HAVE_D_TYPE
+        is_dir = e->d_type == DT_DIR || e->d_type == DT_UNKNOWN || e->d_type == DT_LNK;
+#endif
+        if (filter(e->d_name, is_dir)) {
+            found = true;
+            break;
+        }
+    }
+    closedir(sub);
+    return found;
+}
+
+static void read_listing(DIR* d, ScanFilter filter, bool probe, std::vector<ScanEntry>& entries) {
+    while (struct dirent* e = readdir(d)) {
+        if (is_dot(e->d_name)) continue;
+        int is_dir = dir_entry_is_dir(d, e);
+        if (is_dir < 0 || !filter(e->d_name, is_dir == 1)) continue;
+        entries.push_back({e->d_name, is_dir == 1, false});
+    }
+    std::sort(entries.begin(), entries.end(), [](const ScanEntry& a, const ScanEntry& b) {
+        if (a.is_dir != b.is_dir) return a.is_dir;
+        return a.name < b.name;
+    });
+    for (ScanEntry& entry : entries) {
+        if (entry.is_dir) entry.has_entries = !probe || dir_may_list(dirfd(d), entry.name.c_str(), filter);
+    }
+}
+
+// Hand a listing to the main thread unless its request was cancelled
+static void publish(ScanState& s, const ScanRequest& request, unsigned long epoch, DirListing&& listing) {
+    bool notify = false;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (s.epoch != epoch) return;
+        s.listings.push_back(std::move(listing));
+        notify = !s.notified;
+        s.notified = true;
+    }
+    if (notify) Fl::awake(request.ready, nullptr);
+}
+
+// A directory's mtime moves whenever an entry is added, removed or renamed in
+// it, so one stat tells whether its listing still holds
+static void run_revalidation(ScanState& s, const ScanRequest& request, unsigned long epoch) {
+    for (const DirStamp& stamp : request.stamps) {
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if (s.epoch != epoch) return;
+        }
+        // Unchanged, or gone, which the listing of its parent shows
+        struct stat st;
+        if (stat(stamp.dir.c_str(), &st) != 0 || stat_mtime_ns(st) == stamp.mtime) continue;
+        DIR* d = open_dir_at(AT_FDCWD, stamp.dir.c_str());
+        if (!d) continue;
+        DirListing listing{request.job, stamp.dir, {}, false};
+        listing.mtime = dir_mtime(d);
+        listing.refresh = true;
+        read_listing(d, request.filter, true, listing.entries);
+        closedir(d);
+        publish(s, request, epoch, std::move(listing));
+    }
+}
+
+static void run_request(ScanState& s, const ScanRequest& request, unsigned long epoch) {
+    if (!request.stamps.empty()) {
+        run_revalidation(s, request, epoch);
+        return;
+    }
+    DIR* d = open_dir_at(AT_FDCWD, request.dir.c_str());
+    DirListing listing{request.job, request.dir, {}, true};
+    if (!d) {
+        publish(s, request, epoch, std::move(listing));
+        return;
+    }
+    listing.mtime = dir_mtime(d);
+    read_listing(d, request.filter, !request.subdirs, listing.entries);
+
+    std::vector<std::string> subdirs;
+    if (request.subdirs) {
+        for (const ScanEntry& entry : listing.entries) {
+            if (entry.is_dir) subdirs.push_back(entry.name);
+        }
+    }
+    listing.last = subdirs.empty();
+    publish(s, request, epoch, std::move(listing));
+
+    for (size_t i = 0; i < subdirs.size(); ++i) {
+        DirListing sub_listing{request.job, request.dir + "/" + subdirs[i], {}, i + 1 == subdirs.size()};
+        if (DIR* sub = open_dir_at(dirfd(d), subdirs[i].c_str())) {
+            sub_listing.mtime = dir_mtime(sub);
+            read_listing(sub, request.filter, true, sub_listing.entries);
+            closedir(sub);
+        }
+        publish(s, request, epoch, std::move(sub_listing));
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (s.epoch != epoch) break;
+    }
+    closedir(d);
+}
+
+static void scanner_main() {
+    ScanState& s = state();
+    std::unique_lock<std::mutex> lock(s.mutex);
+    for (;;) {
+        s.wake.wait(lock, [&s] { return !s.requests.empty(); });
+        ScanRequest request = std::move(s.requests.front());
+        s.requests.pop_front();
+        unsigned long epoch = s.epoch;
+        lock.unlock();
+        run_request(s, request, epoch);
+        lock.lock();
+    }
+}
+
+static void queue_request(ScanRequest&& request, bool urgent) {
+    ScanState& s = state();
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!s.running) {
+            s.running = true;
+            std::thread(scanner_main).detach();
+        }
+        if (urgent) s.requests.push_front(std::move(request));
+        else s.requests.push_back(std::move(request));
+    }
+    s.wake.notify_one();
+}
+
+void scan_directory(unsigned long job, const std::string& dir, bool subdirs, bool urgent,
+                    ScanFilter filter, ScanReady ready) {
+    queue_request(ScanRequest{job, dir, subdirs, filter, ready, {}}, urgent);
+}
+
+void revalidate_directories(unsigned long job, std::vector<DirStamp> stamps,
+                            ScanFilter filter, ScanReady ready) {
+    if (stamps.empty()) return;
+    queue_request(ScanRequest{job, std::string(), false, filter, ready, std::move(stamps)}, false);
+}
+
+// Directory reads are mostly waiting on the disk, so more threads than
+// cores still overlap usefully
+static unsigned prefetch_threads() {
+    unsigned n = std::thread::hardware_concurrency();
+    return std::min(std::max(n, 4u), 8u);
+}
+
+static void drop_prefetch(ScanState& s, const Prefetch* p) {
+    for (auto it = s.prefetches.begin(); it != s.prefetches.end(); ++it) {
+        if (it->get() == p) {
+            s.prefetches.erase(it);
+            return;
+        }
+    }
+}
+
+// Next directory for a pool thread. Prefetches cancelled since they began
+// are dropped here.
+static bool take_prefetch_slot(ScanState& s, std::shared_ptr<Prefetch>& p, size_t& slot) {
+    for (auto it = s.prefetches.begin(); it != s.prefetches.end();) {
+        Prefetch& candidate = **it;
+        if (candidate.ready && candidate.epoch != s.epoch) {
+            it = s.prefetches.erase(it);
+            continue;
+        }
+        if (candidate.taken < candidate.slots.size()) {
+            p = *it;
+            slot = candidate.taken++;
+            // Nothing is added below a read_directories slot
+            if (!candidate.ready && candidate.taken == candidate.slots.size()) s.prefetches.erase(it);
+            return true;
+        }
+        ++it;
+    }
+    return false;
+}
+
+// Hand over the slots read so far, in order. Each adds the directories it
+// holds, within the bounds, behind all the others. True if an Fl::awake is due.
+static bool hand_over_prefetched(ScanState& s, Prefetch& p) {
+    if (p.epoch != s.epoch) return false;
+    size_t before = s.listings.size();
+    bool added = false;
+    while (p.published < p.slots.size() && p.slots[p.published].done) {
+        Prefetch::Slot& slot = p.slots[p.published++];
+        p.entries += slot.listing.entries.size();
+        if (slot.depth < p.depth && p.entries < p.max_entries) {
+            for (const ScanEntry& entry : slot.listing.entries) {
+                if (!entry.is_dir) continue;
+                p.slots.push_back({slot.dir + "/" + entry.name, slot.depth + 1, DirListing(), false});
+                added = true;
+            }
+        }
+        slot.listing.last = p.published == p.slots.size();
+        s.listings.push_back(std::move(slot.listing));
+    }
+    if (added) s.prefetch_wake.notify_all();
+    if (p.published == p.slots.size()) drop_prefetch(s, &p);
+    if (s.listings.size() == before || s.notified) return false;
+    s.notified = true;
+    return true;
+}
+
+static void prefetch_main() {
+    ScanState& s = state();
+    std::unique_lock<std::mutex> lock(s.mutex);
+    for (;;) {
+        std::shared_ptr<Prefetch> p;
+        size_t i = 0;
+        s.prefetch_wake.wait(lock, [&] { return take_prefetch_slot(s, p, i); });
+        // Deque elements stay put as slots are added behind them
+        Prefetch::Slot& slot = p->slots[i];
+        std::string dir = slot.dir;
+        bool probe = slot.depth >= p->depth;
+        lock.unlock();
+
+        DirListing listing{p->job, dir, {}, false};
+        if (DIR* d = open_dir_at(AT_FDCWD, dir.c_str())) {
+            listing.mtime = dir_mtime(d);
+            read_listing(d, p->filter, probe, listing.entries);
+            closedir(d);
+        }
+
+        lock.lock();
+        slot.listing = std::move(listing);
+        slot.done = true;
+        ++p->finished;
+        if (!p->ready) {
+            if (p->finished == p->slots.size()) p->all_read.notify_all();
+        } else if (hand_over_prefetched(s, *p)) {
+            lock.unlock();
+            Fl::awake(p->ready, nullptr);
+            lock.lock();
+        }
+    }
+}
+
+static void start_prefetch_pool(ScanState& s) {
+    if (s.pool_running) return;
+    s.pool_running = true;
+    for (unsigned i = prefetch_threads(); i > 0; --i) std::thread(prefetch_main).detach();
+}
+
+void prefetch_directories(unsigned long job, std::vector<std::string> dirs, int depth,
+                          size_t max_entries, ScanFilter filter, ScanReady ready) {
+    if (dirs.empty()) return;
+    auto p = std::make_shared<Prefetch>();
+    p->job = job;
+    p->filter = filter;
+    p->ready = ready;
+    p->depth = depth;
+    p->max_entries = max_entries;
+    for (std::string& dir : dirs) p->slots.push_back({std::move(dir), 0, DirListing(), false});
+
+    ScanState& s = state();
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        start_prefetch_pool(s);
+        p->epoch = s.epoch;
+        s.prefetches.push_back(std::move(p));
+    }
+    s.prefetch_wake.notify_all();
+}
+
+void read_directories(const std::vector<std::string>& dirs, ScanFilter filter,
+                      std::vector<DirListing>& out) {
+    out.clear();
+    if (dirs.empty()) return;
+    auto p = std::make_shared<Prefetch>();
+    p->filter = filter;
+    for (const std::string& dir : dirs) p->slots.push_back({dir, 0, DirListing(), false});
+
+    ScanState& s = state();
+    std::unique_lock<std::mutex> lock(s.mutex);
+    start_prefetch_pool(s);
+    s.prefetches.push_front(p);
+    s.prefetch_wake.notify_all();
+    p->all_read.wait(lock, [&] { return p->finished == p->slots.size(); });
+    for (Prefetch::Slot& slot : p->slots) out.push_back(std::move(slot.listing));
+}
+
+bool take_dir_listing(DirListing& out) {
+    ScanState& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.listings.empty()) {
+        s.notified = false;
+        return false;
+    }
+    out = std::move(s.listings.front());
+    s.listings.pop_front();
+    return true;
+}
+
+void cancel_dir_scans() {
+    ScanState& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    ++s.epoch;
+    s.requests.clear();
+    s.listings.clear();
+}
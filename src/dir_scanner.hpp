@@ -0,0 +1,79 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <dirent.h>
+
+struct ScanEntry {
+    std::string name;
+    bool is_dir;
+    bool has_entries;  // directories only: may have something to list
+};
+
+// One directory as read by the scanner, directories first, then by name
+struct DirListing {
+    unsigned long job;
+    std::string dir;
+    std::vector<ScanEntry> entries;
+    bool last;  // final listing of its request
+    long long mtime = -1;  // of the directory, taken before it was read
+    bool refresh = false;  // a new listing of a directory listed before
+};
+
+// A directory as it was when last listed
+struct DirStamp {
+    std::string dir;
+    long long mtime;
+};
+
+// Which entries are listed. Called on the scanner thread, so it must only
+// read shared state. For has_entries probes `is_dir` may be a guess.
+typedef bool (*ScanFilter)(const char* name, bool is_dir);
+// Posted through Fl::awake when listings are waiting to be taken
+typedef void (*ScanReady)(void* data);
+
+// Read `dir` on the scanner thread, and with `subdirs` each directory in it
+// as well. `urgent` requests, e.g. a folder the user just opened, go ahead
+// of those queued.
+void scan_directory(unsigned long job, const std::string& dir, bool subdirs, bool urgent,
+                    ScanFilter filter, ScanReady ready);
+
+// Check each directory of `stamps` on the scanner thread and list again,
+// as refresh listings, only those whose mtime has moved
+void revalidate_directories(unsigned long job, std::vector<DirStamp> stamps,
+                            ScanFilter filter, ScanReady ready);
+
+// Read `dirs` at once on a pool of threads and, up to `depth` levels below
+// them, the directories they hold, until about `max_entries` entries are in.
+// Listings are handed over as from scan_directory and in order, each
+// directory before those inside it; the final one is marked `last`. Where
+// the level below is read anyway, has_entries is not probed.
+void prefetch_directories(unsigned long job, std::vector<std::string> dirs, int depth,
+                          size_t max_entries, ScanFilter filter, ScanReady ready);
+
+// Read `dirs` at once on the same pool, ahead of any prefetch, and wait for
+// them; out[i] is dirs[i], with mtime -1 if it could not be read
+void read_directories(const std::vector<std::string>& dirs, ScanFilter filter,
+                      std::vector<DirListing>& out);
+
+// Main thread: take the next finished listing, if any
+bool take_dir_listing(DirListing& out);
+
+// Drop queued requests and unclaimed listings; a scan running now finishes
+// but its listings are dropped too
+void cancel_dir_scans();
+
+// Open `name` relative to the directory fd `at` (AT_FDCWD for a plain path)
+DIR* open_dir_at(int at, const char* name);
+
+// Modification time of an open directory in nanoseconds, -1 if unknown
+long long dir_mtime(DIR* d);
+
+// 1 for a directory, 0 for anything else, -1 if it cannot be told. The type
+// readdir reports is used; only untyped entries and symlinks, which count as
+// what they point to unless `follow_links` is false, need an fstatat.
+int dir_entry_is_dir(DIR* d, const struct dirent* e, bool follow_links = true);
+
+// Whether directory `name` in `at` holds anything the filter lets through.
+// Untyped entries are taken for directories rather than stat'ed, and a
+// directory that cannot be read counts as non-empty.
+bool dir_may_list(int at, const char* name, ScanFilter filter);
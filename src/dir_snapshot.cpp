@@ -0,0 +1,73 @@
+#include "dir_snapshot.hpp"
+#include "file_io.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <sys/stat.h>
+
+// File layout, little endian:
+//   header  "FLS1", u32 folder length, folder, u32 directory count
+//   dir     u32 path length, path, i64 mtime, u32 entry count, entries
+//   entry   u8 flags (1: directory, 2: has entries), u32 name length, name
+
+static const char MAGIC[4] = {'F', 'L', 'S', '1'};
+static const uint8_t ENTRY_DIR = 1;
+static const uint8_t ENTRY_HAS_ENTRIES = 2;
+
+static std::string snapshot_dir() {
+    const char* home = getenv("HOME");
+    return std::string(home ? home : ".") + "/.flick/snapshots";
+}
+
+static std::string snapshot_file(const std::string& folder) {
+    return snapshot_dir() + "/" + hashed_name(folder) + ".fs";
+}
+
+bool save_dir_snapshot(const std::string& folder, const std::vector<SnapshotDir>& dirs) {
+    std::string out(MAGIC, sizeof(MAGIC));
+    put_string(out, folder);
+    put_u32(out, (uint32_t)dirs.size());
+    for (const SnapshotDir& dir : dirs) {
+        put_string(out, dir.rel);
+        put_i64(out, dir.mtime);
+        put_u32(out, (uint32_t)dir.entries.size());
+        for (const ScanEntry& entry : dir.entries) {
+            out += static_cast<char>((entry.is_dir ? ENTRY_DIR : 0) | (entry.has_entries ? ENTRY_HAS_ENTRIES : 0));
+            put_string(out, entry.name);
+        }
+    }
+
+    std::string dir = snapshot_dir();
+    mkdir(dir.substr(0, dir.rfind('/')).c_str(), 0700);
+    mkdir(dir.c_str(), 0700);
+    return write_file_atomic(snapshot_file(folder), out);
+}
+
+bool load_dir_snapshot(const std::string& folder, std::vector<SnapshotDir>& dirs) {
+    dirs.clear();
+    std::string data;
+    if (!read_file(snapshot_file(folder), data)) return false;
+
+    ByteReader in{data};
+    std::string stored_folder;
+    uint32_t count;
+    if (data.compare(0, sizeof(MAGIC), MAGIC, sizeof(MAGIC)) != 0) return false;
+    in.pos = sizeof(MAGIC);
+    // A hash collision names another folder's snapshot
+    if (!in.string(stored_folder) || stored_folder != folder || !in.u32(count)) return false;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        SnapshotDir dir;
+        uint32_t entries;
+        if (!in.string(dir.rel) || !in.i64(dir.mtime) || !in.u32(entries)) return false;
+        for (uint32_t j = 0; j < entries; ++j) {
+            uint8_t flags;
+            ScanEntry entry;
+            if (!in.u8(flags) || !in.string(entry.name)) return false;
+            entry.is_dir = (flags & ENTRY_DIR) != 0;
+            entry.has_entries = (flags & ENTRY_HAS_ENTRIES) != 0;
+            dir.entries.push_back(std::move(entry));
+        }
+        dirs.push_back(std::move(dir));
+    }
+    return true;
+}
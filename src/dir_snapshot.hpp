@@ -0,0 +1,20 @@
+#pragma once
+#include "dir_scanner.hpp"
+#include <string>
+#include <vector>
+
+// Snapshot of the directories listed in the file tree, kept between runs in
+// ~/.flick/snapshots so reopening a folder paints at once. Each directory
+// carries the mtime it had when read; only those whose mtime has moved need
+// reading again.
+struct SnapshotDir {
+    std::string rel;  // relative to the folder; the folder itself is ""
+    long long mtime;  // -1 if unknown, which never matches
+    std::vector<ScanEntry> entries;
+};
+
+// Replace the snapshot of `folder`. Parents must come before their children.
+bool save_dir_snapshot(const std::string& folder, const std::vector<SnapshotDir>& dirs);
+
+// The snapshot of `folder`; false if there is none or it is unreadable
+bool load_dir_snapshot(const std::string& folder, std::vector<SnapshotDir>& dirs);
@@ -0,0 +1,171 @@
+#include "dir_watcher.hpp"
+#include <FL/Fl.H>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+struct DirWatcher::State {
+    DirWatcher::Handler handler = nullptr;
+    void* data = nullptr;
+    bool closed = false;  // main thread only: no more deliveries
+    int fd = -1;
+    int wake[2] = {-1, -1};
+    std::thread thread;
+    mutable std::mutex mutex;  // guards the maps below
+    std::unordered_map<int, std::string> dir_of;
+    std::unordered_map<std::string, int> wd_of;
+};
+
+namespace {
+struct Delivery {
+    std::shared_ptr<DirWatcher::State> state;
+    std::vector<DirEvent> events;
+};
+}
+
+static void deliver(void* data) {
+    std::unique_ptr<Delivery> delivery(static_cast<Delivery*>(data));
+    if (!delivery->state->closed) delivery->state->handler(delivery->events, delivery->state->data);
+}
+
+#ifdef __linux__
+static uint32_t inotify_mask(unsigned events) {
+    uint32_t mask = IN_ONLYDIR | IN_DELETE_SELF | IN_MOVE_SELF;
+    if (events & WATCH_CHANGED) mask |= IN_CLOSE_WRITE;
+    if (events & WATCH_CREATED) mask |= IN_CREATE;
+    if (events & WATCH_DELETED) mask |= IN_DELETE;
+    if (events & WATCH_MOVED_FROM) mask |= IN_MOVED_FROM;
+    if (events & WATCH_MOVED_TO) mask |= IN_MOVED_TO;
+    return mask;
+}
+
+static unsigned watch_events(uint32_t mask) {
+    unsigned events = 0;
+    if (mask & IN_CLOSE_WRITE) events |= WATCH_CHANGED;
+    if (mask & IN_CREATE) events |= WATCH_CREATED;
+    if (mask & (IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF)) events |= WATCH_DELETED;
+    if (mask & IN_MOVED_FROM) events |= WATCH_MOVED_FROM;
+    if (mask & IN_MOVED_TO) events |= WATCH_MOVED_TO;
+    if (mask & IN_Q_OVERFLOW) events |= WATCH_OVERFLOW;
+    if (mask & IN_ISDIR) events |= WATCH_IS_DIR;
+    return events;
+}
+
+static void watch_loop(std::shared_ptr<DirWatcher::State> state) {
+    alignas(struct inotify_event) char buf[64 * 1024];
+    pollfd fds[2] = {{state->fd, POLLIN, 0}, {state->wake[0], POLLIN, 0}};
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) continue;
+        if (fds[1].revents) return;
+        ssize_t len = read(state->fd, buf, sizeof(buf));
+        if (len <= 0) continue;
+
+        Delivery* delivery = new Delivery{state, {}};
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            for (char* p = buf; p < buf + len;) {
+                const inotify_event* ev = reinterpret_cast<const inotify_event*>(p);
+                p += sizeof(inotify_event) + ev->len;
+                if (ev->mask & IN_Q_OVERFLOW) {
+                    delivery->events.push_back({std::string(), std::string(), WATCH_OVERFLOW, 0});
+                    continue;
+                }
+                auto it = state->dir_of.find(ev->wd);
+                if (it == state->dir_of.end()) continue;
+                std::string dir = it->second;
+                if (ev->mask & IN_IGNORED) {
+                    // Directory removed or unmounted: the watch is gone
+                    state->wd_of.erase(dir);
+                    state->dir_of.erase(it);
+                    continue;
+                }
+                unsigned events = watch_events(ev->mask);
+                if (events) delivery->events.push_back({dir, ev->len ? std::string(ev->name) : std::string(), events, ev->cookie});
+                if (ev->mask & IN_MOVE_SELF) {
+                    // Reported as deleted, but a moved directory keeps its
+                    // watch: drop it so the path can be watched again
+                    inotify_rm_watch(state->fd, ev->wd);
+                    state->wd_of.erase(dir);
+                    state->dir_of.erase(ev->wd);
+                }
+            }
+        }
+        // The awake queue can be full; the events are lost with it
+        if (delivery->events.empty() || Fl::awake(deliver, delivery) != 0) delete delivery;
+    }
+}
+#endif
+
+DirWatcher::DirWatcher(unsigned events, Handler handler, void* data)
+    : state_(std::make_shared<State>()), events_(events) {
+    state_->handler = handler;
+    state_->data = data;
+#ifdef __linux__
+    state_->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (state_->fd < 0) return;
+    if (pipe(state_->wake) != 0) {
+        close(state_->fd);
+        state_->fd = -1;
+        return;
+    }
+    state_->thread = std::thread(watch_loop, state_);
+#endif
+}
+
+DirWatcher::~DirWatcher() {
+    state_->closed = true;
+#ifdef __linux__
+    if (state_->fd < 0) return;
+    if (write(state_->wake[1], "x", 1) < 0) {}
+    state_->thread.join();
+    close(state_->fd);
+    close(state_->wake[0]);
+    close(state_->wake[1]);
+#endif
+}
+
+bool DirWatcher::add(const std::string& dir) {
+#ifdef __linux__
+    if (state_->fd < 0) return false;
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if (state_->wd_of.count(dir)) return true;
+    int wd = inotify_add_watch(state_->fd, dir.c_str(), inotify_mask(events_));
+    if (wd < 0) return false;
+    state_->wd_of[dir] = wd;
+    state_->dir_of[wd] = dir;
+    return true;
+#else
+    (void)dir;
+    return false;
+#endif
+}
+
+void DirWatcher::remove(const std::string& dir) {
+#ifdef __linux__
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    auto it = state_->wd_of.find(dir);
+    if (it == state_->wd_of.end()) return;
+    inotify_rm_watch(state_->fd, it->second);
+    state_->dir_of.erase(it->second);
+    state_->wd_of.erase(it);
+#else
+    (void)dir;
+#endif
+}
+
+bool DirWatcher::watching(const std::string& dir) const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->wd_of.count(dir) != 0;
+}
+
+std::vector<std::string> DirWatcher::dirs() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    std::vector<std::string> out;
+    for (const auto& entry : state_->wd_of) out.push_back(entry.first);
+    return out;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Events reported by DirWatcher
+enum {
+    WATCH_CHANGED    = 1 << 0,  // a file was written and closed
+    WATCH_CREATED    = 1 << 1,
+    WATCH_DELETED    = 1 << 2,  // with an empty name: the watched directory itself is gone
+    WATCH_MOVED_FROM = 1 << 3,  // paired with WATCH_MOVED_TO through `cookie`
+    WATCH_MOVED_TO   = 1 << 4,
+    WATCH_OVERFLOW   = 1 << 5,  // events were lost; rescan whatever matters
+    WATCH_IS_DIR     = 1 << 6   // the entry named is a directory
+};
+
+struct DirEvent {
+    std::string dir;   // as passed to DirWatcher::add
+    std::string name;  // entry inside dir, empty for events on dir itself
+    unsigned events;
+    uint32_t cookie;
+};
+
+// Watches directories (not recursively) with inotify on a thread of its
+// own and hands batches of events to `handler` on the main thread through
+// Fl::awake. Without inotify, add() fails and nothing is reported.
+class DirWatcher {
+public:
+    typedef void (*Handler)(const std::vector<DirEvent>& events, void* data);
+
+    DirWatcher(unsigned events, Handler handler, void* data = nullptr);
+    ~DirWatcher();
+
+    bool add(const std::string& dir);
+    void remove(const std::string& dir);
+    bool watching(const std::string& dir) const;
+    std::vector<std::string> dirs() const;
+
+    struct State;
+
+private:
+    std::shared_ptr<State> state_;
+    unsigned events_;
+};
@@ -1,11 +1,13 @@
 #include "dock_button.hpp"
 #include "globals.hpp"
+#include "file_tree.hpp"
 #include <FL/fl_draw.H>
 #include <FL/Fl_Menu.H>
 #include <FL/fl_ask.H>
-#include <FL/Fl_Tree.H>
+#include "tree_view.hpp"
 #include <FL/Fl_Box.H>
 #include <FL/Fl_Double_Window.H>
+#include <FL/filename.H>
 
 // Global state for dock button
 static bool tree_panel_pinned = false;
@@ -160,10 +162,10 @@ void DockButton::auto_hide_cb(Fl_Widget* w, void* data) {
 }
 
 void DockButton::reveal_active_cb(Fl_Widget* w, void* data) {
-    // TODO: Implement reveal active file in tree
-    if (file_tree && current_file[0]) {
-        // Logic to expand tree and highlight current file
-        fl_message("Reveal active file: %s", current_file);
+    if (!file_tree || !current_file[0]) return;
+    if (tree_width == 0) toggle_file_tree();
+    if (!reveal_in_tree(current_file)) {
+        fl_message("%s is not in the open folder", fl_filename_name(current_file));
     }
 }
 
@@ -177,12 +179,12 @@ void toggle_file_tree() {
         // Hide tree
         saved_tree_width = tree_width;
         tree_width = 0;
-        file_tree->hide();
+        show_file_tree(false);
         tree_resizer->hide();
     } else {
         // Show tree
         tree_width = saved_tree_width > 0 ? saved_tree_width : 200;
-        file_tree->show();
+        show_file_tree(true);
         tree_resizer->show();
     }
 
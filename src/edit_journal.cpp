@@ -0,0 +1,330 @@
+#include "edit_journal.hpp"
+#include "file_io.hpp"
+#include <FL/Fl.H>
+#include <FL/Fl_Text_Buffer.H>
+#include <FL/fl_utf8.h>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <dirent.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <unistd.h>
+#endif
+
+// File layout, little endian:
+//   header  "FLJ1", i64 base size (-1: replay starts from an empty
+//           document), i64 base mtime, u32 path length, path
+//   record  'E', u32 position, u32 bytes deleted, u32 bytes inserted, text
+// A record cut short by a crash is ignored on replay.
+
+static const char MAGIC[4] = {'F', 'L', 'J', '1'};
+static const double FLUSH_INTERVAL = 1.0;
+static const size_t FLUSH_THRESHOLD = 256 * 1024;
+
+struct JournalDoc {
+    std::string path;
+    std::string file;
+    Fl_Text_Buffer* buffer = nullptr;  // the tracked document
+    long long base_size = -1;
+    long long base_mtime = 0;
+    bool started = false;  // a journal exists or is queued for this document
+    bool fresh = false;    // next write starts the file over
+    std::string pending;   // records not handed to the writer yet
+};
+
+enum WriteKind { WRITE_APPEND, WRITE_REPLACE, WRITE_REMOVE };
+
+struct WriteTask {
+    std::string file;
+    std::string bytes;
+    WriteKind kind;
+};
+
+// Main thread only
+static std::map<std::string, std::unique_ptr<JournalDoc>> docs;
+static bool flush_scheduled = false;
+
+// Shared with the writer thread
+static std::mutex queue_mutex;
+static std::condition_variable queue_cv;
+static std::deque<WriteTask> queue;
+static bool stopping = false;
+static std::thread writer;
+
+static std::string journal_dir() {
+    const char* home = getenv("HOME");
+    return std::string(home ? home : ".") + "/.flick/journal";
+}
+
+static void make_dir(const std::string& dir) {
+#ifdef _WIN32
+    _mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0700);
+#endif
+}
+
+static std::string journal_file(const std::string& path) {
+    return journal_dir() + "/" + hashed_name(path) + ".fj";
+}
+
+static void put_record(std::string& out, int pos, int deleted, const char* text, size_t len) {
+    out += 'E';
+    put_u32(out, (uint32_t)pos);
+    put_u32(out, (uint32_t)deleted);
+    put_u32(out, (uint32_t)len);
+    out.append(text, len);
+}
+
+static void read_base(JournalDoc& doc) {
+    struct stat st;
+    if (!doc.path.empty() && fl_stat(doc.path.c_str(), &st) == 0) {
+        doc.base_size = (long long)st.st_size;
+        doc.base_mtime = (long long)st.st_mtime;
+    } else {
+        doc.base_size = -1;
+        doc.base_mtime = 0;
+    }
+}
+
+static void begin_journal(JournalDoc& doc) {
+    doc.pending.assign(MAGIC, sizeof(MAGIC));
+    put_i64(doc.pending, doc.base_size);
+    put_i64(doc.pending, doc.base_mtime);
+    put_u32(doc.pending, (uint32_t)doc.path.size());
+    doc.pending += doc.path;
+    doc.started = true;
+    doc.fresh = true;
+}
+
+static void writer_main() {
+    std::string dir = journal_dir();
+    make_dir(dir.substr(0, dir.rfind('/')));
+    make_dir(dir);
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    for (;;) {
+        queue_cv.wait(lock, [] { return stopping || !queue.empty(); });
+        if (queue.empty()) return;  // stopping and drained
+        WriteTask task = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+
+        if (task.kind == WRITE_REMOVE) {
+            remove(task.file.c_str());
+        } else if (FILE* fp = fopen(task.file.c_str(), task.kind == WRITE_REPLACE ? "wb" : "ab")) {
+            fwrite(task.bytes.data(), 1, task.bytes.size(), fp);
+            fflush(fp);
+#ifndef _WIN32
+            fdatasync(fileno(fp));
+#endif
+            fclose(fp);
+        }
+        lock.lock();
+    }
+}
+
+static void push_task(WriteTask task) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (!writer.joinable()) {
+            stopping = false;
+            writer = std::thread(writer_main);
+        }
+        queue.push_back(std::move(task));
+    }
+    queue_cv.notify_one();
+}
+
+static void flush_all() {
+    for (auto& entry : docs) {
+        JournalDoc& doc = *entry.second;
+        if (doc.pending.empty()) continue;
+        push_task({doc.file, std::move(doc.pending), doc.fresh ? WRITE_REPLACE : WRITE_APPEND});
+        doc.pending.clear();
+        doc.fresh = false;
+    }
+}
+
+static void flush_cb(void*) {
+    flush_scheduled = false;
+    flush_all();
+}
+
+static void schedule_flush(const JournalDoc& doc) {
+    if (doc.pending.size() >= FLUSH_THRESHOLD) {
+        flush_all();
+    } else if (!flush_scheduled) {
+        flush_scheduled = true;
+        Fl::add_timeout(FLUSH_INTERVAL, flush_cb);
+    }
+}
+
+static void journal_cb(int pos, int inserted, int deleted, int, const char*, void* arg) {
+    if (!inserted && !deleted) return;  // selection or style only
+    JournalDoc* doc = static_cast<JournalDoc*>(arg);
+    if (!doc->started) begin_journal(*doc);
+    if (inserted) {
+        char* text = doc->buffer->text_range(pos, pos + inserted);
+        put_record(doc->pending, pos, deleted, text, (size_t)inserted);
+        free(text);
+    } else {
+        put_record(doc->pending, pos, deleted, "", 0);
+    }
+    schedule_flush(*doc);
+}
+
+void journal_track(Fl_Text_Buffer* buffer, const std::string& path) {
+    std::unique_ptr<JournalDoc>& slot = docs[path];
+    if (!slot) {
+        slot.reset(new JournalDoc);
+        slot->path = path;
+        slot->file = journal_file(path);
+    }
+    // A running journal keeps its base: the text came back from memory
+    if (!slot->started) read_base(*slot);
+    slot->buffer = buffer;
+    buffer->add_modify_callback(journal_cb, slot.get());
+}
+
+void journal_untrack(Fl_Text_Buffer* buffer, const std::string& path) {
+    auto it = docs.find(path);
+    if (it == docs.end() || it->second->buffer != buffer) return;
+    buffer->remove_modify_callback(journal_cb, it->second.get());
+    it->second->buffer = nullptr;
+}
+
+void journal_rewrite(const std::string& path) {
+    auto it = docs.find(path);
+    if (it == docs.end() || !it->second->buffer) return;
+    JournalDoc& doc = *it->second;
+    doc.base_size = -1;
+    doc.base_mtime = 0;
+    begin_journal(doc);
+    char* text = doc.buffer->text();
+    put_record(doc.pending, 0, 0, text, (size_t)doc.buffer->length());
+    free(text);
+    flush_all();
+}
+
+void journal_saved(const std::string& path, bool clean) {
+    auto it = docs.find(path);
+    if (it == docs.end()) return;
+    JournalDoc& doc = *it->second;
+    if (!clean) {
+        journal_rewrite(path);
+        return;
+    }
+    doc.pending.clear();
+    if (doc.started) push_task({doc.file, std::string(), WRITE_REMOVE});
+    doc.started = false;
+    read_base(doc);
+}
+
+void journal_discard(const std::string& path) {
+    // Still tracked if the document stays open: a later edit starts over
+    auto it = docs.find(path);
+    if (it != docs.end()) {
+        it->second->pending.clear();
+        it->second->started = false;
+        read_base(*it->second);
+    }
+    push_task({journal_file(path), std::string(), WRITE_REMOVE});
+}
+
+void journal_shutdown() {
+    // Journals still running hold unsaved edits: written out, not removed
+    flush_all();
+    Fl::remove_timeout(flush_cb);
+    flush_scheduled = false;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_cv.notify_one();
+    if (writer.joinable()) writer.join();
+}
+
+// Replay one journal file; nullptr if it is unreadable. A journal whose base
+// changed is `stale` and replayed onto the file as it is now.
+static Fl_Text_Buffer* replay(const std::string& data, std::string& path, bool& stale) {
+    ByteReader in{data};
+    long long base_size, base_mtime;
+    if (data.size() < sizeof(MAGIC) || memcmp(data.data(), MAGIC, sizeof(MAGIC)) != 0) return nullptr;
+    in.pos = sizeof(MAGIC);
+    if (!in.i64(base_size) || !in.i64(base_mtime) || !in.string(path)) return nullptr;
+
+    Fl_Text_Buffer* doc = new Fl_Text_Buffer();
+    if (base_size >= 0) {
+        struct stat st;
+        stale = fl_stat(path.c_str(), &st) != 0 || (long long)st.st_size != base_size ||
+                (long long)st.st_mtime != base_mtime;
+        doc->transcoding_warning_action = nullptr;
+        doc->loadfile(path.c_str());
+    }
+
+    uint8_t kind;
+    while (in.u8(kind) && kind == 'E') {
+        uint32_t pos, deleted, inserted;
+        if (!in.u32(pos) || !in.u32(deleted) || !in.u32(inserted) || data.size() - in.pos < inserted ||
+            (uint64_t)pos + deleted > (uint64_t)doc->length())
+            break;  // torn or inconsistent tail
+        doc->replace((int)pos, (int)(pos + deleted), data.data() + in.pos, (int)inserted);
+        in.pos += inserted;
+    }
+    return doc;
+}
+
+// Move a stale journal off the name journal_file() gives its document
+static std::string set_aside(const std::string& file, const std::string& path) {
+    if (file != journal_file(path)) return file;  // aside already
+    std::string stem = file.substr(0, file.size() - 3);
+    for (int n = 1; ; ++n) {
+        std::string aside = stem + "-" + std::to_string(n) + ".fj";
+        struct stat st;
+        if (fl_stat(aside.c_str(), &st) == 0) continue;
+        return rename(file.c_str(), aside.c_str()) == 0 ? aside : file;
+    }
+}
+
+std::vector<RecoveredDocument> journal_recover(std::vector<RecoveredDocument>* stale) {
+    std::vector<RecoveredDocument> recovered;
+    std::string dir = journal_dir();
+    DIR* d = opendir(dir.c_str());
+    if (!d) return recovered;
+    while (struct dirent* entry = readdir(d)) {
+        std::string name = entry->d_name;
+        if (name.size() < 3 || name.compare(name.size() - 3, 3, ".fj") != 0) continue;
+        std::string file = dir + "/" + name;
+        std::string data;
+        if (!read_file(file, data)) continue;
+
+        std::string path;
+        bool is_stale = false;
+        Fl_Text_Buffer* doc = replay(data, path, is_stale);
+        if (!doc) {
+            remove(file.c_str());  // unreadable, nothing to recover
+        } else if (!is_stale) {
+            recovered.push_back({path, doc, file});
+        } else if (stale) {
+            stale->push_back({path, doc, set_aside(file, path)});
+        } else {
+            delete doc;
+        }
+    }
+    closedir(d);
+    return recovered;
+}
+
+void journal_remove(const RecoveredDocument& rec) {
+    push_task({rec.journal, std::string(), WRITE_REMOVE});
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <string>
+#include <vector>
+
+class Fl_Text_Buffer;
+
+// Crash-recovery journal. Every edit to a tracked document is appended to
+// ~/.flick/journal as a small (position, deleted, inserted text) record;
+// records are batched in memory and written by a background thread, so a
+// keystroke costs one short append. A journal holds the file's size and
+// mtime as its base and is removed once the document is saved or closed.
+// The path of the untitled document is "".
+
+// Record the edits made to `doc` from now on. Call after its text has been
+// loaded, so loading is not journalled.
+void journal_track(Fl_Text_Buffer* doc, const std::string& path);
+// Stop recording `doc` under `path`, e.g. before it is tracked as another file
+void journal_untrack(Fl_Text_Buffer* doc, const std::string& path);
+
+// A save of `path` succeeded. With `clean` the document matches the disk and
+// the journal goes; otherwise the text typed during the save is kept by
+// rewriting the journal with the whole document.
+void journal_saved(const std::string& path, bool clean);
+// Replace the journal with the whole current text of `path`
+void journal_rewrite(const std::string& path);
+
+// Drop the journal of `path`: changes discarded, or its tab is closing
+void journal_discard(const std::string& path);
+// Clean exit: write out the journals still running and stop the writer.
+// Discard the documents that are clean first; the rest are offered for
+// recovery on the next start.
+void journal_shutdown();
+
+struct RecoveredDocument {
+    std::string path;
+    Fl_Text_Buffer* doc;  // owned by the caller
+    std::string journal;  // the journal file it was replayed from
+};
+
+// Journals left behind by a crash, replayed onto their files. Journals whose
+// file has changed since go to `stale`, replayed onto the file as it is now
+// for as long as their edits still fit. Those are set aside where a new
+// journal of the same file cannot overwrite them, and stay until removed.
+std::vector<RecoveredDocument> journal_recover(std::vector<RecoveredDocument>* stale = nullptr);
+// Remove the journal a stale document came from
+void journal_remove(const RecoveredDocument& rec);
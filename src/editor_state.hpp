@@ -5,7 +5,7 @@
 #include <FL/Fl_Text_Editor.H>
 #include <FL/Fl_Menu_Bar.H>
 #include <FL/Fl_Menu_Button.H>
-#include <FL/Fl_Tree.H>
+#include "tree_view.hpp"
 #include <FL/Fl_Box.H>
 #include <FL/Fl_Text_Buffer.H>
 #include <ctime>
@@ -20,7 +20,7 @@ public:
     // Window and UI components
     Fl_Double_Window* win = nullptr;
     Fl_Menu_Bar* menu = nullptr;
-    Fl_Tree* file_tree = nullptr;
+    TreeView* file_tree = nullptr;
     Fl_Menu_Button* context_menu = nullptr;
     Fl_Text_Editor* editor = nullptr;
     Fl_Text_Buffer* buffer = nullptr;
@@ -6,21 +6,31 @@
 #include "tab_bar.hpp"
 #include "dock_button.hpp"
 #include "custom_title_bar.hpp"
+#include "tab_memory.hpp"
+#include "file_saver.hpp"
+#include "edit_journal.hpp"
+#include "diff_gutter.hpp"
+#include "colors.hpp"
 #include <FL/Fl_Text_Display.H>
 #include <FL/Fl_Scrollbar.H>
 #include <FL/Fl.H>
 #include <FL/fl_ask.H>
+#include <FL/fl_draw.H>
 #include <thread>
-#include <future>
+#include <vector>
 
 Fl_Double_Window *win = nullptr;
 Fl_Menu_Bar    *menu = nullptr;
-Fl_Tree        *file_tree = nullptr;
+TreeView       *file_tree = nullptr;
 int font_size = 14;
 Fl_Menu_Button *context_menu = nullptr;
 My_Text_Editor  *editor = nullptr;
-Fl_Text_Buffer  *buffer = new Fl_Text_Buffer();
-Fl_Text_Buffer  *style_buffer = new Fl_Text_Buffer();
+// Document shown when no tab is active; tabs own their own buffers
+Fl_Text_Buffer  *untitled_buffer = new Fl_Text_Buffer();
+Fl_Text_Buffer  *untitled_style_buffer = new Fl_Text_Buffer();
+// Document currently in the editor
+Fl_Text_Buffer  *buffer = untitled_buffer;
+Fl_Text_Buffer  *style_buffer = untitled_style_buffer;
 bool text_changed = false;
 bool switching_tabs = false;
 char current_file[FL_PATH_MAX] = "";
@@ -42,10 +52,6 @@ int             window_y = 100;
 int             window_w = 1301;
 int             window_h = 887;
 
-// Add lazy loading flags
-static bool file_tree_loaded = false;
-static std::future<void> file_tree_future;
-
 static void legacy_tree_new_file_cb(Fl_Widget* w, void*) {
     new_file_cb(w, tree_context_menu->user_data());
 }
@@ -93,8 +99,7 @@ void EditorWindow::resize(int X,int Y,int W,int H) {
         editor->size(W - tree_w - resize_w, H - content_y - tab_h - status_h);
 
         if (file_tree) {
-            file_tree->position(0, content_y);
-            file_tree->size(tree_w, H - content_y - status_h);
+            layout_file_tree(0, content_y, tree_w, H - content_y - status_h);
             if (tree_resizer) {
                 tree_resizer->position(tree_w, content_y);
                 tree_resizer->size(resize_w, H - content_y - status_h);
@@ -307,12 +312,13 @@ int My_Tree::handle(int e) {
 
     // Handle right-click context menu
     if (e == FL_PUSH && Fl::event_button() == FL_RIGHT_MOUSE) {
-        Fl_Tree_Item* it = item_clicked();
-        show_tree_context_menu(Fl::event_x(), Fl::event_y(), it);
+        int node = node_at(Fl::event_y());
+        if (node == TREE_NONE) node = TREE_ROOT;  // empty space: the folder itself
+        show_tree_context_menu(Fl::event_x(), Fl::event_y(), node);
         return 1;
     }
 
-    return Fl_Tree::handle(e);
+    return TreeView::handle(e);
 }
 
 int My_Text_Editor::handle(int e) {
@@ -350,7 +356,57 @@ int My_Text_Editor::handle(int e) {
     return ret;
 }
 
+void My_Text_Editor::draw() {
+    // A new diff result only needs the gutter painted again
+    if (damage() & ~FL_DAMAGE_USER1) Fl_Text_Editor::draw();
+    draw_diff_gutter();
+}
+
+// Bars in the right edge of the line number column beside lines that
+// differ from the saved file, and a notch where lines were deleted
+void My_Text_Editor::draw_diff_gutter() {
+    const int GUTTER_W = 3;
+    const int TEXT_LEFT_MARGIN = 3;  // Fl_Text_Display's gap before the text
+    if (linenumber_width() < 2 * GUTTER_W || mNVisibleLines <= 0 || !buffer()) return;
+    int gx = text_area.x - TEXT_LEFT_MARGIN - GUTTER_W;
+
+    // Line of each visible row, counted as draw_line_numbers does; wrapped
+    // rows belong to the line they continue
+    std::vector<int> rows;
+    int line = get_absolute_top_line_number() - 1;
+    for (int i = 0; i < mNVisibleLines && mLineStarts[i] >= 0; ++i) {
+        if (i > 0 && buffer()->char_at(mLineStarts[i] - 1) == '\n') ++line;
+        rows.push_back(line);
+    }
+    std::vector<unsigned char> marks;
+    if (!rows.empty()) diff_gutter_marks(rows.front(), rows.back() - rows.front() + 1, marks);
+
+    bool dark = current_theme == THEME_DARK;
+    Fl_Color added = dark ? Colors::rgb(Colors::SUCCESS) : fl_rgb_color(60, 160, 60);
+    Fl_Color modified = dark ? Colors::rgb(Colors::ACCENT_BLUE) : fl_rgb_color(70, 120, 210);
+    Fl_Color deleted = dark ? Colors::rgb(Colors::ERROR) : fl_rgb_color(210, 70, 70);
+
+    fl_push_clip(gx, text_area.y, GUTTER_W, text_area.h);
+    fl_rectf(gx, text_area.y, GUTTER_W, text_area.h, linenumber_bgcolor());
+    for (size_t i = 0; i < rows.size(); ++i) {
+        unsigned char mark = marks[rows[i] - rows.front()];
+        int y = text_area.y + (int)i * mMaxsize;
+        if (mark & (DIFF_ADDED | DIFF_MODIFIED))
+            fl_rectf(gx, y, GUTTER_W, mMaxsize, (mark & DIFF_ADDED) ? added : modified);
+        bool first_row = i == 0 || rows[i - 1] != rows[i];
+        bool last_row = i + 1 == rows.size() || rows[i + 1] != rows[i];
+        fl_color(deleted);
+        if ((mark & DIFF_DELETED_ABOVE) && first_row) fl_polygon(gx, y - 3, gx + GUTTER_W, y, gx, y + 3);
+        if ((mark & DIFF_DELETED_BELOW) && last_row)
+            fl_polygon(gx, y + mMaxsize - 3, gx + GUTTER_W, y + mMaxsize, gx, y + mMaxsize + 3);
+    }
+    fl_pop_clip();
+}
+
 int run_editor(int argc,char** argv){
+    // Enable Fl::awake() callbacks from worker threads
+    Fl::lock();
+
     // Quick initialization of basic UI
     Fl::get_system_colors();
 
@@ -409,6 +465,9 @@ int run_editor(int argc,char** argv){
     menu->add("&Find/Find...", FL_CTRL + 'f', find_cb);
     menu->add("&Find/Replace...", FL_CTRL + 'h', replace_cb);
     menu->add("&Find/Global Search...", FL_CTRL | FL_SHIFT | 'f', global_search_cb);
+    menu->add("&Find/Batch Replace...", FL_CTRL | FL_SHIFT | 'h', batch_replace_cb, 0, FL_MENU_DIVIDER);
+    menu->add("&Find/Match Case", FL_ALT + 'c', match_case_cb, 0, FL_MENU_TOGGLE | FL_MENU_VALUE);
+    menu->add("&Find/Whole Word", FL_ALT + 'w', whole_word_cb, 0, FL_MENU_TOGGLE);
 
     const int status_h = 20;
     const int content_y = title_h + menu_h;  // Content starts below title bar and menu
@@ -417,8 +476,7 @@ int run_editor(int argc,char** argv){
     // Create file tree but don't load content immediately
     file_tree = new My_Tree(0, content_y, tree_width, win->h() - content_y - status_h);
     file_tree->callback(tree_cb);
-    file_tree->showroot(false);
-    file_tree->root_label("Loading...");
+    create_tree_filter();
 
     tree_context_menu = new Fl_Menu_Button(0,0,0,0);
     tree_context_menu->hide();
@@ -435,42 +493,47 @@ int run_editor(int argc,char** argv){
     
     // Set up tab bar callbacks
     tab_bar->on_tab_selected = [](const std::string& filepath) {
+        Tab* tab = tab_bar->get_tab(filepath);
+        // Already showing this document
+        if (!tab || tab->buffer == buffer) return;
+
+        // Restored tabs read their file on first activation; large ones
+        // come back through the background loader and select themselves
+        if (!tab->loaded && !load_tab_document(tab)) return;
+
+        // Remember where the cursor was in the outgoing document
+        if (editor && current_file[0]) {
+            if (Tab* old = tab_bar->get_tab(current_file))
+                old->insert_position = editor->insert_position();
+        }
+
         // Set flag to prevent changed_cb from marking tabs as modified during switching
         switching_tabs = true;
-        
-        // First, save current content and modified state to the current tab's buffer
-        std::string current_filepath = std::string(current_file);
-        if (!current_filepath.empty() && current_filepath != filepath) {
-            Fl_Text_Buffer* current_tab_buffer = tab_bar->get_tab_buffer(current_filepath);
-            if (current_tab_buffer) {
-                // Save the current editor content to the tab's buffer
-                current_tab_buffer->text(buffer->text());
-                // Save the current modified state to the tab
-                tab_bar->update_tab_modified(current_filepath, text_changed);
-            }
-        }
-        
-        // Switch to the new tab's buffer
-        Fl_Text_Buffer* tab_buffer = tab_bar->get_tab_buffer(filepath);
-        if (tab_buffer) {
-            buffer->text(tab_buffer->text());
-            strcpy(current_file, filepath.c_str());
-            
-            // Restore the modified state from the tab
-            std::vector<Tab*> all_tabs = tab_bar->get_all_tabs();
-            for (Tab* tab : all_tabs) {
-                if (tab->filepath == filepath) {
-                    text_changed = tab->is_modified;
-                    break;
-                }
-            }
-            
-            update_title();
-            update_status();
+
+        // The editor shows the tab's own buffer; nothing is copied
+        attach_document(tab->buffer, tab->style_buffer);
+        strcpy(current_file, filepath.c_str());
+        text_changed = tab->is_modified;
+
+        // Styles are built on first display, or after a background edit
+        if (style_buffer->length() != buffer->length()) style_init();
+        else update_linenumber_width();
+        if (editor) {
+            editor->insert_position(tab->insert_position);
+            editor->show_insert_position();
         }
-        
+
         // Clear the switching flag
         switching_tabs = false;
+
+        // Other tabs may now be released to stay within the memory budget
+        touch_tab(tab);
+        request_tab_budget_check();
+        update_tab_watches();
+        if (tab->disk_changed) Fl::add_timeout(0.0, resolve_disk_conflict_cb);
+
+        update_title();
+        update_status();
     };
     
     tab_bar->on_tab_closed = [](const std::string& filepath) {
@@ -479,26 +542,50 @@ int run_editor(int argc,char** argv){
             int r = fl_choice("Save changes before closing?", "Cancel", "Save", "Don't Save");
             if (r == 0) return; // Cancel - don't close the tab
             if (r == 1) {
-                // Save the file
+                // Save the file; the tab closes once it has been written
                 save_cb(nullptr, nullptr);
-                // Check if save was successful
-                if (text_changed) return; // Save failed or was cancelled
+                if (file_save_pending(filepath)) {
+                    if (Tab* tab = tab_bar->get_tab(filepath)) tab->close_after_save = true;
+                    return;
+                }
+                if (text_changed) return; // Save was cancelled
             }
         }
         
-        // Remove the tab from the tab bar
-        tab_bar->remove_tab(filepath);
-        
-        // If this was the current file, clear the editor
+        // Move the editor off the document before its tab frees it; the
+        // tab bar then selects a neighbour if there is one
         if (std::string(current_file) == filepath) {
-            buffer->text("");
-            current_file[0] = '\0';
+            show_untitled_document();
             text_changed = false;
-            update_title();
-            update_status();
         }
+        if (Tab* tab = tab_bar->get_tab(filepath)) journal_untrack(tab->buffer, filepath);
+        journal_discard(filepath);
+        tab_bar->remove_tab(filepath);
+        update_tab_watches();
+        update_title();
+        update_status();
     };
     
+    tab_bar->on_tab_moved = [](const std::string& old_path, const std::string& new_path) {
+        if (old_path == new_path) return;  // only dragged to another place
+        Tab* tab = tab_bar->get_tab(new_path);
+        if (!tab) return;
+        // The journal follows the document to its new name
+        if (tab->loaded) {
+            journal_untrack(tab->buffer, old_path);
+            journal_discard(old_path);
+            journal_track(tab->buffer, new_path);
+            if (tab->is_modified) journal_rewrite(new_path);
+        }
+        if (old_path == current_file) {
+            strncpy(current_file, new_path.c_str(), sizeof(current_file) - 1);
+            current_file[sizeof(current_file) - 1] = '\0';
+            save_last_file();
+            update_title();
+        }
+        update_tab_watches();
+    };
+
     // Load saved tab state
     tab_bar->load_tab_state();
 
@@ -544,19 +631,13 @@ int run_editor(int argc,char** argv){
     status_right->align(FL_ALIGN_RIGHT | FL_ALIGN_INSIDE);
     status_right->label("");
     apply_theme(current_theme);
-    buffer->add_modify_callback(changed_cb, nullptr);
+    journal_track(untitled_buffer, "");
+    attach_document(buffer, style_buffer);
     style_init();
     update_status();
     
-    // Asynchronously load file tree
-    file_tree_future = std::async(std::launch::async, []() {
-        load_last_folder_if_any();
-        file_tree_loaded = true;
-    });
-    
-    editor->highlight_data(style_buffer, style_table,
-                           style_table_size,
-                           'A', nullptr, nullptr);
+    // The file tree fills in from a scanner thread as the folder is read
+    load_last_folder_if_any();
 
     win->resizable(editor);
     win->end();
@@ -565,26 +646,16 @@ int run_editor(int argc,char** argv){
     // Quick file loading (if command line arguments provided)
     if (argc > 1) {
         load_file(argv[1]);
+        recover_unsaved_documents();
     } else {
         // Delay loading last file to avoid blocking UI
         Fl::add_timeout(0.1, [](void*) {
             load_last_file_if_any();
+            recover_unsaved_documents();
             if (!current_file[0]) update_title();
             update_status();
         });
     }
 
-    // Add callback for file tree loading completion
-    Fl::add_timeout(0.05, [](void*) {
-        if (file_tree_loaded && file_tree_future.valid()) {
-            file_tree_future.wait();
-            if (file_tree) {
-                file_tree->redraw();
-            }
-        } else {
-            Fl::repeat_timeout(0.05, nullptr);
-        }
-    });
-
     return Fl::run();
 }
\ No newline at end of file
@@ -4,7 +4,7 @@
 #include <FL/Fl_Text_Editor.H>
 #include <FL/Fl_Menu_Bar.H>
 #include <FL/Fl_Menu_Button.H>
-#include <FL/Fl_Tree.H>
+#include "tree_view.hpp"
 #include <FL/Fl_Box.H>
 #include <FL/Fl_Text_Buffer.H>
 #include <ctime>
@@ -15,11 +15,15 @@ class My_Text_Editor : public Fl_Text_Editor {
 public:
     using Fl_Text_Editor::Fl_Text_Editor;
     int handle(int e) override;
+    void draw() override;
+
+private:
+    void draw_diff_gutter();
 };
 
-class My_Tree : public Fl_Tree {
+class My_Tree : public TreeView {
 public:
-    using Fl_Tree::Fl_Tree;
+    using TreeView::TreeView;
     int handle(int e) override;
 };
 
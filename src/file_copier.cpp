@@ -0,0 +1,273 @@
+#include "file_copier.hpp"
+#include "file_remover.hpp"
+#include "background_jobs.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+struct CopyJob : BackgroundJob {
+    std::string from;
+    std::string to;
+    bool move = false;
+    FileCopyDone done = nullptr;
+    FileCopyProgress progress = nullptr;
+    std::atomic<size_t> copied{0};
+    std::atomic<size_t> total{0};
+
+    void run() override;
+    void report_progress() override {
+        if (progress) progress(from, copied.load(), total.load());
+    }
+    void report_done() override {
+        done(from, to, move, error, cancelled);
+    }
+};
+
+static BackgroundJobs jobs;
+
+static const size_t COPY_CHUNK = 8 * 1024 * 1024;
+static const size_t BUFFER_SIZE = 1024 * 1024;
+
+static bool fail(CopyJob& job, const std::string& name) {
+    if (job.error.empty()) job.error = name + ": " + strerror(errno);
+    return false;
+}
+
+// Through a buffer, for file systems the kernel cannot copy between
+static bool copy_buffered(int in, int out, CopyJob& job) {
+    std::vector<char> buffer(BUFFER_SIZE);
+    for (;;) {
+        if (job.cancelled) return false;
+        ssize_t n = read(in, buffer.data(), buffer.size());
+        if (n == 0) return true;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        for (ssize_t written = 0; written < n;) {
+            ssize_t w = write(out, buffer.data() + written, n - written);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            written += w;
+        }
+        job.copied += n;
+    }
+}
+
+static bool copy_data(int in, int out, CopyJob& job) {
+#ifdef __linux__
+#ifdef FICLONE
+    // Shares the extents: instant, and no space is used until either changes
+    if (ioctl(out, FICLONE, in) == 0) {
+        struct stat st;
+        if (fstat(in, &st) == 0) job.copied += (size_t)st.st_size;
+        return true;
+    }
+#endif
+    // In chunks, so progress and cancelling are seen. Offsets advance as with
+    // read and write, so the fallback carries on where this stopped.
+    for (;;) {
+        if (job.cancelled) return false;
+        ssize_t n = copy_file_range(in, nullptr, out, nullptr, COPY_CHUNK, 0);
+        if (n == 0) return true;
+        if (n > 0) {
+            job.copied += (size_t)n;
+            continue;
+        }
+        if (errno == EINTR) continue;
+        if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP) return false;
+        break;
+    }
+#endif
+    return copy_buffered(in, out, job);
+}
+
+static bool copy_at(int from_at, const char* from_name, int to_at, const char* to_name,
+                    const std::string& rel, CopyJob& job);
+
+static bool copy_dir_contents(int from_fd, int to_fd, const std::string& rel, CopyJob& job) {
+    DIR* d = fdopendir(from_fd);
+    if (!d) {
+        close(from_fd);
+        return fail(job, rel);
+    }
+    bool ok = true;
+    while (struct dirent* e = readdir(d)) {
+        if (job.cancelled) {
+            ok = false;
+            break;
+        }
+        if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) continue;
+        ok = copy_at(dirfd(d), e->d_name, to_fd, e->d_name, rel + "/" + e->d_name, job) && ok;
+    }
+    closedir(d);
+    return ok;
+}
+
+static bool copy_at(int from_at, const char* from_name, int to_at, const char* to_name,
+                    const std::string& rel, CopyJob& job) {
+    struct stat st;
+    if (fstatat(from_at, from_name, &st, AT_SYMLINK_NOFOLLOW) != 0) return fail(job, rel);
+
+    if (S_ISLNK(st.st_mode)) {
+        std::vector<char> target(st.st_size > 0 ? st.st_size + 1 : 4096);
+        ssize_t n = readlinkat(from_at, from_name, target.data(), target.size() - 1);
+        if (n < 0) return fail(job, rel);
+        target[n] = '\0';
+        return symlinkat(target.data(), to_at, to_name) == 0 || fail(job, rel);
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        int from_fd = openat(from_at, from_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (from_fd < 0) return fail(job, rel);
+        if (mkdirat(to_at, to_name, (st.st_mode & 07777) | S_IRWXU) != 0) {
+            close(from_fd);
+            return fail(job, rel);
+        }
+        int to_fd = openat(to_at, to_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (to_fd < 0) {
+            close(from_fd);
+            return fail(job, rel);
+        }
+        bool ok = copy_dir_contents(from_fd, to_fd, rel, job);
+        fchmod(to_fd, st.st_mode & 07777);
+        close(to_fd);
+        return ok;
+    }
+
+    if (!S_ISREG(st.st_mode)) {
+        errno = ENOTSUP;
+        return fail(job, rel);
+    }
+    int in = openat(from_at, from_name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (in < 0) return fail(job, rel);
+    int out = openat(to_at, to_name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777);
+    if (out < 0) {
+        close(in);
+        return fail(job, rel);
+    }
+    bool ok = copy_data(in, out, job) || job.cancelled || fail(job, rel);
+    ok = close(out) == 0 && ok;
+    close(in);
+    return ok && !job.cancelled;
+}
+
+// The directory and the name of `path`, opened as a directory fd
+static int open_parent(const std::string& path, std::string& name) {
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    name = slash == std::string::npos ? path : path.substr(slash + 1);
+    return open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+// rename() that fails with EEXIST rather than replace `to`. EXDEV means the
+// entry has to be copied instead.
+static bool rename_exclusive(const char* from, const char* to) {
+#if defined(__linux__) && defined(SYS_renameat2) && defined(RENAME_NOREPLACE)
+    if (syscall(SYS_renameat2, AT_FDCWD, from, AT_FDCWD, to, RENAME_NOREPLACE) == 0) return true;
+    if (errno != ENOSYS && errno != EINVAL) return false;
+#endif
+    // Without it the name is claimed first: a folder replaces an empty one
+    // made for it, anything else is linked there and unlinked here
+    struct stat st;
+    if (lstat(from, &st) != 0) return false;
+    if (S_ISDIR(st.st_mode)) {
+        if (mkdir(to, 0700) != 0) return false;
+        if (rename(from, to) == 0) return true;
+        int saved = errno;
+        rmdir(to);
+        errno = saved;
+        return false;
+    }
+    if (linkat(AT_FDCWD, from, AT_FDCWD, to, 0) != 0) {
+        if (errno == EPERM || errno == EOPNOTSUPP) errno = EXDEV;  // no hard links here
+        return false;
+    }
+    if (unlink(from) == 0) return true;
+    int saved = errno;
+    unlink(to);
+    errno = saved;
+    return false;
+}
+
+static void run_copy(CopyJob& job) {
+    if (!job.to.compare(0, job.from.size() + 1, job.from + "/")) {
+        job.error = "a folder cannot go inside itself";
+        return;
+    }
+    if (job.move) {
+        if (rename_exclusive(job.from.c_str(), job.to.c_str())) return;
+        if (errno != EXDEV) {
+            fail(job, errno == EEXIST ? job.to : job.from);
+            return;
+        }
+        // Another file system: copied below, then the source goes
+    }
+
+    struct stat st;
+    if (lstat(job.from.c_str(), &st) == 0 && S_ISREG(st.st_mode)) job.total = (size_t)st.st_size;
+
+    std::string from_name, to_name;
+    int from_at = open_parent(job.from, from_name);
+    int to_at = open_parent(job.to, to_name);
+    bool ok = false;
+    bool started = false;  // the target is ours: it did not exist before
+    if (from_at < 0) {
+        fail(job, job.from);
+    } else if (to_at < 0) {
+        fail(job, job.to);
+    } else if (faccessat(to_at, to_name.c_str(), F_OK, AT_SYMLINK_NOFOLLOW) == 0) {
+        errno = EEXIST;
+        fail(job, to_name);
+    } else {
+        started = true;
+        ok = copy_at(from_at, from_name.c_str(), to_at, to_name.c_str(), from_name, job);
+    }
+    if (from_at >= 0) close(from_at);
+    if (to_at >= 0) close(to_at);
+
+    std::string error;
+    if (!ok) {
+        // Nothing half done stays behind
+        if (started) remove_file_tree(job.to, error);
+        return;
+    }
+    if (job.move && !remove_file_tree(job.from, error)) job.error = "copied, but not removed: " + error;
+}
+
+void CopyJob::run() {
+    run_copy(*this);
+}
+
+void start_file_copy(const std::string& from, const std::string& to, bool move,
+                     FileCopyDone done, FileCopyProgress progress) {
+    auto job = std::make_shared<CopyJob>();
+    job->from = from;
+    job->to = to;
+    job->move = move;
+    job->done = done;
+    job->progress = progress;
+    jobs.start(job);
+}
+
+void cancel_file_copies() {
+    jobs.cancel_all();
+}
+
+bool file_copy_pending() {
+    return jobs.pending();
+}
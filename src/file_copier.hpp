@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Called on the main thread once a copy or move has stopped. `error` is
+// empty on success. A copy that failed or was cancelled leaves nothing
+// behind; a move is either done or leaves the source where it was.
+typedef void (*FileCopyDone)(const std::string& from, const std::string& to, bool move,
+                             const std::string& error, bool cancelled);
+// Called on the main thread while a copy is running. `total` is 0 when it
+// is not known, e.g. for a folder.
+typedef void (*FileCopyProgress)(const std::string& from, size_t copied, size_t total);
+
+// Copy `from`, a file or a folder with everything in it, to `to` on a
+// worker thread; `to` must not exist yet. File data is cloned (FICLONE)
+// where the file system shares extents, otherwise copied in the kernel
+// with copy_file_range, and only then through a buffer. Symlinks are copied
+// as symlinks. With `move`, a rename that never replaces `to` is tried
+// first and a copy across file systems is followed by deleting the source.
+void start_file_copy(const std::string& from, const std::string& to, bool move,
+                     FileCopyDone done, FileCopyProgress progress = nullptr);
+
+// Stop every running copy at the next chunk
+void cancel_file_copies();
+
+bool file_copy_pending();
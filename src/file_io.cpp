@@ -0,0 +1,89 @@
+#include "file_io.hpp"
+#include <cstdio>
+
+long long stat_mtime_ns(const struct stat& st) {
+#if defined(__APPLE__)
+    return (long long)st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    return (long long)st.st_mtime * 1000000000LL;
+#else
+    return (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+}
+
+std::string hashed_name(const std::string& key) {
+    uint64_t h = 1469598103934665603ull;  // FNV-1a
+    for (unsigned char c : key) h = (h ^ c) * 1099511628211ull;
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)h);
+    return name;
+}
+
+bool read_file(const std::string& path, std::string& data) {
+    data.clear();
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp) return false;
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) data.append(buf, n);
+    fclose(fp);
+    return true;
+}
+
+bool write_file_atomic(const std::string& path, const std::string& data) {
+    std::string tmp = path + ".tmp";
+    FILE* fp = fopen(tmp.c_str(), "wb");
+    if (!fp) return false;
+    bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+void put_u32(std::string& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out += static_cast<char>((v >> (8 * i)) & 0xFF);
+}
+
+void put_i64(std::string& out, long long v) {
+    uint64_t u = static_cast<uint64_t>(v);
+    for (int i = 0; i < 8; ++i) out += static_cast<char>((u >> (8 * i)) & 0xFF);
+}
+
+void put_string(std::string& out, const std::string& s) {
+    put_u32(out, (uint32_t)s.size());
+    out += s;
+}
+
+bool ByteReader::u8(uint8_t& v) {
+    if (data.size() - pos < 1) return false;
+    v = static_cast<uint8_t>(data[pos++]);
+    return true;
+}
+
+bool ByteReader::u32(uint32_t& v) {
+    if (data.size() - pos < 4) return false;
+    v = 0;
+    for (int i = 0; i < 4; ++i) v |= (uint32_t)(unsigned char)data[pos + i] << (8 * i);
+    pos += 4;
+    return true;
+}
+
+bool ByteReader::i64(long long& v) {
+    if (data.size() - pos < 8) return false;
+    uint64_t u = 0;
+    for (int i = 0; i < 8; ++i) u |= (uint64_t)(unsigned char)data[pos + i] << (8 * i);
+    pos += 8;
+    v = static_cast<long long>(u);
+    return true;
+}
+
+bool ByteReader::string(std::string& s) {
+    uint32_t len;
+    if (!u32(len) || data.size() - pos < len) return false;
+    s.assign(data, pos, len);
+    pos += len;
+    return true;
+}
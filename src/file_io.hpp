@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/stat.h>
+
+// Helpers for the small files kept under ~/.flick (caches, snapshots,
+// journals) and for the stat times compared against them.
+
+// Modification time in nanoseconds
+long long stat_mtime_ns(const struct stat& st);
+
+// 16 hex digits to name the file kept for `key`, e.g. a folder's path
+std::string hashed_name(const std::string& key);
+
+// The whole file; false if it cannot be opened
+bool read_file(const std::string& path, std::string& data);
+// Written aside and renamed over `path`, so a crash leaves the old file whole
+bool write_file_atomic(const std::string& path, const std::string& data);
+
+// Little-endian fields
+void put_u32(std::string& out, uint32_t v);
+void put_i64(std::string& out, long long v);
+void put_string(std::string& out, const std::string& s);  // u32 length, bytes
+
+// Bounds-checked reads of the same fields from a whole file in memory
+struct ByteReader {
+    const std::string& data;
+    size_t pos = 0;
+
+    bool u8(uint8_t& v);
+    bool u32(uint32_t& v);
+    bool i64(long long& v);
+    bool string(std::string& s);
+};
@@ -0,0 +1,106 @@
+#include "file_loader.hpp"
+#include <FL/Fl.H>
+#include <FL/Fl_Text_Buffer.H>
+#include <FL/fl_utf8.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// State shared between the main thread and one worker. The worker only
+// touches `read`, `cancelled` and, before posting completion, `result`.
+struct LoadJob {
+    std::string path;
+    FileLoadDone done = nullptr;
+    FileLoadProgress progress = nullptr;
+    size_t total = 0;
+    std::atomic<size_t> read{0};
+    std::atomic<bool> cancelled{false};
+    Fl_Text_Buffer* result = nullptr;
+};
+
+static std::shared_ptr<LoadJob> pending_job; // main thread only
+
+static const size_t LOAD_CHUNK_SIZE = 1024 * 1024;
+static const double PROGRESS_INTERVAL = 0.1;
+
+static void progress_tick(void*) {
+    if (!pending_job) return;
+    if (pending_job->progress)
+        pending_job->progress(pending_job->path, pending_job->read.load(), pending_job->total);
+    Fl::repeat_timeout(PROGRESS_INTERVAL, progress_tick);
+}
+
+// Runs on the main thread once the worker is finished
+static void load_finished(void* data) {
+    std::unique_ptr<std::shared_ptr<LoadJob>> holder(static_cast<std::shared_ptr<LoadJob>*>(data));
+    std::shared_ptr<LoadJob> job = *holder;
+    if (job != pending_job || job->cancelled) {
+        delete job->result;
+        return;
+    }
+    pending_job.reset();
+    Fl::remove_timeout(progress_tick);
+    job->done(job->path, job->result);
+}
+
+static Fl_Text_Buffer* read_into_buffer(LoadJob& job) {
+    FILE* fp = fl_fopen(job.path.c_str(), "rb");
+    if (!fp) return nullptr;
+    std::string data;
+    data.reserve(job.total);
+    std::vector<char> chunk(LOAD_CHUNK_SIZE);
+    size_t n;
+    while (!job.cancelled && (n = fread(chunk.data(), 1, chunk.size(), fp)) > 0) {
+        data.append(chunk.data(), n);
+        job.read = data.size();
+    }
+    bool failed = ferror(fp) != 0;
+    fclose(fp);
+    if (failed || job.cancelled) return nullptr;
+
+    Fl_Text_Buffer* loaded = new Fl_Text_Buffer((int)data.size());
+    // Same rule as Fl_Text_Buffer::loadfile: text that is not UTF-8 is
+    // taken as Latin-1 and transcoded
+    if (!fl_utf8test(data.data(), (unsigned)data.size())) {
+        unsigned len = fl_utf8froma(nullptr, 0, data.data(), (unsigned)data.size());
+        std::string utf8(len + 1, '\0');
+        fl_utf8froma(&utf8[0], len + 1, data.data(), (unsigned)data.size());
+        utf8.resize(len);
+        data.swap(utf8);
+        loaded->input_file_was_transcoded = 1;
+    }
+    loaded->text(data.c_str());
+    return loaded;
+}
+
+void start_file_load(const char* path, FileLoadDone done, FileLoadProgress progress) {
+    cancel_file_load();
+
+    auto job = std::make_shared<LoadJob>();
+    job->path = path;
+    job->done = done;
+    job->progress = progress;
+    struct stat st;
+    if (fl_stat(path, &st) == 0) job->total = (size_t)st.st_size;
+    pending_job = job;
+    Fl::add_timeout(PROGRESS_INTERVAL, progress_tick);
+
+    std::thread([job]() {
+        job->result = read_into_buffer(*job);
+        Fl::awake(load_finished, new std::shared_ptr<LoadJob>(job));
+    }).detach();
+}
+
+void cancel_file_load() {
+    if (!pending_job) return;
+    pending_job->cancelled = true;
+    pending_job.reset();
+    Fl::remove_timeout(progress_tick);
+}
+
+bool file_load_pending() {
+    return pending_job != nullptr;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+class Fl_Text_Buffer;
+
+// Called on the main thread. `loaded` is a private buffer now owned by the
+// callee, or nullptr when the file could not be read.
+typedef void (*FileLoadDone)(const std::string& path, Fl_Text_Buffer* loaded);
+// Called on the main thread while a load is running
+typedef void (*FileLoadProgress)(const std::string& path, size_t done, size_t total);
+
+// Read a file into a new Fl_Text_Buffer on a worker thread. Only one load
+// runs at a time: starting another one cancels the previous load.
+void start_file_load(const char* path, FileLoadDone done, FileLoadProgress progress = nullptr);
+
+// Drop the pending load, if any; its buffer is freed when the worker stops
+void cancel_file_load();
+
+bool file_load_pending();
@@ -0,0 +1,113 @@
+#include "file_remover.hpp"
+#include "background_jobs.hpp"
+#include "dir_scanner.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct RemoveJob : BackgroundJob {
+    std::string path;
+    FileRemoveDone done = nullptr;
+    FileRemoveProgress progress = nullptr;
+    std::atomic<size_t> removed{0};
+
+    void run() override;
+    void report_progress() override {
+        if (progress) progress(path, removed.load());
+    }
+    void report_done() override {
+        done(path, error, cancelled);
+    }
+};
+
+static BackgroundJobs jobs;
+
+static void note_error(RemoveJob& job, const std::string& name) {
+    if (job.error.empty()) job.error = name + ": " + strerror(errno);
+}
+
+static void remove_at(int at, const char* name, bool is_dir, const std::string& rel, RemoveJob& job);
+
+// Remove everything inside the directory `fd`, which is taken over
+static void remove_contents(int fd, const std::string& rel, RemoveJob& job) {
+    DIR* d = fdopendir(fd);
+    if (!d) {
+        note_error(job, rel);
+        close(fd);
+        return;
+    }
+    while (struct dirent* e = readdir(d)) {
+        if (job.cancelled) break;
+        if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) continue;
+        remove_at(dirfd(d), e->d_name, dir_entry_is_dir(d, e, false) == 1, rel + "/" + e->d_name, job);
+    }
+    closedir(d);
+}
+
+static void remove_at(int at, const char* name, bool is_dir, const std::string& rel, RemoveJob& job) {
+    if (is_dir) {
+        int fd = openat(at, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0) {
+            note_error(job, rel);
+            return;
+        }
+        remove_contents(fd, rel, job);
+        if (job.cancelled) return;
+    }
+    if (unlinkat(at, name, is_dir ? AT_REMOVEDIR : 0) != 0) {
+        note_error(job, rel);
+        return;
+    }
+    ++job.removed;
+}
+
+static void remove_path(RemoveJob& job) {
+    std::string path = job.path;
+    while (path.size() > 1 && path.back() == '/') path.pop_back();
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+
+    int at = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (at < 0) {
+        note_error(job, dir);
+        return;
+    }
+    struct stat st;
+    if (fstatat(at, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0) note_error(job, name);
+    else remove_at(at, name.c_str(), S_ISDIR(st.st_mode), name, job);
+    close(at);
+}
+
+void RemoveJob::run() {
+    remove_path(*this);
+}
+
+bool remove_file_tree(const std::string& path, std::string& error) {
+    RemoveJob job;
+    job.path = path;
+    remove_path(job);
+    error = job.error;
+    return error.empty();
+}
+
+void start_file_remove(const std::string& path, FileRemoveDone done, FileRemoveProgress progress) {
+    auto job = std::make_shared<RemoveJob>();
+    job->path = path;
+    job->done = done;
+    job->progress = progress;
+    jobs.start(job);
+}
+
+void cancel_file_removes() {
+    jobs.cancel_all();
+}
+
+bool file_remove_pending() {
+    return jobs.pending();
+}
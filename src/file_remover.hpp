@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Called on the main thread once a delete has stopped. `error` is empty on
+// success; a cancelled delete has left what it had not reached yet.
+typedef void (*FileRemoveDone)(const std::string& path, const std::string& error, bool cancelled);
+// Called on the main thread while a delete is running, with the number of
+// entries removed so far
+typedef void (*FileRemoveProgress)(const std::string& path, size_t removed);
+
+// Delete `path`, a file or a directory with everything in it, on a worker
+// thread. Entries are reached through directory fds (openat, fdopendir,
+// unlinkat), so nothing is looked up by path twice and symlinks are
+// removed, never followed. An entry that cannot be removed is reported
+// and the rest is still deleted.
+void start_file_remove(const std::string& path, FileRemoveDone done, FileRemoveProgress progress = nullptr);
+
+// The same delete run on the calling thread, for other modules' workers;
+// false with `error` set if anything stayed
+bool remove_file_tree(const std::string& path, std::string& error);
+
+// Stop every running delete at the next entry
+void cancel_file_removes();
+
+bool file_remove_pending();
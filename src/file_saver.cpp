@@ -0,0 +1,166 @@
+#include "file_saver.hpp"
+#include <FL/Fl.H>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <thread>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <climits>
+#include <unistd.h>
+#endif
+
+struct SaveJob {
+    std::string path;
+    char* text = nullptr;
+    size_t length = 0;
+    unsigned long tag = 0;
+    FileSaveDone done = nullptr;
+    std::string error;  // written by the worker before completion is posted
+
+    ~SaveJob() { free(text); }
+};
+
+// Main thread only. At most one save per path runs; one more may wait.
+static std::map<std::string, std::unique_ptr<SaveJob>> running;
+static std::map<std::string, std::unique_ptr<SaveJob>> queued;
+
+static std::string system_error(const char* what) {
+    return std::string(what) + ": " + strerror(errno);
+}
+
+#ifdef _WIN32
+static std::string write_atomically(const std::string& path, const char* text, size_t length) {
+    std::string tmp = path + ".flick-save";
+    FILE* fp = fopen(tmp.c_str(), "wb");
+    if (!fp) return system_error("Cannot create temporary file");
+    bool ok = fwrite(text, 1, length, fp) == length && fflush(fp) == 0 && _commit(_fileno(fp)) == 0;
+    std::string error = ok ? "" : system_error("Cannot write");
+    if (fclose(fp) != 0 && ok) error = system_error("Cannot write");
+    if (error.empty() &&
+        !MoveFileExA(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+        error = "Cannot replace file";
+    if (!error.empty()) remove(tmp.c_str());
+    return error;
+}
+#else
+// A new file named `prefix` and a unique suffix, created with `mode` so the
+// umask applies; mkstemp would always make it 0600
+static int open_temporary(const std::string& prefix, std::string& path, mode_t mode) {
+    static std::atomic<unsigned> serial{0};
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        path = prefix + std::to_string(getpid()) + "-" + std::to_string(serial++);
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+        if (fd >= 0 || errno != EEXIST) return fd;
+    }
+    return -1;
+}
+
+static std::string write_atomically(const std::string& path, const char* text, size_t length) {
+    // Replace the file a symlink points to, not the link itself
+    std::string target = path;
+    char real[PATH_MAX];
+    if (realpath(path.c_str(), real)) target = real;
+
+    std::string::size_type slash = target.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : target.substr(0, slash));
+    std::string name = slash == std::string::npos ? target : target.substr(slash + 1);
+    std::string tmp;
+
+    // Keep the permissions of the file being replaced; a new file gets
+    // what the umask leaves of 0666, as with any other program
+    struct stat st;
+    bool existed = stat(target.c_str(), &st) == 0;
+    int fd = open_temporary((dir == "/" ? "" : dir) + "/." + name + ".flick-", tmp,
+                            existed ? (st.st_mode & 07777) : 0666);
+    if (fd < 0) return system_error("Cannot create temporary file");
+    if (existed) fchmod(fd, st.st_mode & 07777);
+
+    std::string error;
+    size_t written = 0;
+    while (written < length) {
+        ssize_t n = write(fd, text + written, length - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            error = system_error("Cannot write");
+            break;
+        }
+        written += (size_t)n;
+    }
+    if (error.empty() && fsync(fd) != 0) error = system_error("Cannot sync");
+    if (close(fd) != 0 && error.empty()) error = system_error("Cannot write");
+    if (error.empty() && rename(tmp.c_str(), target.c_str()) != 0) error = system_error("Cannot replace file");
+    if (!error.empty()) {
+        unlink(tmp.c_str());
+        return error;
+    }
+
+    // Make the rename itself durable; best effort
+    int dfd = open(dir.c_str(), O_RDONLY);
+    if (dfd >= 0) {
+        fsync(dfd);
+        close(dfd);
+    }
+    return error;
+}
+#endif
+
+static void run_job(SaveJob* job);
+
+static void save_finished(void* data) {
+    SaveJob* job = static_cast<SaveJob*>(data);
+    auto it = running.find(job->path);
+    std::unique_ptr<SaveJob> finished = std::move(it->second);
+    running.erase(it);
+
+    auto next = queued.find(job->path);
+    if (next != queued.end()) {
+        SaveJob* waiting = next->second.get();
+        running[waiting->path] = std::move(next->second);
+        queued.erase(next);
+        run_job(waiting);
+    }
+    finished->done(finished->path, finished->tag, finished->error);
+}
+
+static void run_job(SaveJob* job) {
+    std::thread([job]() {
+        job->error = write_atomically(job->path, job->text, job->length);
+        Fl::awake(save_finished, job);
+    }).detach();
+}
+
+void start_file_save(const std::string& path, char* text, size_t length,
+                     unsigned long tag, FileSaveDone done) {
+    std::unique_ptr<SaveJob> job(new SaveJob);
+    job->path = path;
+    job->text = text;
+    job->length = length;
+    job->tag = tag;
+    job->done = done;
+
+    if (running.count(path)) {
+        queued[path] = std::move(job);  // frees an older waiting snapshot
+        return;
+    }
+    SaveJob* started = job.get();
+    running[path] = std::move(job);
+    run_job(started);
+}
+
+bool file_save_pending(const std::string& path) {
+    if (path.empty()) return !running.empty();
+    return running.count(path) || queued.count(path);
+}
+
+void wait_for_file_saves() {
+    while (!running.empty()) Fl::wait(0.05);
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Called on the main thread once a save has finished. `error` is empty on
+// success; `tag` is the value given to start_file_save.
+typedef void (*FileSaveDone)(const std::string& path, unsigned long tag, const std::string& error);
+
+// Write `text` (malloc'd, taken over and freed) to `path` on a worker
+// thread: a temporary file in the same directory is written and synced,
+// then renamed over the target so readers never see a partial file.
+// Saves of one path run in order; a newer snapshot queued behind a running
+// save replaces any older one still waiting.
+void start_file_save(const std::string& path, char* text, size_t length,
+                     unsigned long tag, FileSaveDone done);
+
+// Any save of `path` running or queued; any save at all when empty
+bool file_save_pending(const std::string& path = std::string());
+
+// Process events until every save has finished, e.g. before quitting
+void wait_for_file_saves();
@@ -1,49 +1,42 @@
 #include "file_tree.hpp"
 #include "utils.hpp"
-#include <FL/Fl_Tree.H>
+#include "dir_watcher.hpp"
+#include "dir_scanner.hpp"
+#include "dir_snapshot.hpp"
+#include "file_types.hpp"
+#include "file_remover.hpp"
+#include "file_copier.hpp"
+#include "tab_bar.hpp"
+#include "tree_view.hpp"
+#include "path_index.hpp"
+#include "git_status.hpp"
+#include "file_io.hpp"
+#include "colors.hpp"
+#include <FL/Fl_Input.H>
 #include <FL/Fl_Menu.H>
+#include <FL/Fl_Scrollbar.H>
+#include <FL/fl_draw.H>
 #include <FL/fl_ask.H>
 #include <FL/filename.H>
 #include <dirent.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <cstring>
 #include <cstdio>
 #include <cstdint>
+#include <memory>
 #include <set>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 #include <unistd.h>
 #include <algorithm>
+#include <chrono>
 #include <vector>
 
-static char root_label_buf[FL_PATH_MAX];
-
-// Common source code file extensions
-static const std::set<std::string> source_extensions = {
-    ".c", ".cpp", ".cc", ".cxx", ".h", ".hpp", ".hxx",
-    ".java", ".py", ".js", ".ts", ".html", ".css", ".scss",
-    ".php", ".rb", ".go", ".rs", ".swift", ".kt", ".scala",
-    ".cs", ".vb", ".sql", ".sh", ".bash", ".zsh", ".fish",
-    ".cmake", ".make", ".mk", ".md", ".txt", ".json", ".xml",
-    ".yaml", ".yml", ".toml", ".ini", ".cfg", ".conf"
-};
-
-// Directories and files to ignore
-static const std::set<std::string> ignore_patterns = {
-    ".git", ".svn", ".hg", ".bzr",
-    "node_modules", "vendor", "target", "build", "dist",
-    ".cache", ".tmp", ".temp", "__pycache__",
-    ".DS_Store", "Thumbs.db", "desktop.ini"
-};
-
 static bool should_ignore_item(const char* name) {
-    std::string item_name(name);
-
-    // Check ignore patterns
-    for (const auto& pattern : ignore_patterns) {
-        if (item_name == pattern) return true;
-    }
-
-    return false;
+    return classify_file(name).ignored;
 }
 
 // Configuration: Set to true for minimal icons, false for pure text-only
@@ -54,117 +47,318 @@ static const char* get_file_icon(const char* filename, bool is_directory) {
     if (!USE_MINIMAL_ICONS) {
         return "";  // Pure text-only mode - no icons at all
     }
-
     if (is_directory) {
         return "▸ ";  // Simple chevron for folders
     }
+    return classify_file(filename).icon;
+}
+
+static bool is_source_file(const char* name) {
+    return classify_file(name).source;
+}
 
-    const char* ext = strrchr(filename, '.');
-    if (!ext) return "◦ ";  // Simple dot for files without extension
+// Directories whose entries are listed in the tree are watched, so that
+// changes made by the editor or anything else become single item updates
+static DirWatcher* tree_watcher = nullptr;
+static void tree_dirs_changed(const std::vector<DirEvent>& events, void*);
+
+static void watch_listed_dir(const std::string& dir) {
+    if (!tree_watcher)
+        tree_watcher = new DirWatcher(WATCH_CHANGED | WATCH_CREATED | WATCH_DELETED | WATCH_MOVED_FROM |
+                                          WATCH_MOVED_TO,
+                                      tree_dirs_changed);
+    tree_watcher->add(dir);
+}
 
-    std::string extension(ext);
-    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+// Stop watching `dir` and every directory below it
+static void unwatch_dirs_under(const std::string& dir) {
+    if (!tree_watcher) return;
+    for (const std::string& watched : tree_watcher->dirs()) {
+        if (watched == dir || (watched.size() > dir.size() && !watched.compare(0, dir.size(), dir) &&
+                               watched[dir.size()] == '/'))
+            tree_watcher->remove(watched);
+    }
+}
 
-    // Source code files - use subtle circles
-    if (extension == ".c" || extension == ".cpp" || extension == ".cc" || extension == ".cxx" ||
-        extension == ".h" || extension == ".hpp" || extension == ".hxx") return "◯ ";
+// Node flag for entries that are directories, loaded or not
+static const unsigned DIR_NODE = 1;
 
-    // Web files - simple geometric shapes
-    if (extension == ".html" || extension == ".htm") return "◇ ";
-    if (extension == ".css" || extension == ".scss") return "◈ ";
-    if (extension == ".js" || extension == ".ts" || extension == ".jsx" || extension == ".tsx") return "◉ ";
+static bool is_dir_item(int node) {
+    return node == TREE_ROOT || (file_tree->flags(node) & DIR_NODE);
+}
 
-    // Data/Config files - simple square
-    if (extension == ".json" || extension == ".xml" || extension == ".yaml" || extension == ".yml" ||
-        extension == ".toml" || extension == ".ini" || extension == ".cfg" || extension == ".conf") return "◾ ";
+// "..." until expanded, "Loading..." while the scanner reads the directory
+static bool is_placeholder(int node) {
+    const std::string& label = file_tree->label(node);
+    return label == "..." || label == "Loading...";
+}
 
-    // Script files - simple triangle
-    if (extension == ".sh" || extension == ".bash" || extension == ".zsh" || extension == ".fish" ||
-        extension == ".py" || extension == ".rb" || extension == ".go" || extension == ".rs" ||
-        extension == ".java" || extension == ".php" || extension == ".swift" || extension == ".kt") return "▲ ";
+static int placeholder_of(int node) {
+    for (int i = file_tree->children(node) - 1; i >= 0; --i) {
+        if (is_placeholder(file_tree->child(node, i))) return file_tree->child(node, i);
+    }
+    return TREE_NONE;
+}
 
-    // Build files - simple diamond
-    if (extension == ".cmake" || extension == ".make" || extension == ".mk") return "◆ ";
+static void add_placeholder(int node, const char* label) {
+    file_tree->add(node, label);
+}
 
-    // Documents - simple dot
-    if (extension == ".md" || extension == ".txt" || extension == ".rst") return "◦ ";
+// Entries the tree shows. Also run on the scanner thread: reads constants only.
+static bool tree_lists(const char* name, bool is_dir) {
+    FileType type = classify_file(name);
+    return !type.ignored && (is_dir || type.source);
+}
 
-    return "◦ ";  // Default: simple dot
+// Give a collapsed directory, `name` inside the directory fd `at`, a "..."
+// child that is loaded on expansion, unless it is certainly empty
+static void add_lazy_placeholder(int node, int at, const char* name) {
+    if (dir_may_list(at, name, tree_lists)) add_placeholder(node, "...");
 }
 
-static bool is_source_file(const char* name) {
-    std::string filename(name);
-    size_t dot_pos = filename.find_last_of('.');
-    if (dot_pos == std::string::npos) return false;
+// ======================
+// Path Index
+// ======================
 
-    std::string ext = filename.substr(dot_pos);
-    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+// Every listed entry by its path relative to current_folder; the root is "".
+// Kept in step with the tree so lookups never walk or rebuild labels.
+static std::unordered_map<std::string, int> item_index;
+// mtime of each listed directory when it was read, for the snapshot
+static std::unordered_map<std::string, long long> dir_mtimes;
 
-    return source_extensions.find(ext) != source_extensions.end();
+static std::string entry_label(const std::string& name, bool is_dir) {
+    return std::string(get_file_icon(name.c_str(), is_dir)) + name;
 }
 
-static bool has_subdirectories(const char* dir_path) {
-    if (!dir_path || !*dir_path) return false;
+// Entry name of an item, without its icon
+static std::string item_name(int node) {
+    const char* label = file_tree->label(node).c_str();
+    if (USE_MINIMAL_ICONS) {
+        const char* space = strchr(label, ' ');
+        if (space) label = space + 1;
+    }
+    return label;
+}
+
+static std::string join_path(const std::string& dir, const std::string& name) {
+    if (dir.empty()) return name;
+    if (name.empty()) return dir;
+    return dir.back() == '/' ? dir + name : dir + "/" + name;
+}
 
-    DIR* d = opendir(dir_path);
-    if (!d) {
-        // Debug: Directory couldn't be opened
-        return false;
+// Path of `abs` relative to current_folder; false if it lies outside
+static bool relative_path(const std::string& abs, std::string& rel) {
+    std::string root(current_folder);
+    if (abs == root) {
+        rel.clear();
+        return true;
     }
+    std::string prefix = root.back() == '/' ? root : root + "/";
+    if (abs.size() <= prefix.size() || abs.compare(0, prefix.size(), prefix) != 0) return false;
+    rel = abs.substr(prefix.size());
+    return true;
+}
 
-    struct dirent* e;
-    bool has_dirs = false;
+static int lookup_item(const std::string& rel) {
+    if (rel.empty()) return TREE_ROOT;
+    auto it = item_index.find(rel);
+    return it == item_index.end() ? TREE_NONE : it->second;
+}
 
-    while ((e = readdir(d))) {
-        if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) continue;
-        if (should_ignore_item(e->d_name)) continue;
+// Node listing absolute `path`, or TREE_NONE if it is not in the tree
+static int item_for_path(const std::string& path) {
+    std::string rel;
+    return relative_path(path, rel) ? lookup_item(rel) : TREE_NONE;
+}
+
+// Path of `node` relative to current_folder, from its labels: O(depth)
+static std::string item_rel_path(int node) {
+    std::string rel;
+    for (; node != TREE_NONE && node != TREE_ROOT; node = file_tree->parent(node))
+        rel = rel.empty() ? item_name(node) : item_name(node) + "/" + rel;
+    return rel;
+}
+
+// Absolute path of the entry `node` stands for
+static std::string item_path_of(int node) {
+    return join_path(current_folder, item_rel_path(node));
+}
+
+static void index_subtree(int node, const std::string& rel) {
+    item_index[rel] = node;
+    for (int i = 0; i < file_tree->children(node); ++i) {
+        int child = file_tree->child(node, i);
+        if (!is_placeholder(child)) index_subtree(child, join_path(rel, item_name(child)));
+    }
+}
+
+static void unindex_subtree(int node, const std::string& rel) {
+    item_index.erase(rel);
+    dir_mtimes.erase(rel);
+    for (int i = 0; i < file_tree->children(node); ++i) {
+        int child = file_tree->child(node, i);
+        if (!is_placeholder(child)) unindex_subtree(child, join_path(rel, item_name(child)));
+    }
+}
+
+// ======================
+// Git Status
+// ======================
+
+// Entries that are not clean, by path relative to current_folder
+static std::unordered_map<std::string, GitState> git_states;
+// Folders with a modified, deleted or untracked entry somewhere below, by count
+static std::unordered_map<std::string, int> git_changes_below;
+// Metadata directory of the folder's repository, watched for index changes
+static std::string git_dir;
+
+static std::string parent_rel_of(const std::string& rel) {
+    size_t slash = rel.rfind('/');
+    return slash == std::string::npos ? std::string() : rel.substr(0, slash);
+}
+
+static Fl_Color git_color(GitState state) {
+    bool dark = current_theme == THEME_DARK;
+    switch (state) {
+        case GIT_MODIFIED:
+        case GIT_DELETED:
+            return dark ? Colors::rgb(Colors::WARNING) : fl_rgb_color(176, 110, 0);
+        case GIT_UNTRACKED:
+            return dark ? Colors::rgb(Colors::SUCCESS) : fl_rgb_color(40, 140, 40);
+        case GIT_IGNORED:
+            return dark ? Colors::rgb(Colors::TEXT_DISABLED) : fl_rgb_color(150, 150, 150);
+        default:
+            return 0;
+    }
+}
+
+static void count_change_below(const std::string& rel, int delta) {
+    for (std::string dir = parent_rel_of(rel); !dir.empty(); dir = parent_rel_of(dir)) {
+        int& count = git_changes_below[dir];
+        count += delta;
+        if (count <= 0) git_changes_below.erase(dir);
+    }
+}
+
+static void set_git_state(const std::string& rel, GitState state) {
+    auto it = git_states.find(rel);
+    GitState old = it == git_states.end() ? GIT_CLEAN : it->second;
+    if (old == state) return;
+    if (old != GIT_CLEAN && old != GIT_IGNORED) count_change_below(rel, -1);
+    if (state != GIT_CLEAN && state != GIT_IGNORED) count_change_below(rel, 1);
+    if (state == GIT_CLEAN) git_states.erase(it);
+    else git_states[rel] = state;
+}
+
+// An entry's own state, or that of an untracked or ignored folder it is in
+static GitState git_state_of(const std::string& rel) {
+    auto it = git_states.find(rel);
+    if (it != git_states.end()) return it->second;
+    for (std::string dir = parent_rel_of(rel); !dir.empty(); dir = parent_rel_of(dir)) {
+        auto up = git_states.find(dir);
+        if (up != git_states.end() && (up->second == GIT_UNTRACKED || up->second == GIT_IGNORED))
+            return up->second;
+    }
+    return GIT_CLEAN;
+}
+
+static void decorate_item(int node, const std::string& rel) {
+    if (git_states.empty()) {
+        file_tree->node_color(node, 0);
+        return;
+    }
+    GitState state = git_state_of(rel);
+    if (state == GIT_CLEAN && git_changes_below.count(rel)) state = GIT_MODIFIED;
+    file_tree->node_color(node, git_color(state));
+}
+
+static void decorate_subtree(int node, const std::string& rel) {
+    decorate_item(node, rel);
+    for (int i = 0; i < file_tree->children(node); ++i) {
+        int child = file_tree->child(node, i);
+        if (!is_placeholder(child)) decorate_subtree(child, join_path(rel, item_name(child)));
+    }
+}
 
-        // Build full path more carefully
-        std::string full_path = std::string(dir_path);
-        if (full_path.back() != '/') {
-            full_path += "/";
+static void git_status_ready(void*) {
+    if (!file_tree) return;
+    GitStatusUpdate update;
+    bool full = false;
+    std::vector<std::string> touched;
+    while (take_git_status(update)) {
+        if (update.full) {
+            git_states.clear();
+            git_changes_below.clear();
+            touched.clear();
+            full = true;
         }
-        full_path += e->d_name;
+        for (const auto& state : update.states) {
+            set_git_state(state.first, state.second);
+            if (!full) touched.push_back(state.first);
+        }
+    }
 
-        struct stat st;
-        if (stat(full_path.c_str(), &st) == 0) {
-            if (S_ISDIR(st.st_mode)) {
-                // Found a directory that's not ignored
-                has_dirs = true;
-                break;
+    if (full) {
+        for (const auto& item : item_index) decorate_item(item.second, item.first);
+    } else {
+        // The entries, the folders above them, and what is listed inside
+        for (const std::string& rel : touched) {
+            int node = lookup_item(rel);
+            if (node != TREE_NONE) decorate_subtree(node, rel);
+            for (std::string dir = parent_rel_of(rel); !dir.empty(); dir = parent_rel_of(dir)) {
+                int up = lookup_item(dir);
+                if (up != TREE_NONE) decorate_item(up, dir);
             }
         }
     }
-    closedir(d);
-    return has_dirs;
+    file_tree->redraw();
 }
 
-static void load_dir_recursive(const char* dir_path, Fl_Tree_Item* parent_item, bool lazy_load = false) {
-    DIR* d = opendir(dir_path);
-    if (!d) return;
+// Forget the previous folder's states and work out those of current_folder
+static void start_tree_git_status() {
+    git_states.clear();
+    git_changes_below.clear();
+    git_dir = find_git_dir(current_folder);
+    if (!git_dir.empty()) watch_listed_dir(git_dir);
+    start_git_status(current_folder, git_status_ready);
+}
+
+// Add entry `name` under `parent`, whose relative path is `parent_rel`, at `pos`
+static int add_entry_item(int parent, const std::string& parent_rel,
+                          const std::string& name, bool is_dir, int pos) {
+    int node = file_tree->add(parent, entry_label(name, is_dir).c_str(), pos);
+    std::string rel = join_path(parent_rel, name);
+    if (is_dir) file_tree->flags(node, DIR_NODE);
+    decorate_item(node, rel);
+    item_index[std::move(rel)] = node;
+    return node;
+}
+
+// List the open directory `d`, found at `dir_path`, under `parent_item`.
+// Subdirectories are opened relative to it, so paths are resolved once.
+static void load_dir_at(DIR* d, const char* dir_path, int parent_item, bool lazy_load) {
+    watch_listed_dir(dir_path);
+    std::string parent_rel = item_rel_path(parent_item);
+    dir_mtimes[parent_rel] = dir_mtime(d);
 
     struct dirent* e;
     std::vector<std::pair<std::string, bool>> entries;
 
     while ((e = readdir(d))) {
         if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) continue;
-        if (should_ignore_item(e->d_name)) continue;
+        FileType type = classify_file(e->d_name);
+        if (type.ignored) continue;
 
-        std::string full_path = std::string(dir_path) + "/" + e->d_name;
-        struct stat st;
+        int is_dir = dir_entry_is_dir(d, e);
+        if (is_dir < 0) continue;
 
-        if (stat(full_path.c_str(), &st) == 0) {
-            bool is_dir = S_ISDIR(st.st_mode);
-
-            // Only include source files or directories
-            if (!is_dir && !is_source_file(e->d_name)) {
-                continue;
-            }
-
-            entries.push_back({e->d_name, is_dir});
+        // Only include source files or directories
+        if (!is_dir && !type.source) {
+            continue;
         }
+
+        entries.push_back({e->d_name, is_dir == 1});
     }
-    closedir(d);
 
     // Sort entries: directories first, then by name
     std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) {
@@ -174,83 +368,66 @@ static void load_dir_recursive(const char* dir_path, Fl_Tree_Item* parent_item,
 
     // Add entries to tree
     for (const auto& entry : entries) {
-        std::string full_path = std::string(dir_path) + "/" + entry.first;
-
-        // Build relative path from root
-        std::string rel_path;
-        if (parent_item == file_tree->root()) {
-            rel_path = entry.first;
-        } else {
-            char parent_rel_path[FL_PATH_MAX];
-            file_tree->item_pathname(parent_rel_path, sizeof(parent_rel_path), parent_item);
-
-            // Remove root label prefix if present
-            const char* root_lbl = file_tree->root()->label();
-            if (root_lbl && *root_lbl) {
-                size_t len = strlen(root_lbl);
-                if (!strncmp(parent_rel_path, root_lbl, len) && parent_rel_path[len] == '/') {
-                    memmove(parent_rel_path, parent_rel_path + len + 1, strlen(parent_rel_path + len + 1) + 1);
-                }
-            }
-            rel_path = std::string(parent_rel_path) + "/" + entry.first;
-        }
-
-        Fl_Tree_Item* item = file_tree->add(rel_path.c_str());
-        if (item) {
-            // Set icon in label
-            const char* icon = get_file_icon(entry.first.c_str(), entry.second);
-            std::string labeled_name = std::string(icon) + entry.first;
-            item->label(labeled_name.c_str());
-
-            if (entry.second) {
-                // For directories in lazy load mode
-                if (lazy_load) {
-                    // Be optimistic: add placeholder if directory might have content
-                    // We use a more permissive check - if we can't determine or if it has subdirs
-                    bool should_add_placeholder = true;
-
-                    // Only skip placeholder if we're absolutely sure directory is empty
-                    DIR* check_dir = opendir(full_path.c_str());
-                    if (check_dir) {
-                        struct dirent* check_entry;
-                        bool found_any_item = false;
-                        while ((check_entry = readdir(check_dir))) {
-                            if (!strcmp(check_entry->d_name, ".") || !strcmp(check_entry->d_name, "..")) continue;
-                            if (should_ignore_item(check_entry->d_name)) continue;
-                            found_any_item = true;
-                            break;
-                        }
-                        closedir(check_dir);
-                        should_add_placeholder = found_any_item;
-                    }
-
-                    if (should_add_placeholder) {
-                        std::string placeholder_path = rel_path + "/__LAZY_LOAD_PLACEHOLDER__";
-                        Fl_Tree_Item* placeholder = file_tree->add(placeholder_path.c_str());
-                        if (placeholder) {
-                            placeholder->label("...");
-                        }
-                    }
-                } else {
-                    // Initial load: load immediate children with lazy loading
-                    load_dir_recursive(full_path.c_str(), item, true);
-                }
-                item->close(); // Start collapsed
+        int item = add_entry_item(parent_item, parent_rel, entry.first, entry.second, -1);
+        if (entry.second) {
+            // For directories in lazy load mode
+            if (lazy_load) {
+                add_lazy_placeholder(item, dirfd(d), entry.first.c_str());
+            } else if (DIR* sub = open_dir_at(dirfd(d), entry.first.c_str())) {
+                // Initial load: load immediate children with lazy loading
+                load_dir_at(sub, join_path(dir_path, entry.first).c_str(), item, true);
+                closedir(sub);
             }
+            file_tree->close(item); // Start collapsed
         }
     }
 }
 
+static void load_dir_recursive(const char* dir_path, int parent_item, bool lazy_load = false) {
+    DIR* d = open_dir_at(AT_FDCWD, dir_path);
+    if (!d) return;
+    load_dir_at(d, dir_path, parent_item, lazy_load);
+    closedir(d);
+}
+
 static void collapse_first_level() {
-    Fl_Tree_Item* root = file_tree->root();
-    if (!root) return;
-    for (int i = 0; i < root->children(); ++i) {
-        Fl_Tree_Item* child = root->child(i);
-        if (child->has_children()) child->close();
+    for (int i = 0; i < file_tree->children(TREE_ROOT); ++i) {
+        int child = file_tree->child(TREE_ROOT, i);
+        if (file_tree->children(child)) file_tree->close(child);
     }
 }
 
+// Listings come from the scanner thread. A job older than the folder's
+// own belongs to a folder no longer shown.
+static unsigned long scan_jobs = 0;
+static unsigned long folder_job = 0;
+static bool root_listed = false;  // the folder's own entries are in the tree
+static void listings_ready(void*);
+static bool paint_from_snapshot();
+static void clear_tree_filter();
+static void invalidate_path_index();
+
+// Open directories of the folder by relative path, kept in step as they open
+// and close and written out a moment after the last change, or at quit
+static std::set<std::string> expanded_dirs;
+static bool expansion_dirty = false;
+static void note_expansion(int node, bool open);
+static void note_open_subtree(int node, const std::string& rel);
+static std::vector<std::string> path_prefixes(const std::vector<std::string>& rels);
+
+// Expand All reads what it opens ahead on the scanner's pool, this many
+// levels below the directories not listed yet and this many entries at most
+static const int EXPAND_ALL_DEPTH = 16;
+static const size_t EXPAND_ALL_ENTRIES = 200000;
+static unsigned long expand_all_job = 0;
+
 void load_folder(const char* folder) {
+    // Keep what was read of the folder shown so far; the same folder again
+    // is a refresh and is read afresh
+    save_tree_snapshot();
+    save_tree_expansion_state();
+    std::string previous = root_listed ? current_folder : "";
+
     strncpy(current_folder, folder, sizeof(current_folder));
     current_folder[sizeof(current_folder) - 1] = '\0';
     size_t len = strlen(current_folder);
@@ -259,17 +436,24 @@ void load_folder(const char* folder) {
         --len;
     }
 
-    if (USE_MINIMAL_ICONS) {
-        snprintf(root_label_buf, sizeof(root_label_buf), "▸ %s", fl_filename_name(current_folder));
-    } else {
-        snprintf(root_label_buf, sizeof(root_label_buf), "%s", fl_filename_name(current_folder));
+    if (tree_watcher) {
+        for (const std::string& watched : tree_watcher->dirs()) tree_watcher->remove(watched);
     }
-
     file_tree->clear();
-    file_tree->root_label(root_label_buf);
-
-    load_dir_recursive(current_folder, file_tree->root());
-    collapse_first_level();
+    item_index.clear();
+    dir_mtimes.clear();
+    expanded_dirs.clear();
+    root_listed = false;
+    clear_tree_filter();
+    start_tree_git_status();
+
+    cancel_dir_scans();
+    folder_job = ++scan_jobs;
+    if (previous == current_folder || !paint_from_snapshot()) {
+        // The scanner thread reads the folder; listings are added as they come
+        add_placeholder(TREE_ROOT, "Loading...");
+        scan_directory(folder_job, current_folder, true, false, tree_lists, listings_ready);
+    }
 
     // Save current folder
     FILE* fp = fopen(last_folder_path(), "w");
@@ -278,9 +462,6 @@ void load_folder(const char* folder) {
         fclose(fp);
     }
 
-    // Load and restore the expansion state for this folder
-    load_tree_expansion_state();
-
     file_tree->redraw();
 }
 
@@ -296,208 +477,391 @@ void load_last_folder_if_any() {
     }
 }
 
-void refresh_tree_item(Fl_Tree_Item* it) {
-    if (!it) return;
+void refresh_tree_item(int it) {
+    if (it == TREE_NONE) return;
 
-    // Get the full path for this item
-    char item_path[FL_PATH_MAX];
-    file_tree->item_pathname(item_path, sizeof(item_path), it);
-
-    // Remove root label prefix if present
-    const char* root_lbl = file_tree->root()->label();
-    if (root_lbl && *root_lbl) {
-        size_t len = strlen(root_lbl);
-        if (!strncmp(item_path, root_lbl, len) && item_path[len] == '/') {
-            memmove(item_path, item_path + len + 1, strlen(item_path + len + 1) + 1);
-        }
-    }
-
-    std::string full_path = std::string(current_folder) + "/" + item_path;
+    std::string rel = item_rel_path(it);
+    std::string full_path = join_path(current_folder, rel);
 
     // Remove all children
-    while (it->children() > 0) {
-        file_tree->remove(it->child(0));
+    while (file_tree->children(it) > 0) {
+        int child = file_tree->child(it, 0);
+        if (!is_placeholder(child)) unindex_subtree(child, join_path(rel, item_name(child)));
+        file_tree->remove(child);
     }
 
     // Reload directory content
-    bool was_open = it->is_open();
+    bool was_open = file_tree->is_open(it);
     load_dir_recursive(full_path.c_str(), it, true);
 
     if (was_open) {
-        it->open();
+        file_tree->open(it);
     } else {
-        it->close();
+        file_tree->close(it);
     }
 
     file_tree->redraw();
 }
 
-void tree_cb(Fl_Widget* w, void*) {
-    Fl_Tree* tr = static_cast<Fl_Tree*>(w);
-    Fl_Tree_Item* it = tr->callback_item();
-    if (!it) return;
+// ======================
+// Live Updates
+// ======================
 
-    if (tr->callback_reason() == FL_TREE_REASON_SELECTED) {
-        // Auto-scroll horizontally to make selected item visible
-        if (it) {
-            // Calculate item position based on tree indentation and text width
-            int icon_width = 16; // Default icon width
-            if (tr->openicon() && tr->openicon()->w() > 0) {
-                icon_width = tr->openicon()->w();
-            }
-            int indent = it->depth() * icon_width;
-            int label_width = 0;
-            fl_font(tr->labelfont(), tr->labelsize());
-            if (it->label()) {
-                label_width = (int)fl_width(it->label());
-            }
+// A directory's entries are listed once its placeholder has been replaced
+static bool is_listed(int node) {
+    return is_dir_item(node) && placeholder_of(node) == TREE_NONE;
+}
 
-            int item_x = indent;
-            int item_w = label_width + 40; // Add some padding for icon space
+// Position keeping the order of load_dir_recursive: directories first, then
+// by name. Children are sorted, so a binary search finds it.
+static int entry_position(int parent, const std::string& name, bool is_dir) {
+    int lo = 0, hi = file_tree->children(parent);
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int child = file_tree->child(parent, mid);
+        bool child_dir = is_dir_item(child);
+        bool before = is_placeholder(child) ? false
+                    : child_dir != is_dir ? child_dir
+                    : item_name(child) < name;
+        if (before) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
 
-            // Get current scroll position and tree viewport
-            int scroll_x = tr->hposition();
-            int tree_view_w = tr->w();
+// Add `name` in `dir` if the tree lists that directory; true if the tree changed
+static bool tree_add_entry(const std::string& dir, const std::string& name) {
+    if (should_ignore_item(name.c_str())) return false;
+    int parent = item_for_path(dir);
+    if (parent == TREE_NONE || !is_listed(parent)) return false;
+
+    std::string path = join_path(dir, name);
+    std::string rel;
+    if (!relative_path(path, rel) || lookup_item(rel) != TREE_NONE) return false;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    bool is_dir = S_ISDIR(st.st_mode);
+    if (!is_dir && !is_source_file(name.c_str())) return false;
+
+    int item = add_entry_item(parent, item_rel_path(parent), name, is_dir,
+                              entry_position(parent, name, is_dir));
+    if (is_dir) {
+        add_lazy_placeholder(item, AT_FDCWD, path.c_str());
+        file_tree->close(item);
+    }
+    invalidate_path_index();
+    return true;
+}
 
-            // Check if item extends beyond right edge of visible area
-            if (item_x + item_w > scroll_x + tree_view_w) {
-                // Scroll right to show the item with some padding
-                int new_scroll_x = (item_x + item_w) - tree_view_w + 20;
-                tr->hposition(new_scroll_x);
-            }
-            // Check if item is too far left
-            else if (item_x < scroll_x) {
-                // Scroll left to show the item with some padding
-                int new_scroll_x = item_x - 20;
-                if (new_scroll_x < 0) new_scroll_x = 0;
-                tr->hposition(new_scroll_x);
-            }
+static bool tree_remove_entry(const std::string& path) {
+    int item = item_for_path(path);
+    if (item == TREE_NONE || item == TREE_ROOT) return false;
+    unwatch_dirs_under(path);
+    unindex_subtree(item, item_rel_path(item));
+    file_tree->remove(item);
+    invalidate_path_index();
+    return true;
+}
+
+// Follow a rename, moving the item (and its loaded subtree) when the tree
+// lists both ends; otherwise it is a removal and/or an addition
+static bool tree_move_entry(const std::string& from, const std::string& dir, const std::string& name) {
+    int item = item_for_path(from);
+    if (item == TREE_NONE || item == TREE_ROOT) return tree_add_entry(dir, name);
+
+    bool is_dir = is_dir_item(item);
+    int parent = item_for_path(dir);
+    std::string to = join_path(dir, name);
+    std::string to_rel;
+    if (parent == TREE_NONE || !is_listed(parent) || should_ignore_item(name.c_str()) ||
+        (!is_dir && !is_source_file(name.c_str())) || !relative_path(to, to_rel) || lookup_item(to_rel) != TREE_NONE) {
+        tree_remove_entry(from);
+        tree_add_entry(dir, name);
+        return true;
+    }
+
+    unindex_subtree(item, item_rel_path(item));
+    int pos = entry_position(parent, name, is_dir);  // while the children are still in order
+    file_tree->label(item, entry_label(name, is_dir).c_str());
+    file_tree->move(item, parent, pos);
+    index_subtree(item, to_rel);
+    invalidate_path_index();
+
+    if (is_dir && tree_watcher) {
+        // Watches follow the directory, so file them under its new path
+        std::vector<std::string> rewatch;
+        for (const std::string& watched : tree_watcher->dirs()) {
+            if (watched == from || (watched.size() > from.size() && !watched.compare(0, from.size(), from) &&
+                                    watched[from.size()] == '/'))
+                rewatch.push_back(watched);
         }
+        for (const std::string& watched : rewatch) tree_watcher->remove(watched);
+        for (const std::string& watched : rewatch) tree_watcher->add(to + watched.substr(from.size()));
+    }
+    return true;
+}
 
-        if (!it->has_children()) {
-            char rel[FL_PATH_MAX];
-            tr->item_pathname(rel, sizeof(rel), it);
-            const char* root_lbl = file_tree->root()->label();
-            if (root_lbl && *root_lbl) {
-                size_t len = strlen(root_lbl);
-                if (!strncmp(rel, root_lbl, len) && rel[len] == '/')
-                    memmove(rel, rel + len + 1, strlen(rel + len + 1) + 1);
+static void tree_dirs_changed(const std::vector<DirEvent>& events, void*) {
+    if (!file_tree || !current_folder[0]) return;
+
+    bool changed = false;
+    std::vector<bool> handled(events.size(), false);
+    std::vector<std::string> git_paths;
+    for (size_t i = 0; i < events.size(); ++i) {
+        const DirEvent& ev = events[i];
+        if (ev.events & WATCH_OVERFLOW) {
+            load_folder(current_folder);  // events were lost
+            return;
+        }
+        if (ev.name.empty()) continue;  // a directory itself: its parent reports it
+        std::string path = ev.dir + "/" + ev.name;
+        // A new index is picked up by the worker, which then looks at everything
+        if (!git_dir.empty() && (ev.dir != git_dir || ev.name == "index")) git_paths.push_back(path);
+        if (handled[i]) continue;
+
+        if (ev.events & WATCH_MOVED_FROM) {
+            size_t to = i + 1;
+            while (to < events.size() && !((events[to].events & WATCH_MOVED_TO) && events[to].cookie == ev.cookie))
+                ++to;
+            if (to < events.size()) {
+                handled[to] = true;
+                changed |= tree_move_entry(path, events[to].dir, events[to].name);
+            } else {
+                changed |= tree_remove_entry(path);  // moved out of sight
             }
+        } else if (ev.events & WATCH_DELETED) {
+            changed |= tree_remove_entry(path);
+        } else if (ev.events & (WATCH_CREATED | WATCH_MOVED_TO)) {
+            changed |= tree_add_entry(ev.dir, ev.name);
+        }
+    }
+    recheck_git_status(git_paths);
+    if (changed) file_tree->redraw();
+}
+
+// ======================
+// Background Loading
+// ======================
+
+static const size_t LISTING_BATCH = 64;
+static const std::chrono::milliseconds DRAIN_BUDGET(8);
+
+static DirListing applying;     // listing being added to the tree
+static size_t applied = 0;      // entries of it added so far
+static bool have_listing = false;
 
-            char full_path[FL_PATH_MAX];
-            snprintf(full_path, sizeof(full_path), "%s/%s", current_folder, rel);
-            load_file(full_path);
+static void add_listed_entry(int parent, const std::string& parent_rel, const ScanEntry& entry) {
+    // In front of the placeholder, which stays until the listing is complete
+    int item = add_entry_item(parent, parent_rel, entry.name, entry.is_dir, file_tree->children(parent) - 1);
+    if (!entry.is_dir) return;
+    if (entry.has_entries) add_placeholder(item, "...");
+    file_tree->close(item);
+}
+
+// Bring the listed directory `node` in line with a new listing of it.
+// Entries still there keep their nodes, and so their open subtrees.
+static void reconcile_listing(int node, const std::string& rel, const std::vector<ScanEntry>& entries) {
+    std::unordered_set<std::string> listed;  // names; directories end in '/'
+    for (const ScanEntry& entry : entries) listed.insert(entry.is_dir ? entry.name + "/" : entry.name);
+
+    for (int i = file_tree->children(node) - 1; i >= 0; --i) {
+        int child = file_tree->child(node, i);
+        if (is_placeholder(child)) continue;
+        std::string name = item_name(child);
+        if (listed.count(is_dir_item(child) ? name + "/" : name)) continue;
+        std::string child_rel = join_path(rel, name);
+        unwatch_dirs_under(join_path(current_folder, child_rel));
+        unindex_subtree(child, child_rel);
+        file_tree->remove(child);
+    }
+    for (const ScanEntry& entry : entries) {
+        if (lookup_item(join_path(rel, entry.name)) != TREE_NONE) continue;
+        int item = add_entry_item(node, rel, entry.name, entry.is_dir,
+                                  entry_position(node, entry.name, entry.is_dir));
+        if (entry.is_dir && entry.has_entries) add_placeholder(item, "...");
+    }
+}
+
+// Add the next entries of `applying`; true once it is done with
+static bool continue_listing() {
+    if (applying.job < folder_job) return true;  // another folder since
+
+    std::string rel;
+    int item = relative_path(applying.dir, rel) ? lookup_item(rel) : TREE_NONE;
+    if (applying.refresh) {
+        // Changed since the snapshot the tree was painted from
+        if (item != TREE_NONE && is_listed(item)) {
+            reconcile_listing(item, rel, applying.entries);
+            dir_mtimes[rel] = applying.mtime;
         }
-    } else if (tr->callback_reason() == FL_TREE_REASON_OPENED) {
-        // Auto-scroll horizontally to make expanded item visible
-        if (it) {
-            // Calculate item position based on tree indentation and text width
-            int icon_width = 16; // Default icon width
-            if (tr->openicon() && tr->openicon()->w() > 0) {
-                icon_width = tr->openicon()->w();
-            }
-            int indent = it->depth() * icon_width;
-            int label_width = 0;
-            fl_font(tr->labelfont(), tr->labelsize());
-            if (it->label()) {
-                label_width = (int)fl_width(it->label());
-            }
+        return true;
+    }
 
-            int item_x = indent;
-            int item_w = label_width + 40; // Add some padding for icon space
+    int placeholder = item != TREE_NONE ? placeholder_of(item) : TREE_NONE;
+    if (placeholder != TREE_NONE) {
+        size_t end = std::min(applied + LISTING_BATCH, applying.entries.size());
+        for (; applied < end; ++applied) add_listed_entry(item, rel, applying.entries[applied]);
+        if (applied < applying.entries.size()) return false;
+        file_tree->remove(placeholder);
+        dir_mtimes[rel] = applying.mtime;
+        watch_listed_dir(applying.dir);
+        if (item == TREE_ROOT) root_listed = true;
+        if (applying.job == expand_all_job) {
+            file_tree->open(item);
+            note_expansion(item, true);
+        }
+    }
+    // else: gone, or listed another way meanwhile
 
-            // Get current scroll position and tree viewport
-            int scroll_x = tr->hposition();
-            int tree_view_w = tr->w();
+    if (applying.job == folder_job && applying.last) {
+        // Whole folder in: restore the expansion state for it
+        collapse_first_level();
+        load_tree_expansion_state();
+    }
+    return true;
+}
 
-            // Check if expanded item extends beyond right edge of visible area
-            if (item_x + item_w > scroll_x + tree_view_w) {
-                // Scroll right to show the expanded item with some padding
-                int new_scroll_x = (item_x + item_w) - tree_view_w + 20;
-                tr->hposition(new_scroll_x);
+// Idle callback: add listings in slices short enough to keep input responsive
+static void drain_listings(void*) {
+    if (!file_tree) return;
+    auto deadline = std::chrono::steady_clock::now() + DRAIN_BUDGET;
+    do {
+        if (!have_listing) {
+            if (!take_dir_listing(applying)) {
+                Fl::remove_idle(drain_listings);
+                break;
             }
+            have_listing = true;
+            applied = 0;
         }
+        if (continue_listing()) have_listing = false;
+    } while (std::chrono::steady_clock::now() < deadline);
+    file_tree->redraw();
+}
 
-        // Handle lazy loading when a directory is expanded
-        if (it->has_children()) {
-            // Check if this directory has placeholder children
-            bool has_placeholder = false;
-            std::vector<Fl_Tree_Item*> placeholders_to_remove;
-
-            // Find all placeholder children
-            for (int i = 0; i < it->children(); ++i) {
-                Fl_Tree_Item* child = it->child(i);
-                if (child) {
-                    // Get the child's path to check for placeholder pattern
-                    char child_path[FL_PATH_MAX];
-                    file_tree->item_pathname(child_path, sizeof(child_path), child);
-                    const char* label = child->label();
-
-                    // Check for placeholder by path pattern or label content
-                    if ((label && (strstr(label, "...") || strstr(label, "Loading..."))) ||
-                        strstr(child_path, "__LAZY_LOAD_PLACEHOLDER__") ||
-                        strstr(child_path, "__PLACEHOLDER_")) {
-                        placeholders_to_remove.push_back(child);
-                        has_placeholder = true;
-                    }
-                }
-            }
+static void listings_ready(void*) {
+    if (!Fl::has_idle(drain_listings)) Fl::add_idle(drain_listings);
+}
 
-            if (has_placeholder) {
-                // Remove all placeholders - iterate backwards to avoid index issues
-                for (int i = placeholders_to_remove.size() - 1; i >= 0; --i) {
-                    file_tree->remove(placeholders_to_remove[i]);
-                }
+// ======================
+// Snapshot
+// ======================
 
-                // Build the full path more carefully
-                char item_path[FL_PATH_MAX];
-                file_tree->item_pathname(item_path, sizeof(item_path), it);
-
-                // Remove root label prefix if present - be more careful with deep paths
-                const char* root_lbl = file_tree->root()->label();
-                char* clean_path = item_path;
-                if (root_lbl && *root_lbl) {
-                    // Extract just the folder name from root label (remove icon if present)
-                    const char* root_name = root_lbl;
-                    if (strlen(root_lbl) > 2 && root_lbl[1] == ' ') {
-                        root_name = root_lbl + 2; // Skip icon
-                    }
-
-                    size_t len = strlen(root_name);
-                    if (!strncmp(item_path, root_name, len) && (item_path[len] == '/' || item_path[len] == '\0')) {
-                        if (item_path[len] == '/') {
-                            clean_path = item_path + len + 1;
-                        } else {
-                            clean_path = item_path + len;
-                        }
-                    }
-                }
+// Listed directories below and including `node`, parents first
+static void collect_snapshot(int node, const std::string& rel, std::vector<SnapshotDir>& dirs) {
+    if (!is_listed(node)) return;
+    auto mtime = dir_mtimes.find(rel);
+    size_t at = dirs.size();
+    dirs.push_back({rel, mtime == dir_mtimes.end() ? -1 : mtime->second, {}});
+    for (int i = 0; i < file_tree->children(node); ++i) {
+        int child = file_tree->child(node, i);
+        bool is_dir = is_dir_item(child);
+        dirs[at].entries.push_back({item_name(child), is_dir, is_dir && file_tree->children(child) > 0});
+    }
+    for (int i = 0; i < file_tree->children(node); ++i) {
+        int child = file_tree->child(node, i);
+        if (is_dir_item(child)) collect_snapshot(child, join_path(rel, item_name(child)), dirs);
+    }
+}
 
-                // Build full filesystem path
-                std::string full_path;
-                if (strlen(clean_path) > 0) {
-                    full_path = std::string(current_folder) + "/" + clean_path;
-                } else {
-                    full_path = current_folder;
-                }
+void save_tree_snapshot() {
+    if (!file_tree || !root_listed || !current_folder[0]) return;
+    std::vector<SnapshotDir> dirs;
+    collect_snapshot(TREE_ROOT, "", dirs);
+    save_dir_snapshot(current_folder, dirs);
+}
 
-                // Load directory contents and check if any children were actually added
-                int children_before = it->children();
-                load_dir_recursive(full_path.c_str(), it, true);
-                int children_after = it->children();
+// Paint the tree from the snapshot the last session left, then have the
+// scanner re-read the directories changed since; false if there is none
+static bool paint_from_snapshot() {
+    std::vector<SnapshotDir> dirs;
+    if (!load_dir_snapshot(current_folder, dirs) || dirs.empty() || !dirs[0].rel.empty()) return false;
+
+    std::vector<DirStamp> stamps;
+    for (const SnapshotDir& dir : dirs) {
+        // Each listed once, under a parent the snapshot listed
+        int node = lookup_item(dir.rel);
+        if (node == TREE_NONE || !is_dir_item(node) || dir_mtimes.count(dir.rel)) continue;
+        for (int placeholder; (placeholder = placeholder_of(node)) != TREE_NONE;) file_tree->remove(placeholder);
+        for (const ScanEntry& entry : dir.entries) {
+            int item = add_entry_item(node, dir.rel, entry.name, entry.is_dir, -1);
+            if (entry.is_dir && entry.has_entries) add_placeholder(item, "...");
+        }
+        dir_mtimes[dir.rel] = dir.mtime;
+        std::string path = join_path(current_folder, dir.rel);
+        watch_listed_dir(path);
+        stamps.push_back({path, dir.mtime});
+    }
+    root_listed = true;
 
-                // If no children were added (directory is empty or has no displayable content),
-                // the directory will naturally not show a "+" icon, which is correct
+    collapse_first_level();
+    load_tree_expansion_state();
+    revalidate_directories(folder_job, std::move(stamps), tree_lists, listings_ready);
+    return true;
+}
 
-                file_tree->redraw();
-            }
+// Relabel the "..." of a directory about to be read; false if it has none
+static bool mark_loading(int node) {
+    int placeholder = placeholder_of(node);
+    if (placeholder == TREE_NONE || file_tree->label(placeholder) != "...") return false;
+    file_tree->label(placeholder, "Loading...");
+    return true;
+}
+
+// Have the scanner list a directory still showing "..."
+static void request_listing(int node, bool urgent) {
+    if (!mark_loading(node)) return;
+    scan_directory(++scan_jobs, item_path_of(node), false, urgent, tree_lists, listings_ready);
+}
+
+// Scroll horizontally so that the label of `node` is in view
+static void scroll_label_into_view(TreeView* tr, int node, bool scroll_left) {
+    const int indent_width = 16;  // TreeView's indent per level
+    int indent = tr->depth(node) * indent_width;
+    fl_font(tr->labelfont(), tr->labelsize());
+    int label_width = (int)fl_width(tr->label(node).c_str());
+
+    int item_x = indent;
+    int item_w = label_width + 40; // Add some padding for icon space
+
+    // Get current scroll position and tree viewport
+    int scroll_x = tr->hposition();
+    int tree_view_w = tr->w();
+
+    // Check if item extends beyond right edge of visible area
+    if (item_x + item_w > scroll_x + tree_view_w) {
+        // Scroll right to show the item with some padding
+        tr->hposition((item_x + item_w) - tree_view_w + 20);
+    }
+    // Check if item is too far left
+    else if (scroll_left && item_x < scroll_x) {
+        // Scroll left to show the item with some padding
+        tr->hposition(std::max(0, item_x - 20));
+    }
+}
+
+void tree_cb(Fl_Widget* w, void*) {
+    TreeView* tr = static_cast<TreeView*>(w);
+    int it = tr->callback_node();
+    if (it == TREE_NONE) return;
+
+    if (tr->callback_reason() == TREE_REASON_SELECTED) {
+        // Auto-scroll horizontally to make selected item visible
+        scroll_label_into_view(tr, it, true);
+
+        if (!is_dir_item(it) && !is_placeholder(it)) {
+            load_file(item_path_of(it).c_str());
         }
+    } else if (tr->callback_reason() == TREE_REASON_OPENED) {
+        // Auto-scroll horizontally to make expanded item visible
+        scroll_label_into_view(tr, it, false);
 
-        // Save expansion state after loading directory
-        save_tree_expansion_state();
-    } else if (tr->callback_reason() == FL_TREE_REASON_CLOSED) {
-        // Save expansion state when an item is collapsed
-        save_tree_expansion_state();
+        // Handle lazy loading when a directory is expanded
+        request_listing(it, true);
+
+        note_expansion(it, true);
+    } else if (tr->callback_reason() == TREE_REASON_CLOSED) {
+        note_expansion(it, false);
     }
 }
 
@@ -505,17 +869,33 @@ void tree_cb(Fl_Widget* w, void*) {
 // VSCode-like Features
 // ======================
 
-void show_tree_context_menu(int x, int y, Fl_Tree_Item* item) {
-    static Fl_Menu_Item context_menu[] = {
+// Entry marked by Copy or Cut for the next Paste
+static std::string clipboard_path;
+static bool clipboard_cut = false;
+
+static bool tree_clipboard_empty() {
+    return clipboard_path.empty();
+}
+
+// Menu and key callbacks carry a node as their user data
+static int node_of(void* data) {
+    return (int)(intptr_t)data;
+}
+
+void show_tree_context_menu(int x, int y, int node) {
+    void* item = (void*)(intptr_t)node;
+    Fl_Menu_Item context_menu[] = {
         {"New File", 0, tree_new_file_cb, item, 0},
-        {"New Folder", 0, tree_new_folder_cb, item, 0},
-        {0}, // separator
-        {"Rename", 0, tree_rename_item_cb, item, 0},
-        {"Delete", 0, tree_delete_item_cb, item, 0},
-        {0}, // separator
-        {"Copy Path", 0, tree_copy_path_cb, item, 0},
-        {0}, // separator
-        {"Refresh", 0, tree_refresh_cb, item, 0},
+        {"New Folder", 0, tree_new_folder_cb, item, FL_MENU_DIVIDER},
+        {"Rename", FL_F + 2, tree_rename_item_cb, item, 0},
+        {"Delete", FL_Delete, tree_delete_item_cb, item, FL_MENU_DIVIDER},
+        {"Duplicate", 0, tree_duplicate_item_cb, item, 0},
+        {"Copy", FL_CTRL + 'c', tree_copy_item_cb, item, 0},
+        {"Cut", FL_CTRL + 'x', tree_cut_item_cb, item, 0},
+        {"Paste", FL_CTRL + 'v', tree_paste_item_cb, item,
+         FL_MENU_DIVIDER | (tree_clipboard_empty() ? FL_MENU_INACTIVE : 0)},
+        {"Copy Path", 0, tree_copy_path_cb, item, FL_MENU_DIVIDER},
+        {"Refresh", FL_F + 5, tree_refresh_cb, item, 0},
         {"Collapse All", 0, tree_collapse_all_cb, item, 0},
         {"Expand All", 0, tree_expand_all_cb, item, 0},
         {0}
@@ -527,246 +907,212 @@ void show_tree_context_menu(int x, int y, Fl_Tree_Item* item) {
     }
 }
 
+// Directory new entries go into: the item itself, or the folder of a file
+static int target_dir_item(int item) {
+    if (is_dir_item(item)) return item;
+    return file_tree->parent(item);
+}
+
 void tree_new_file_cb(Fl_Widget* w, void* data) {
-    Fl_Tree_Item* item = static_cast<Fl_Tree_Item*>(data);
-    if (!item) return;
+    int item = node_of(data);
+    if (item == TREE_NONE) return;
 
     const char* filename = fl_input("Enter filename:", "");
     if (!filename || !*filename) return;
 
-    // Get directory path
-    char item_path[FL_PATH_MAX];
-    if (item->has_children() || item == file_tree->root()) {
-        // Directory selected
-        if (item == file_tree->root()) {
-            strcpy(item_path, "");
-        } else {
-            file_tree->item_pathname(item_path, sizeof(item_path), item);
-            const char* root_lbl = file_tree->root()->label();
-            if (root_lbl && *root_lbl) {
-                size_t len = strlen(root_lbl);
-                if (!strncmp(item_path, root_lbl, len) && item_path[len] == '/') {
-                    memmove(item_path, item_path + len + 1, strlen(item_path + len + 1) + 1);
-                }
-            }
-        }
-    } else {
-        // File selected, get parent directory
-        if (item->parent() && item->parent() != file_tree->root()) {
-            file_tree->item_pathname(item_path, sizeof(item_path), item->parent());
-            const char* root_lbl = file_tree->root()->label();
-            if (root_lbl && *root_lbl) {
-                size_t len = strlen(root_lbl);
-                if (!strncmp(item_path, root_lbl, len) && item_path[len] == '/') {
-                    memmove(item_path, item_path + len + 1, strlen(item_path + len + 1) + 1);
-                }
-            }
-        } else {
-            strcpy(item_path, "");
-        }
-    }
-
-    char full_path[FL_PATH_MAX];
-    if (strlen(item_path) > 0) {
-        snprintf(full_path, sizeof(full_path), "%s/%s/%s", current_folder, item_path, filename);
-    } else {
-        snprintf(full_path, sizeof(full_path), "%s/%s", current_folder, filename);
-    }
+    std::string full_path = join_path(item_path_of(target_dir_item(item)), filename);
 
     // Create file
-    FILE* fp = fopen(full_path, "w");
+    FILE* fp = fopen(full_path.c_str(), "w");
     if (fp) {
         fclose(fp);
-        load_folder(current_folder); // Refresh tree
+        size_t slash = full_path.rfind('/');
+        if (tree_add_entry(full_path.substr(0, slash), full_path.substr(slash + 1))) file_tree->redraw();
     } else {
         fl_alert("Could not create file: %s", filename);
     }
 }
 
 void tree_new_folder_cb(Fl_Widget* w, void* data) {
-    Fl_Tree_Item* item = static_cast<Fl_Tree_Item*>(data);
-    if (!item) return;
+    int item = node_of(data);
+    if (item == TREE_NONE) return;
 
     const char* foldername = fl_input("Enter folder name:", "");
     if (!foldername || !*foldername) return;
 
-    // Get directory path
-    char item_path[FL_PATH_MAX];
-    if (item->has_children() || item == file_tree->root()) {
-        // Directory selected
-        if (item == file_tree->root()) {
-            strcpy(item_path, "");
-        } else {
-            file_tree->item_pathname(item_path, sizeof(item_path), item);
-            const char* root_lbl = file_tree->root()->label();
-            if (root_lbl && *root_lbl) {
-                size_t len = strlen(root_lbl);
-                if (!strncmp(item_path, root_lbl, len) && item_path[len] == '/') {
-                    memmove(item_path, item_path + len + 1, strlen(item_path + len + 1) + 1);
-                }
-            }
-        }
-    } else {
-        // File selected, get parent directory
-        if (item->parent() && item->parent() != file_tree->root()) {
-            file_tree->item_pathname(item_path, sizeof(item_path), item->parent());
-            const char* root_lbl = file_tree->root()->label();
-            if (root_lbl && *root_lbl) {
-                size_t len = strlen(root_lbl);
-                if (!strncmp(item_path, root_lbl, len) && item_path[len] == '/') {
-                    memmove(item_path, item_path + len + 1, strlen(item_path + len + 1) + 1);
-                }
-            }
-        } else {
-            strcpy(item_path, "");
-        }
-    }
-
-    char full_path[FL_PATH_MAX];
-    if (strlen(item_path) > 0) {
-        snprintf(full_path, sizeof(full_path), "%s/%s/%s", current_folder, item_path, foldername);
-    } else {
-        snprintf(full_path, sizeof(full_path), "%s/%s", current_folder, foldername);
-    }
+    std::string full_path = join_path(item_path_of(target_dir_item(item)), foldername);
 
     // Create directory
-    if (mkdir(full_path, 0755) == 0) {
-        load_folder(current_folder); // Refresh tree
+    if (mkdir(full_path.c_str(), 0755) == 0) {
+        size_t slash = full_path.rfind('/');
+        if (tree_add_entry(full_path.substr(0, slash), full_path.substr(slash + 1))) file_tree->redraw();
     } else {
         fl_alert("Could not create folder: %s", foldername);
     }
 }
 
 void tree_rename_item_cb(Fl_Widget* w, void* data) {
-    Fl_Tree_Item* item = static_cast<Fl_Tree_Item*>(data);
-    if (!item || item == file_tree->root()) return;
+    int item = node_of(data);
+    if (item == TREE_NONE || item == TREE_ROOT) return;
 
     // Get current name (without icon)
-    const char* current_label = item->label();
-    const char* current_name = current_label;
-    if (current_label && strlen(current_label) > 2 && current_label[1] == ' ') {
-        current_name = current_label + 2; // Skip emoji and space
-    }
-
-    const char* new_name = fl_input("Rename to:", current_name);
-    if (!new_name || !*new_name || strcmp(new_name, current_name) == 0) return;
-
-    // Get old path
-    char old_rel_path[FL_PATH_MAX];
-    file_tree->item_pathname(old_rel_path, sizeof(old_rel_path), item);
-    const char* root_lbl = file_tree->root()->label();
-    if (root_lbl && *root_lbl) {
-        size_t len = strlen(root_lbl);
-        if (!strncmp(old_rel_path, root_lbl, len) && old_rel_path[len] == '/') {
-            memmove(old_rel_path, old_rel_path + len + 1, strlen(old_rel_path + len + 1) + 1);
-        }
-    }
+    std::string current_name = item_name(item);
 
-    // Build full paths
-    char old_full_path[FL_PATH_MAX];
-    snprintf(old_full_path, sizeof(old_full_path), "%s/%s", current_folder, old_rel_path);
+    const char* new_name = fl_input("Rename to:", current_name.c_str());
+    if (!new_name || !*new_name || current_name == new_name) return;
 
-    // Get parent directory
-    char new_full_path[FL_PATH_MAX];
-    if (item->parent() && item->parent() != file_tree->root()) {
-        char parent_rel_path[FL_PATH_MAX];
-        file_tree->item_pathname(parent_rel_path, sizeof(parent_rel_path), item->parent());
-        if (root_lbl && *root_lbl) {
-            size_t len = strlen(root_lbl);
-            if (!strncmp(parent_rel_path, root_lbl, len) && parent_rel_path[len] == '/') {
-                memmove(parent_rel_path, parent_rel_path + len + 1, strlen(parent_rel_path + len + 1) + 1);
-            }
-        }
-        snprintf(new_full_path, sizeof(new_full_path), "%s/%s/%s", current_folder, parent_rel_path, new_name);
-    } else {
-        snprintf(new_full_path, sizeof(new_full_path), "%s/%s", current_folder, new_name);
-    }
+    std::string old_full_path = item_path_of(item);
+    std::string parent_path = item_path_of(file_tree->parent(item));
+    std::string new_full_path = join_path(parent_path, new_name);
 
     // Rename
-    if (rename(old_full_path, new_full_path) == 0) {
-        load_folder(current_folder); // Refresh tree
+    if (rename(old_full_path.c_str(), new_full_path.c_str()) == 0) {
+        if (tree_move_entry(old_full_path, parent_path, new_name)) file_tree->redraw();
+        if (tab_bar) tab_bar->move_tab_path(old_full_path, new_full_path);
     } else {
-        fl_alert("Could not rename: %s", current_name);
+        fl_alert("Could not rename: %s", current_name.c_str());
     }
 }
 
+static void tree_remove_progress(const std::string& path, size_t removed) {
+    if (!status_left) return;
+    char msg[FL_PATH_MAX + 64];
+    snprintf(msg, sizeof(msg), "Deleting %s... %zu items (Esc in the tree to stop)",
+             fl_filename_name(path.c_str()), removed);
+    status_left->copy_label(msg);
+    status_left->redraw();
+}
+
+static void tree_remove_done(const std::string& path, const std::string& error, bool cancelled) {
+    update_status();
+    if (error.empty() && !cancelled) return;
+    // Show again whatever is left of it
+    int parent = item_for_path(path.substr(0, path.rfind('/')));
+    if (parent != TREE_NONE) refresh_tree_item(parent);
+    if (!error.empty()) fl_alert("Could not delete %s\n%s", fl_filename_name(path.c_str()), error.c_str());
+}
+
 void tree_delete_item_cb(Fl_Widget* w, void* data) {
-    Fl_Tree_Item* item = static_cast<Fl_Tree_Item*>(data);
-    if (!item || item == file_tree->root()) return;
+    int item = node_of(data);
+    if (item == TREE_NONE || item == TREE_ROOT) return;
 
     // Get current name (without icon)
-    const char* current_label = item->label();
-    const char* current_name = current_label;
-    if (current_label && strlen(current_label) > 2 && current_label[1] == ' ') {
-        current_name = current_label + 2; // Skip emoji and space
-    }
-
-    if (fl_choice("Delete %s?", "Cancel", "Delete", 0, current_name) != 1) return;
-
-    // Get path
-    char rel_path[FL_PATH_MAX];
-    file_tree->item_pathname(rel_path, sizeof(rel_path), item);
-    const char* root_lbl = file_tree->root()->label();
-    if (root_lbl && *root_lbl) {
-        size_t len = strlen(root_lbl);
-        if (!strncmp(rel_path, root_lbl, len) && rel_path[len] == '/') {
-            memmove(rel_path, rel_path + len + 1, strlen(rel_path + len + 1) + 1);
-        }
+    std::string current_name = item_name(item);
+
+    if (fl_choice("Delete %s?", "Cancel", "Delete", 0, current_name.c_str()) != 1) return;
+
+    // Gone from the tree at once; the files go on a worker, and the parent
+    // is listed again if any of them stay
+    std::string full_path = item_path_of(item);
+    if (tree_remove_entry(full_path)) file_tree->redraw();
+    start_file_remove(full_path, tree_remove_done, tree_remove_progress);
+}
+
+// `name` if `dir` has no such entry, else "name copy.ext", "name copy 2.ext", ...
+static std::string free_copy_name(const std::string& dir, const std::string& name) {
+    struct stat st;
+    if (lstat(join_path(dir, name).c_str(), &st) != 0) return name;
+    size_t dot = name.rfind('.');
+    if (dot == 0 || dot == std::string::npos) dot = name.size();
+    std::string stem = name.substr(0, dot), ext = name.substr(dot);
+    for (int n = 1;; ++n) {
+        std::string candidate = stem + (n == 1 ? " copy" : " copy " + std::to_string(n)) + ext;
+        if (lstat(join_path(dir, candidate).c_str(), &st) != 0) return candidate;
     }
+}
+
+static void tree_copy_progress(const std::string& from, size_t copied, size_t total) {
+    if (!status_left) return;
+    char msg[FL_PATH_MAX + 64];
+    const char* name = fl_filename_name(from.c_str());
+    if (total)
+        snprintf(msg, sizeof(msg), "Copying %s... %d%%", name, (int)(copied * 100 / total));
+    else
+        snprintf(msg, sizeof(msg), "Copying %s... %.1f MB", name, copied / (1024.0 * 1024.0));
+    status_left->copy_label(msg);
+    status_left->redraw();
+}
+
+static void tree_copy_done(const std::string& from, const std::string& to, bool move,
+                           const std::string& error, bool cancelled) {
+    update_status();
+    size_t slash = to.rfind('/');
+    struct stat st;
+    // A failed copy leaves no target, so one there now is complete; only
+    // deleting the source of a move across file systems may have failed
+    bool moved = move && lstat(to.c_str(), &st) == 0;
+    if (moved) {
+        if (tree_move_entry(from, to.substr(0, slash), to.substr(slash + 1))) file_tree->redraw();
+        if (tab_bar) tab_bar->move_tab_path(from, to);
+        if (lstat(from.c_str(), &st) == 0) tree_add_entry(from.substr(0, from.rfind('/')), fl_filename_name(from.c_str()));
+    } else if (!move && error.empty() && !cancelled) {
+        if (tree_add_entry(to.substr(0, slash), to.substr(slash + 1))) file_tree->redraw();
+    }
+    if (!error.empty())
+        fl_alert("Could not %s %s\n%s", move ? "move" : "copy", fl_filename_name(from.c_str()), error.c_str());
+}
 
-    char full_path[FL_PATH_MAX];
-    snprintf(full_path, sizeof(full_path), "%s/%s", current_folder, rel_path);
+void tree_duplicate_item_cb(Fl_Widget* w, void* data) {
+    int item = node_of(data);
+    if (item == TREE_NONE || item == TREE_ROOT) return;
+    std::string from = item_path_of(item);
+    std::string dir = item_path_of(file_tree->parent(item));
+    start_file_copy(from, join_path(dir, free_copy_name(dir, item_name(item))), false,
+                    tree_copy_done, tree_copy_progress);
+}
+
+void tree_copy_item_cb(Fl_Widget* w, void* data) {
+    int item = node_of(data);
+    if (item == TREE_NONE || item == TREE_ROOT) return;
+    clipboard_path = item_path_of(item);
+    clipboard_cut = false;
+}
 
-    // Delete
-    if (item->has_children()) {
-        // Directory - use rmdir or system call
-        char cmd[FL_PATH_MAX + 10];
-        snprintf(cmd, sizeof(cmd), "rm -rf \"%s\"", full_path);
-        if (system(cmd) == 0) {
-            load_folder(current_folder); // Refresh tree
-        } else {
-            fl_alert("Could not delete folder: %s", current_name);
+void tree_cut_item_cb(Fl_Widget* w, void* data) {
+    tree_copy_item_cb(w, data);
+    clipboard_cut = !clipboard_path.empty();
+}
+
+void tree_paste_item_cb(Fl_Widget* w, void* data) {
+    int item = node_of(data);
+    if (item == TREE_NONE || clipboard_path.empty()) return;
+    std::string from = clipboard_path;
+    std::string dir = item_path_of(target_dir_item(item));
+    std::string name = fl_filename_name(from.c_str());
+    if (dir == from || !dir.compare(0, from.size() + 1, from + "/")) {
+        fl_alert("Cannot put %s inside itself", name.c_str());
+        return;
+    }
+    if (clipboard_cut) {
+        std::string to = join_path(dir, name);
+        if (to == from) return;
+        struct stat st;
+        if (lstat(to.c_str(), &st) == 0) {
+            fl_alert("%s already exists in the folder", name.c_str());
+            return;
         }
+        clipboard_path.clear();  // it will not be there to paste again
+        start_file_copy(from, to, true, tree_copy_done, tree_copy_progress);
     } else {
-        // File
-        if (unlink(full_path) == 0) {
-            load_folder(current_folder); // Refresh tree
-        } else {
-            fl_alert("Could not delete file: %s", current_name);
-        }
+        start_file_copy(from, join_path(dir, free_copy_name(dir, name)), false,
+                        tree_copy_done, tree_copy_progress);
     }
 }
 
 void tree_copy_path_cb(Fl_Widget* w, void* data) {
-    Fl_Tree_Item* item = static_cast<Fl_Tree_Item*>(data);
-    if (!item) return;
+    int item = node_of(data);
+    if (item == TREE_NONE) return;
 
-    // Get path
-    char rel_path[FL_PATH_MAX];
-    if (item == file_tree->root()) {
-        strcpy(rel_path, current_folder);
-    } else {
-        file_tree->item_pathname(rel_path, sizeof(rel_path), item);
-        const char* root_lbl = file_tree->root()->label();
-        if (root_lbl && *root_lbl) {
-            size_t len = strlen(root_lbl);
-            if (!strncmp(rel_path, root_lbl, len) && rel_path[len] == '/') {
-                memmove(rel_path, rel_path + len + 1, strlen(rel_path + len + 1) + 1);
-            }
-        }
-        char full_path[FL_PATH_MAX];
-        snprintf(full_path, sizeof(full_path), "%s/%s", current_folder, rel_path);
-        strcpy(rel_path, full_path);
-    }
+    std::string path = item_path_of(item);
 
     // Copy to clipboard (simplified)
-    Fl::copy(rel_path, strlen(rel_path), 1);
+    Fl::copy(path.c_str(), (int)path.size(), 1);
     // Note: Real clipboard support would require platform-specific code
 }
 
 void tree_refresh_cb(Fl_Widget* w, void* data) {
-    Fl_Tree_Item* item = static_cast<Fl_Tree_Item*>(data);
-    if (item == file_tree->root()) {
+    int item = node_of(data);
+    if (item == TREE_ROOT) {
         load_folder(current_folder);
     } else {
         refresh_tree_item(item);
@@ -774,40 +1120,69 @@ void tree_refresh_cb(Fl_Widget* w, void* data) {
 }
 
 void tree_collapse_all_cb(Fl_Widget* w, void* data) {
-    Fl_Tree_Item* root = file_tree->root();
-    if (root) {
-        for (int i = 0; i < root->children(); ++i) {
-            Fl_Tree_Item* child = root->child(i);
-            if (child->has_children()) child->close();
-        }
+    for (int i = 0; i < file_tree->children(TREE_ROOT); ++i) note_expansion(file_tree->child(TREE_ROOT, i), false);
+    collapse_first_level();
+}
+
+// Directories whose listing was never asked for, below `node`
+static void collect_unlisted(int node, std::vector<int>& out) {
+    for (int i = 0; i < file_tree->children(node); ++i) {
+        int child = file_tree->child(node, i);
+        if (!is_dir_item(child)) continue;
+        int placeholder = placeholder_of(child);
+        if (placeholder == TREE_NONE) collect_unlisted(child, out);
+        else if (file_tree->label(placeholder) == "...") out.push_back(child);
     }
 }
 
 void tree_expand_all_cb(Fl_Widget* w, void* data) {
-    Fl_Tree_Item* root = file_tree->root();
-    if (root) {
-        for (int i = 0; i < root->children(); ++i) {
-            Fl_Tree_Item* child = root->child(i);
-            if (child->has_children()) child->open();
-        }
+    // Everything loaded opens at once, however large: the view only
+    // recounts rows. Directories not read yet are read together on the
+    // pool, with those below them, and open as their listings come in.
+    file_tree->open_subtree(TREE_ROOT);
+    std::vector<int> unlisted;
+    collect_unlisted(TREE_ROOT, unlisted);
+    std::vector<std::string> dirs;
+    for (int node : unlisted) {
+        if (mark_loading(node)) dirs.push_back(item_path_of(node));
     }
+    expand_all_job = ++scan_jobs;
+    prefetch_directories(expand_all_job, std::move(dirs), EXPAND_ALL_DEPTH, EXPAND_ALL_ENTRIES,
+                         tree_lists, listings_ready);
+    note_open_subtree(TREE_ROOT, "");
 }
 
 int tree_handle_key(int key) {
-    Fl_Tree_Item* selected = file_tree->item_clicked();
-    if (!selected) return 0;
+    if (key == FL_Escape && (file_remove_pending() || file_copy_pending())) {
+        cancel_file_removes();
+        cancel_file_copies();
+        return 1;
+    }
+
+    int selected = file_tree->selected();
+    if (selected == TREE_NONE) return 0;
+    void* data = (void*)(intptr_t)selected;
+
+    if (Fl::event_state() & FL_CTRL) {
+        switch (key) {
+            case 'c': tree_copy_item_cb(nullptr, data); return 1;
+            case 'x': tree_cut_item_cb(nullptr, data); return 1;
+            case 'v': tree_paste_item_cb(nullptr, data); return 1;
+            default: return 0;
+        }
+    }
 
     switch (key) {
         case FL_F + 2: // F2 - Rename
-            tree_rename_item_cb(nullptr, selected);
+            tree_rename_item_cb(nullptr, data);
             return 1;
 
         case FL_Delete: // Delete key
-            tree_delete_item_cb(nullptr, selected);
+            tree_delete_item_cb(nullptr, data);
             return 1;
 
         case FL_F + 5: // F5 - Refresh
-            tree_refresh_cb(nullptr, selected);
+            tree_refresh_cb(nullptr, data);
             return 1;
 
         default:
@@ -819,265 +1194,506 @@ int tree_handle_key(int key) {
 // Tree Expansion State Persistence
 // ======================
 
-const char* tree_expansion_state_path() {
-    static char path[FL_PATH_MAX];
-    const char* home = getenv("HOME");
-    if (home) {
-        snprintf(path, sizeof(path), "%s/.flick_tree_expansion_%s", home, fl_filename_name(current_folder));
-    } else {
-        snprintf(path, sizeof(path), ".flick_tree_expansion_%s", fl_filename_name(current_folder));
-    }
-    return path;
+static const double EXPANSION_SAVE_DELAY = 2.0;
+
+static void save_expansion_timeout(void*) {
+    save_tree_expansion_state();
 }
 
-static void collect_expanded_paths(Fl_Tree_Item* item, const std::string& parent_path, std::vector<std::string>& expanded_paths) {
-    if (!item) return;
+static void note_expanded_path(const std::string& rel, bool open) {
+    bool changed = open ? expanded_dirs.insert(rel).second : expanded_dirs.erase(rel) > 0;
+    if (!changed) return;
+    expansion_dirty = true;
+    Fl::remove_timeout(save_expansion_timeout);
+    Fl::add_timeout(EXPANSION_SAVE_DELAY, save_expansion_timeout);
+}
 
-    // Build the current item's path
-    std::string current_path;
-    if (parent_path.empty()) {
-        // Root level - just use the item label (without icon)
-        const char* label = item->label();
-        if (label) {
-            const char* clean_label = label;
-            // Skip icon if present
-            if (strlen(label) > 2 && label[1] == ' ') {
-                clean_label = label + 2;
-            }
-            current_path = clean_label;
-        }
-    } else {
-        // Child item - build path from parent
-        const char* label = item->label();
-        if (label) {
-            const char* clean_label = label;
-            // Skip icon if present
-            if (strlen(label) > 2 && label[1] == ' ') {
-                clean_label = label + 2;
-            }
-            current_path = parent_path + "/" + clean_label;
-        }
-    }
+static void note_expansion(int node, bool open) {
+    if (node == TREE_NONE || node == TREE_ROOT) return;
+    note_expanded_path(item_rel_path(node), open);
+}
 
-    // If this item is expanded and has children, save its path
-    if (item->is_open() && item->has_children()) {
-        expanded_paths.push_back(current_path);
+static void note_open_subtree(int node, const std::string& rel) {
+    for (int i = 0; i < file_tree->children(node); ++i) {
+        int child = file_tree->child(node, i);
+        if (!is_dir_item(child) || !file_tree->is_open(child)) continue;
+        std::string child_rel = join_path(rel, item_name(child));
+        note_expanded_path(child_rel, true);
+        note_open_subtree(child, child_rel);
     }
+}
 
-    // Recursively collect from children
-    for (int i = 0; i < item->children(); ++i) {
-        Fl_Tree_Item* child = item->child(i);
-        if (child) {
-            collect_expanded_paths(child, current_path, expanded_paths);
-        }
+// Restoring the saved state lists every directory on the way to each saved
+// one on the UI thread, so at most this many are written; after Expand All
+// the shallowest open directories are kept
+static const size_t EXPANSION_SAVE_MAX = 512;
+
+static std::vector<std::string> expansion_to_save() {
+    std::vector<std::string> open(expanded_dirs.begin(), expanded_dirs.end());
+    auto depth = [](const std::string& rel) { return std::count(rel.begin(), rel.end(), '/'); };
+    std::stable_sort(open.begin(), open.end(),
+                     [&](const std::string& a, const std::string& b) { return depth(a) < depth(b); });
+    std::vector<std::string> kept;
+    std::unordered_set<std::string> listed;  // what restoring `kept` lists
+    for (const std::string& rel : open) {
+        std::vector<std::string> prefixes = path_prefixes({rel});
+        size_t added = 0;
+        for (const std::string& prefix : prefixes) added += !listed.count(prefix);
+        if (listed.size() + added > EXPANSION_SAVE_MAX) continue;
+        listed.insert(prefixes.begin(), prefixes.end());
+        kept.push_back(rel);
     }
+    return kept;
 }
 
-void save_tree_expansion_state() {
-    if (!file_tree || !file_tree->root()) return;
+// One file per project, named by a hash of its absolute path
+const char* tree_expansion_state_path() {
+    static char path[FL_PATH_MAX];
+    const char* home = getenv("HOME");
+    snprintf(path, sizeof(path), "%s/.flick/expansion/%s", home ? home : ".", hashed_name(current_folder).c_str());
+    return path;
+}
 
-    std::vector<std::string> expanded_paths;
+// Where earlier versions kept it, by the folder's name alone
+static std::string legacy_expansion_state_path() {
+    const char* home = getenv("HOME");
+    std::string name = std::string(".flick_tree_expansion_") + fl_filename_name(current_folder);
+    return home ? std::string(home) + "/" + name : name;
+}
 
-    // Collect expanded paths from all root children
-    Fl_Tree_Item* root = file_tree->root();
-    for (int i = 0; i < root->children(); ++i) {
-        Fl_Tree_Item* child = root->child(i);
-        if (child) {
-            collect_expanded_paths(child, "", expanded_paths);
-        }
-    }
+void save_tree_expansion_state() {
+    Fl::remove_timeout(save_expansion_timeout);
+    if (!expansion_dirty || !current_folder[0]) return;
+    expansion_dirty = false;
 
-    // Save to file
+    std::string dir = tree_expansion_state_path();
+    dir.erase(dir.rfind('/'));
+    mkdir(dir.substr(0, dir.rfind('/')).c_str(), 0700);
+    mkdir(dir.c_str(), 0700);
+
+    // The folder first, so a hash collision is not taken for this project
     FILE* fp = fopen(tree_expansion_state_path(), "w");
     if (fp) {
-        for (const std::string& path : expanded_paths) {
+        fprintf(fp, "%s\n", current_folder);
+        for (const std::string& path : expansion_to_save()) {
             fprintf(fp, "%s\n", path.c_str());
         }
         fclose(fp);
     }
 }
 
-static void expand_path_in_tree(const std::string& target_path) {
-    if (!file_tree || target_path.empty()) return;
-
-    // Split the path into components
-    std::vector<std::string> path_components;
-    std::string current_component;
-    for (char c : target_path) {
-        if (c == '/') {
-            if (!current_component.empty()) {
-                path_components.push_back(current_component);
-                current_component.clear();
-            }
-        } else {
-            current_component += c;
-        }
-    }
-    if (!current_component.empty()) {
-        path_components.push_back(current_component);
+// Listings read ahead for list_now, by relative path
+static std::unordered_map<std::string, DirListing> read_ahead;
+static const size_t READ_AHEAD_MAX = 4096;
+
+// Read those of `rels` not listed yet at once on the scanner's pool, so a
+// run of list_now calls does not wait on the disk one directory at a time.
+// A directory not in the tree yet is read too: its parent may be listed first.
+static void read_ahead_dirs(const std::vector<std::string>& rels) {
+    std::vector<std::string> wanted, dirs;
+    for (const std::string& rel : rels) {
+        int item = lookup_item(rel);
+        if ((item != TREE_NONE && placeholder_of(item) == TREE_NONE) || read_ahead.count(rel)) continue;
+        wanted.push_back(rel);
+        dirs.push_back(join_path(current_folder, rel));
+        if (dirs.size() == READ_AHEAD_MAX) break;
     }
+    if (dirs.size() < 2) return;  // nothing to overlap
 
-    // Navigate through the tree and expand items
-    Fl_Tree_Item* current_item = file_tree->root();
-    std::string built_path;
+    std::vector<DirListing> listings;
+    read_directories(dirs, tree_lists, listings);
+    for (size_t i = 0; i < listings.size(); ++i) {
+        if (listings[i].mtime >= 0) read_ahead[wanted[i]] = std::move(listings[i]);
+    }
+}
 
-    for (const std::string& component : path_components) {
-        if (!built_path.empty()) built_path += "/";
-        built_path += component;
+// List a directory item still showing its placeholder, right away
+static void list_now(int item, const std::string& rel) {
+    if (placeholder_of(item) == TREE_NONE) return;
+    auto found = read_ahead.find(rel);
+    if (found == read_ahead.end()) {
+        for (int placeholder; (placeholder = placeholder_of(item)) != TREE_NONE;) file_tree->remove(placeholder);
+        load_dir_recursive(join_path(current_folder, rel).c_str(), item, true);
+        return;
+    }
+    for (const ScanEntry& entry : found->second.entries) add_listed_entry(item, rel, entry);
+    for (int placeholder; (placeholder = placeholder_of(item)) != TREE_NONE;) file_tree->remove(placeholder);
+    dir_mtimes[rel] = found->second.mtime;
+    watch_listed_dir(found->second.dir);
+    read_ahead.erase(found);
+}
 
-        // Find the child item with this component name
-        Fl_Tree_Item* found_child = nullptr;
-        for (int i = 0; current_item && i < current_item->children(); ++i) {
-            Fl_Tree_Item* child = current_item->child(i);
-            if (child && child->label()) {
-                const char* label = child->label();
-                // Skip icon if present
-                if (strlen(label) > 2 && label[1] == ' ') {
-                    label = label + 2;
-                }
-                if (component == label) {
-                    found_child = child;
-                    break;
-                }
-            }
+// Every directory on the way to each of `rels`, parents first
+static std::vector<std::string> path_prefixes(const std::vector<std::string>& rels) {
+    std::vector<std::string> prefixes;
+    std::unordered_set<std::string> seen;
+    for (const std::string& rel : rels) {
+        for (size_t end = rel.find('/'); ; end = rel.find('/', end + 1)) {
+            std::string prefix = rel.substr(0, end);
+            if (seen.insert(prefix).second) prefixes.push_back(prefix);
+            if (end == std::string::npos) break;
         }
+    }
+    return prefixes;
+}
 
-        if (found_child) {
-            current_item = found_child;
-            // Expand this item
-            current_item->open();
-
-            // If this item has placeholder children, trigger lazy loading
-            if (current_item->has_children()) {
-                bool has_placeholder = false;
-                for (int i = 0; i < current_item->children(); ++i) {
-                    Fl_Tree_Item* child = current_item->child(i);
-                    if (child && child->label()) {
-                        const char* label = child->label();
-                        if (strstr(label, "...") || strstr(label, "Loading...")) {
-                            has_placeholder = true;
-                            break;
-                        }
-                    }
-                }
+// Open every directory on the way to `rel`, listing them as needed; returns
+// the deepest node reached
+static int open_path_in_tree(const std::string& rel, bool open_last) {
+    size_t slash = rel.rfind('/');
+    if (open_last) read_ahead_dirs(path_prefixes({rel}));
+    else if (slash != std::string::npos) read_ahead_dirs(path_prefixes({rel.substr(0, slash)}));
+    int item = TREE_ROOT;
+    size_t start = 0;
+    while (start < rel.size()) {
+        size_t end = rel.find('/', start);
+        if (end == std::string::npos) end = rel.size();
+        std::string prefix = rel.substr(0, end);
+        start = end + 1;
+
+        int child = lookup_item(prefix);
+        if (child == TREE_NONE) break;
+        item = child;
+        if (!is_dir_item(item) || (end == rel.size() && !open_last)) break;
+        file_tree->open(item);
+        note_expanded_path(prefix, true);
+        list_now(item, prefix);
+    }
+    read_ahead.clear();
+    return item;
+}
 
-                if (has_placeholder) {
-                    // Remove placeholders and load directory contents
-                    std::vector<Fl_Tree_Item*> placeholders_to_remove;
-                    for (int i = 0; i < current_item->children(); ++i) {
-                        Fl_Tree_Item* child = current_item->child(i);
-                        if (child && child->label()) {
-                            const char* label = child->label();
-                            if (strstr(label, "...") || strstr(label, "Loading...")) {
-                                placeholders_to_remove.push_back(child);
-                            }
-                        }
-                    }
-
-                    // Remove placeholders
-                    for (int i = placeholders_to_remove.size() - 1; i >= 0; --i) {
-                        file_tree->remove(placeholders_to_remove[i]);
-                    }
-
-                    // Build full filesystem path for this item
-                    std::string full_path = std::string(current_folder) + "/" + built_path;
-
-                    // Load directory contents
-                    load_dir_recursive(full_path.c_str(), current_item, true);
-                }
-            }
-        } else {
-            // Path component not found - might need lazy loading
-            // Check if current_item has placeholder children that need loading
-            if (current_item && current_item->has_children()) {
-                bool has_placeholder = false;
-                for (int i = 0; i < current_item->children(); ++i) {
-                    Fl_Tree_Item* child = current_item->child(i);
-                    if (child && child->label()) {
-                        const char* label = child->label();
-                        if (strstr(label, "...") || strstr(label, "Loading...")) {
-                            has_placeholder = true;
-                            break;
-                        }
-                    }
-                }
+// Reopen the saved directory `rel`. Directories on the way are listed but
+// stay closed unless they were saved open too.
+static void restore_expanded_path(const std::string& rel) {
+    size_t start = 0;
+    while (start < rel.size()) {
+        size_t end = rel.find('/', start);
+        if (end == std::string::npos) end = rel.size();
+        std::string prefix = rel.substr(0, end);
+        start = end + 1;
+
+        int item = lookup_item(prefix);
+        if (item == TREE_NONE || !is_dir_item(item)) return;
+        if (expanded_dirs.count(prefix)) file_tree->open(item);
+        list_now(item, prefix);
+    }
+}
 
-                if (has_placeholder) {
-                    // Remove placeholders and load directory contents
-                    std::vector<Fl_Tree_Item*> placeholders_to_remove;
-                    for (int i = 0; i < current_item->children(); ++i) {
-                        Fl_Tree_Item* child = current_item->child(i);
-                        if (child && child->label()) {
-                            const char* label = child->label();
-                            if (strstr(label, "...") || strstr(label, "Loading...")) {
-                                placeholders_to_remove.push_back(child);
-                            }
-                        }
-                    }
-
-                    // Remove placeholders
-                    for (int i = placeholders_to_remove.size() - 1; i >= 0; --i) {
-                        file_tree->remove(placeholders_to_remove[i]);
-                    }
-
-                    // Build full filesystem path for current item
-                    std::string parent_path;
-                    if (built_path.find('/') != std::string::npos) {
-                        parent_path = built_path.substr(0, built_path.find_last_of('/'));
-                    }
-                    std::string full_path = parent_path.empty() ? current_folder : std::string(current_folder) + "/" + parent_path;
-
-                    // Load directory contents
-                    load_dir_recursive(full_path.c_str(), current_item, true);
-
-                    // Try to find the child again after loading
-                    for (int i = 0; current_item && i < current_item->children(); ++i) {
-                        Fl_Tree_Item* child = current_item->child(i);
-                        if (child && child->label()) {
-                            const char* label = child->label();
-                            // Skip icon if present
-                            if (strlen(label) > 2 && label[1] == ' ') {
-                                label = label + 2;
-                            }
-                            if (component == label) {
-                                found_child = child;
-                                current_item = found_child;
-                                current_item->open();
-                                break;
-                            }
-                        }
-                    }
-                }
-            }
+bool reveal_in_tree(const char* path) {
+    std::string rel;
+    if (!file_tree || !path || !relative_path(path, rel) || rel.empty()) return false;
 
-            // If still not found after lazy loading, stop here
-            if (!found_child) {
-                break;
-            }
-        }
-    }
+    int item = open_path_in_tree(rel, false);
+    if (item != lookup_item(rel)) return false;  // not listed, e.g. filtered out
+
+    file_tree->select(item);
+    file_tree->show_node(item);
+    file_tree->redraw();
+    return true;
 }
 
 void load_tree_expansion_state() {
+    char line[FL_PATH_MAX] = "";
+    bool legacy = false;
     FILE* fp = fopen(tree_expansion_state_path(), "r");
-    if (!fp) return;
+    if (fp) {
+        if (!fgets(line, sizeof(line), fp)) {
+            fclose(fp);
+            return;
+        }
+        size_t len = strlen(line);
+        if (len > 0 && line[len-1] == '\n') line[len-1] = '\0';
+        if (strcmp(line, current_folder) != 0) {
+            fclose(fp);
+            return;
+        }
+    } else {
+        fp = fopen(legacy_expansion_state_path().c_str(), "r");
+        if (!fp) return;
+        legacy = true;
+    }
 
-    char line[FL_PATH_MAX];
     while (fgets(line, sizeof(line), fp)) {
         // Remove trailing newline
         size_t len = strlen(line);
         if (len > 0 && line[len-1] == '\n') {
             line[len-1] = '\0';
         }
-
-        // Expand this path in the tree
-        expand_path_in_tree(std::string(line));
+        if (line[0]) expanded_dirs.insert(line);
     }
 
     fclose(fp);
 
+    // Files written before the bound may hold more than it
+    std::vector<std::string> saved = expansion_to_save();
+    expanded_dirs = std::set<std::string>(saved.begin(), saved.end());
+    // Parents sort before their children
+    saved.assign(expanded_dirs.begin(), expanded_dirs.end());
+    read_ahead_dirs(path_prefixes(saved));
+    for (const std::string& rel : saved) restore_expanded_path(rel);
+    read_ahead.clear();
+    if (legacy) {
+        // Move it to the new place
+        expansion_dirty = true;
+        save_tree_expansion_state();
+    }
+
     // Redraw the tree to show the expanded state
     if (file_tree) {
         file_tree->redraw();
     }
-}
\ No newline at end of file
+}
+
+// ======================
+// Tree Filter
+// ======================
+
+// Typing in the box above the tree swaps the tree for a view of the entries
+// whose names match and the folders holding them. Matches come from an
+// index of the whole folder, so nothing is read as the query changes.
+
+static const int FILTER_H = 24;
+static const size_t MAX_FILTER_RESULTS = 5000;
+
+class TreeFilterInput : public Fl_Input {
+public:
+    using Fl_Input::Fl_Input;
+    int handle(int e) override;
+};
+
+static TreeFilterInput* filter_input = nullptr;
+static TreeView* filter_view = nullptr;
+static bool tree_shown = true;
+static std::shared_ptr<const PathIndex> path_index;
+static bool path_index_stale = true;      // entries changed since it was read
+static bool path_index_building = false;
+static PathFilter path_filter;
+static std::vector<int> filter_entries;   // index entry of each node of filter_view
+
+static bool filtering() {
+    return filter_input && filter_input->size() > 0;
+}
+
+static void show_filter_results(bool show) {
+    if (show && tree_shown) {
+        file_tree->hide();
+        filter_view->show();
+    } else {
+        filter_view->hide();
+        if (tree_shown) file_tree->show();
+    }
+}
+
+static void path_index_ready(void*);
+
+static void start_path_index() {
+    path_index_stale = false;
+    path_index_building = true;
+    build_path_index(current_folder, tree_lists, path_index_ready);
+}
+
+// Fill filter_view with the matches and their folders. The index is in
+// tree order, so a folder is always added before anything inside it.
+static void apply_tree_filter() {
+    if (!filtering()) {
+        path_filter.reset();
+        filter_view->clear();
+        filter_entries.clear();
+        show_filter_results(false);
+        return;
+    }
+    if (path_index_stale && !path_index_building) start_path_index();
+
+    filter_view->clear();
+    filter_entries.clear();
+    if (!path_index) {
+        filter_view->add(TREE_ROOT, "Indexing...");
+    } else {
+        const PathIndex& index = *path_index;
+        const std::vector<uint32_t>& matches = path_filter.update(path_index, filter_input->value());
+        std::unordered_map<std::string_view, int> dir_nodes;
+        auto add_node = [&](int parent, std::string_view path, size_t name_at, bool is_dir, int entry) {
+            int node = filter_view->add(parent, entry_label(std::string(path.substr(name_at)), is_dir).c_str());
+            if (is_dir) {
+                filter_view->flags(node, DIR_NODE);
+                dir_nodes[path] = node;
+            }
+            if ((size_t)node >= filter_entries.size()) filter_entries.resize(node + 1, -1);
+            filter_entries[node] = entry;
+            return node;
+        };
+
+        size_t shown = std::min(matches.size(), MAX_FILTER_RESULTS);
+        for (size_t m = 0; m < shown; ++m) {
+            uint32_t entry = matches[m];
+            std::string_view path = index.path(entry);
+            if (index.dirs[entry] && dir_nodes.count(path)) continue;
+
+            int parent = TREE_ROOT;
+            size_t start = 0;
+            for (size_t slash = path.find('/'); slash != std::string_view::npos; slash = path.find('/', slash + 1)) {
+                std::string_view dir = path.substr(0, slash);
+                auto found = dir_nodes.find(dir);
+                parent = found != dir_nodes.end() ? found->second : add_node(parent, dir, start, true, -1);
+                start = slash + 1;
+            }
+            add_node(parent, path, index.name_offsets[entry], index.dirs[entry], (int)entry);
+        }
+        if (matches.empty()) {
+            filter_view->add(TREE_ROOT, "No matches");
+        } else if (shown < matches.size()) {
+            char more[64];
+            snprintf(more, sizeof(more), "%zu more...", matches.size() - shown);
+            filter_view->add(TREE_ROOT, more);
+        }
+        filter_view->open_subtree(TREE_ROOT);
+    }
+    show_filter_results(true);
+    filter_view->redraw();
+}
+
+static void path_index_ready(void*) {
+    path_index_building = false;
+    std::shared_ptr<const PathIndex> index = finished_path_index();
+    if (!index || index->folder != current_folder) return;
+    path_index = index;
+    if (filtering()) {
+        if (path_index_stale) start_path_index();  // changed again while it was read
+        apply_tree_filter();
+    }
+}
+
+// The folder's entries changed: read the index again, at once if in use
+static void invalidate_path_index() {
+    path_index_stale = true;
+    if (filtering() && !path_index_building) start_path_index();
+}
+
+static void clear_tree_filter() {
+    path_index.reset();
+    path_index_stale = true;
+    if (filter_input) {
+        filter_input->value("");
+        apply_tree_filter();
+    }
+}
+
+static std::string filter_path_of(int node) {
+    int entry = node >= 0 && (size_t)node < filter_entries.size() ? filter_entries[node] : -1;
+    return entry < 0 ? std::string() : join_path(current_folder, std::string(path_index->path(entry)));
+}
+
+// Open the first file the filter shows
+static void open_first_match() {
+    for (size_t node = 0; node < filter_entries.size(); ++node) {
+        int entry = filter_entries[node];
+        if (entry < 0 || path_index->dirs[entry]) continue;
+        filter_view->select((int)node);
+        filter_view->show_node((int)node);
+        load_file(filter_path_of((int)node).c_str());
+        return;
+    }
+}
+
+int TreeFilterInput::handle(int e) {
+    if (e == FL_KEYDOWN) {
+        switch (Fl::event_key()) {
+            case FL_Escape:
+                if (size()) {
+                    value("");
+                    apply_tree_filter();
+                } else {
+                    Fl::focus(file_tree);
+                }
+                return 1;
+            case FL_Enter:
+            case FL_KP_Enter:
+                if (filtering()) open_first_match();
+                return 1;
+            case FL_Down:
+                if (filtering() && filter_view->children(TREE_ROOT)) {
+                    filter_view->select(filter_view->child(TREE_ROOT, 0));
+                    Fl::focus(filter_view);
+                    filter_view->redraw();
+                }
+                return 1;
+        }
+    }
+    return Fl_Input::handle(e);
+}
+
+static void filter_input_cb(Fl_Widget*, void*) {
+    apply_tree_filter();
+}
+
+static void filter_view_cb(Fl_Widget* w, void*) {
+    TreeView* view = static_cast<TreeView*>(w);
+    int node = view->callback_node();
+    if (node == TREE_NONE || view->callback_reason() != TREE_REASON_SELECTED) return;
+    scroll_label_into_view(view, node, true);
+    if (!(view->flags(node) & DIR_NODE)) {
+        std::string path = filter_path_of(node);
+        if (!path.empty()) load_file(path.c_str());
+    }
+}
+
+void create_tree_filter() {
+    int X = file_tree->x(), Y = file_tree->y(), W = file_tree->w(), H = file_tree->h();
+    filter_input = new TreeFilterInput(X, Y, W, FILTER_H);
+    filter_input->when(FL_WHEN_CHANGED);
+    filter_input->callback(filter_input_cb);
+    filter_input->tooltip("Filter files by name, or by path with a '/'");
+    filter_view = new TreeView(X, Y + FILTER_H, W, H - FILTER_H);
+    filter_view->callback(filter_view_cb);
+    filter_view->hide();
+    layout_file_tree(X, Y, W, H);
+}
+
+void layout_file_tree(int X, int Y, int W, int H) {
+    if (!filter_input) {
+        file_tree->resize(X, Y, W, H);
+        return;
+    }
+    filter_input->resize(X, Y, W, FILTER_H);
+    file_tree->resize(X, Y + FILTER_H, W, H - FILTER_H);
+    filter_view->resize(X, Y + FILTER_H, W, H - FILTER_H);
+}
+
+void show_file_tree(bool show) {
+    tree_shown = show;
+    if (filter_input) {
+        if (show) filter_input->show();
+        else filter_input->hide();
+    }
+    if (!show) {
+        file_tree->hide();
+        if (filter_view) filter_view->hide();
+    } else if (filter_view) {
+        show_filter_results(filtering());
+    } else {
+        file_tree->show();
+    }
+}
+
+void restyle_file_tree() {
+    if (!git_states.empty()) {
+        for (const auto& item : item_index) decorate_item(item.second, item.first);
+    }
+    if (!filter_view) return;
+    filter_view->color(file_tree->color());
+    filter_view->selection_color(file_tree->selection_color());
+    for (int i = 0; i < file_tree->children() && i < filter_view->children(); i++) {
+        Fl_Scrollbar* from = dynamic_cast<Fl_Scrollbar*>(file_tree->child(i));
+        Fl_Scrollbar* to = dynamic_cast<Fl_Scrollbar*>(filter_view->child(i));
+        if (from && to) {
+            to->color(from->color(), from->selection_color());
+            to->box(from->box());
+            to->slider(from->slider());
+        }
+    }
+    filter_input->color(file_tree->color());
+    filter_input->textcolor(fl_contrast(FL_FOREGROUND_COLOR, file_tree->color()));
+    filter_input->redraw();
+    filter_view->redraw();
+}
@@ -4,20 +4,40 @@
 void load_folder(const char* folder);
 void load_last_folder_if_any();
 void tree_cb(Fl_Widget* w, void* data);
-void refresh_tree_item(Fl_Tree_Item* it);
+void refresh_tree_item(int node);
+// Open the folders down to `path`, then select and scroll to it; false if
+// it is not shown in the tree
+bool reveal_in_tree(const char* path);
 
 // VSCode-like features
-void show_tree_context_menu(int x, int y, Fl_Tree_Item* item);
+void show_tree_context_menu(int x, int y, int node);
 void tree_new_file_cb(Fl_Widget* w, void* data);
 void tree_new_folder_cb(Fl_Widget* w, void* data);
 void tree_rename_item_cb(Fl_Widget* w, void* data);
 void tree_delete_item_cb(Fl_Widget* w, void* data);
+void tree_duplicate_item_cb(Fl_Widget* w, void* data);
+void tree_copy_item_cb(Fl_Widget* w, void* data);
+void tree_cut_item_cb(Fl_Widget* w, void* data);
+void tree_paste_item_cb(Fl_Widget* w, void* data);
 void tree_copy_path_cb(Fl_Widget* w, void* data);
 void tree_refresh_cb(Fl_Widget* w, void* data);
 void tree_collapse_all_cb(Fl_Widget* w, void* data);
 void tree_expand_all_cb(Fl_Widget* w, void* data);
 int tree_handle_key(int key);
 
+// Filter box above the tree and the view of its matches. Created after
+// file_tree, in the same group; the tree column is then placed and shown
+// through these.
+void create_tree_filter();
+void layout_file_tree(int X, int Y, int W, int H);
+void show_file_tree(bool show);
+// Follow the theme once it has set file_tree's colors: the filter box and
+// the git status colors of the items
+void restyle_file_tree();
+
+// Keep the listed directories for the next time the folder is opened
+void save_tree_snapshot();
+
 // Tree expansion state persistence
 void save_tree_expansion_state();
 void load_tree_expansion_state();
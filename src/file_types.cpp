@@ -0,0 +1,123 @@
+#include "file_types.hpp"
+#include <array>
+#include <cstdint>
+
+namespace {
+
+// Extensions of up to eight characters, lowercased and packed into one
+// integer, so a lookup is a binary search over plain keys
+constexpr uint64_t pack_extension(std::string_view ext) {
+    if (ext.empty() || ext.size() > 8) return 0;
+    uint64_t key = 0;
+    for (size_t i = 0; i < ext.size(); ++i) {
+        char c = ext[i];
+        if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+        key |= static_cast<uint64_t>(static_cast<unsigned char>(c)) << (8 * i);
+    }
+    return key;
+}
+
+struct ExtensionEntry {
+    uint64_t key;
+    FileKind kind;
+    bool source;
+};
+
+constexpr ExtensionEntry ext(std::string_view name, FileKind kind, bool source = true) {
+    return {pack_extension(name), kind, source};
+}
+
+template <class... Entries>
+constexpr auto sorted_table(Entries... entries) {
+    std::array<ExtensionEntry, sizeof...(Entries)> table{{entries...}};
+    const size_t N = table.size();
+    for (size_t i = 1; i < N; ++i) {
+        for (size_t j = i; j > 0 && table[j].key < table[j - 1].key; --j) {
+            ExtensionEntry t = table[j];
+            table[j] = table[j - 1];
+            table[j - 1] = t;
+        }
+    }
+    return table;
+}
+
+constexpr auto EXTENSIONS = sorted_table(
+    ext("c", FILE_KIND_C_CPP), ext("cpp", FILE_KIND_C_CPP), ext("cc", FILE_KIND_C_CPP),
+    ext("cxx", FILE_KIND_C_CPP), ext("h", FILE_KIND_C_CPP), ext("hpp", FILE_KIND_C_CPP),
+    ext("hxx", FILE_KIND_C_CPP),
+    ext("html", FILE_KIND_MARKUP), ext("htm", FILE_KIND_MARKUP, false),
+    ext("css", FILE_KIND_STYLE), ext("scss", FILE_KIND_STYLE),
+    ext("js", FILE_KIND_JS), ext("ts", FILE_KIND_JS),
+    ext("jsx", FILE_KIND_JS, false), ext("tsx", FILE_KIND_JS, false),
+    ext("json", FILE_KIND_DATA), ext("xml", FILE_KIND_DATA), ext("yaml", FILE_KIND_DATA),
+    ext("yml", FILE_KIND_DATA), ext("toml", FILE_KIND_DATA), ext("ini", FILE_KIND_DATA),
+    ext("cfg", FILE_KIND_DATA), ext("conf", FILE_KIND_DATA),
+    ext("sh", FILE_KIND_SCRIPT), ext("bash", FILE_KIND_SCRIPT), ext("zsh", FILE_KIND_SCRIPT),
+    ext("fish", FILE_KIND_SCRIPT), ext("py", FILE_KIND_SCRIPT), ext("rb", FILE_KIND_SCRIPT),
+    ext("go", FILE_KIND_SCRIPT), ext("rs", FILE_KIND_SCRIPT), ext("java", FILE_KIND_SCRIPT),
+    ext("php", FILE_KIND_SCRIPT), ext("swift", FILE_KIND_SCRIPT), ext("kt", FILE_KIND_SCRIPT),
+    ext("cmake", FILE_KIND_BUILD), ext("make", FILE_KIND_BUILD), ext("mk", FILE_KIND_BUILD),
+    ext("md", FILE_KIND_DOC), ext("txt", FILE_KIND_DOC), ext("rst", FILE_KIND_DOC, false),
+    ext("scala", FILE_KIND_OTHER), ext("cs", FILE_KIND_OTHER), ext("vb", FILE_KIND_OTHER),
+    ext("sql", FILE_KIND_OTHER));
+
+constexpr bool keys_unique() {
+    for (size_t i = 1; i < EXTENSIONS.size(); ++i) {
+        if (EXTENSIONS[i].key == EXTENSIONS[i - 1].key || EXTENSIONS[i].key == 0) return false;
+    }
+    return true;
+}
+static_assert(keys_unique(), "file extension listed twice");
+
+// Names hidden wherever they appear, matched exactly
+constexpr std::string_view IGNORED[] = {
+    ".git", ".svn", ".hg", ".bzr",
+    "node_modules", "vendor", "target", "build", "dist",
+    ".cache", ".tmp", ".temp", "__pycache__",
+    ".DS_Store", "Thumbs.db", "desktop.ini",
+};
+
+constexpr const char* ICONS[] = {
+    "◦ ",  // FILE_KIND_OTHER
+    "◯ ",  // FILE_KIND_C_CPP
+    "◇ ",  // FILE_KIND_MARKUP
+    "◈ ",  // FILE_KIND_STYLE
+    "◉ ",  // FILE_KIND_JS
+    "◾ ",  // FILE_KIND_DATA
+    "▲ ",  // FILE_KIND_SCRIPT
+    "◆ ",  // FILE_KIND_BUILD
+    "◦ ",  // FILE_KIND_DOC
+};
+static_assert(sizeof(ICONS) / sizeof(ICONS[0]) == FILE_KIND_DOC + 1, "an icon for every kind");
+
+constexpr bool is_ignored_name(std::string_view name) {
+    for (std::string_view ignored : IGNORED) {
+        if (name == ignored) return true;
+    }
+    return false;
+}
+
+constexpr const ExtensionEntry* find_extension(std::string_view name) {
+    size_t dot = name.rfind('.');
+    if (dot == std::string_view::npos) return nullptr;
+    uint64_t key = pack_extension(name.substr(dot + 1));
+    if (!key) return nullptr;
+    size_t lo = 0, hi = EXTENSIONS.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (EXTENSIONS[mid].key < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < EXTENSIONS.size() && EXTENSIONS[lo].key == key ? &EXTENSIONS[lo] : nullptr;
+}
+
+static_assert(find_extension("main.CPP") && find_extension("main.CPP")->kind == FILE_KIND_C_CPP, "case");
+static_assert(!find_extension("Makefile") && !find_extension("archive.tar.gzip2x"), "no extension");
+
+}  // namespace
+
+FileType classify_file(std::string_view name) {
+    const ExtensionEntry* entry = find_extension(name);
+    FileKind kind = entry ? entry->kind : FILE_KIND_OTHER;
+    return {kind, ICONS[kind], entry && entry->source, is_ignored_name(name)};
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <string_view>
+
+enum FileKind {
+    FILE_KIND_OTHER,
+    FILE_KIND_C_CPP,
+    FILE_KIND_MARKUP,  // HTML
+    FILE_KIND_STYLE,   // CSS, SCSS
+    FILE_KIND_JS,      // JavaScript, TypeScript
+    FILE_KIND_DATA,    // JSON, XML, YAML and config formats
+    FILE_KIND_SCRIPT,  // shells and other languages
+    FILE_KIND_BUILD,   // CMake, make
+    FILE_KIND_DOC      // Markdown, plain text
+};
+
+struct FileType {
+    FileKind kind;
+    const char* icon;  // minimal file tree icon, never null
+    bool source;       // listed in the file tree and covered by folder search
+    bool ignored;      // hidden from the tree and search, e.g. .git or node_modules
+};
+
+// Classify an entry by its name alone. The extension is matched without
+// case against a table sorted at compile time; nothing is allocated, so the
+// scanner thread and folder search can call it for every entry.
+FileType classify_file(std::string_view name);
@@ -0,0 +1,818 @@
+#include "git_status.hpp"
+#include "dir_scanner.hpp"
+#include "file_io.hpp"
+#include <FL/Fl.H>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ======================
+// SHA-1, for blob ids
+// ======================
+
+class Sha1 {
+public:
+    void update(const void* data, size_t n);
+    void finish(unsigned char out[20]);
+
+private:
+    uint32_t h_[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    uint64_t length_ = 0;
+    unsigned char block_[64];
+    size_t used_ = 0;
+
+    void compress(const unsigned char* p);
+};
+
+static uint32_t rol(uint32_t v, int n) {
+    return (v << n) | (v >> (32 - n));
+}
+
+void Sha1::compress(const unsigned char* p) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i)
+        w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+    for (int i = 16; i < 80; ++i) w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    uint32_t a = h_[0], b = h_[1], c = h_[2], d = h_[3], e = h_[4];
+    for (int i = 0; i < 80; ++i) {
+        uint32_t f, k;
+        if (i < 20) f = (b & c) | (~b & d), k = 0x5A827999;
+        else if (i < 40) f = b ^ c ^ d, k = 0x6ED9EBA1;
+        else if (i < 60) f = (b & c) | (b & d) | (c & d), k = 0x8F1BBCDC;
+        else f = b ^ c ^ d, k = 0xCA62C1D6;
+        uint32_t t = rol(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rol(b, 30);
+        b = a;
+        a = t;
+    }
+    h_[0] += a;
+    h_[1] += b;
+    h_[2] += c;
+    h_[3] += d;
+    h_[4] += e;
+}
+
+void Sha1::update(const void* data, size_t n) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    length_ += n;
+    while (n > 0) {
+        size_t take = std::min(n, sizeof(block_) - used_);
+        memcpy(block_ + used_, p, take);
+        used_ += take;
+        p += take;
+        n -= take;
+        if (used_ == sizeof(block_)) {
+            compress(block_);
+            used_ = 0;
+        }
+    }
+}
+
+void Sha1::finish(unsigned char out[20]) {
+    uint64_t bits = length_ * 8;
+    unsigned char pad = 0x80;
+    update(&pad, 1);
+    pad = 0;
+    while (used_ != 56) update(&pad, 1);
+    unsigned char len[8];
+    for (int i = 0; i < 8; ++i) len[i] = (unsigned char)(bits >> (56 - 8 * i));
+    update(len, 8);
+    for (int i = 0; i < 20; ++i) out[i] = (unsigned char)(h_[i / 4] >> (24 - 8 * (i % 4)));
+}
+
+// ======================
+// Index
+// ======================
+
+struct IndexEntry {
+    std::string path;  // relative to the work tree
+    uint32_t mtime_s, mtime_ns, ino, mode, size;
+    unsigned char sha[20];
+    bool conflict;     // more than one stage
+    bool skip;         // submodule, sparse directory or skip-worktree: not compared
+};
+
+struct GitIndex {
+    std::vector<IndexEntry> entries;  // by path, as git sorts them
+    long long mtime = -1;             // of the index file, in nanoseconds
+
+    const IndexEntry* find(const std::string& path) const {
+        auto it = std::lower_bound(entries.begin(), entries.end(), path,
+                                   [](const IndexEntry& e, const std::string& p) { return e.path < p; });
+        return it != entries.end() && it->path == path ? &*it : nullptr;
+    }
+    // Anything tracked inside directory `dir`
+    bool holds_under(const std::string& dir) const {
+        std::string prefix = dir + "/";
+        auto it = std::lower_bound(entries.begin(), entries.end(), prefix,
+                                   [](const IndexEntry& e, const std::string& p) { return e.path < p; });
+        return it != entries.end() && !it->path.compare(0, prefix.size(), prefix);
+    }
+};
+
+static uint32_t be32(const unsigned char* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint16_t be16(const unsigned char* p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+// Versions 2 to 4 of the index format; extensions after the entries are
+// not needed and not read
+static bool parse_index(const std::string& data, GitIndex& index) {
+    const unsigned char* base = reinterpret_cast<const unsigned char*>(data.data());
+    size_t size = data.size();
+    if (size < 12 || memcmp(base, "DIRC", 4) != 0) return false;
+    uint32_t version = be32(base + 4), count = be32(base + 8);
+    if (version < 2 || version > 4) return false;
+
+    const size_t FIXED = 62;  // stat data, mode, size, id and flags
+    size_t pos = 12;
+    std::string previous;
+    index.entries.clear();
+    index.entries.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        if (size - pos < FIXED) return false;
+        const unsigned char* e = base + pos;
+        IndexEntry entry;
+        entry.mtime_s = be32(e + 8);
+        entry.mtime_ns = be32(e + 12);
+        entry.ino = be32(e + 20);
+        entry.mode = be32(e + 24);
+        entry.size = be32(e + 36);
+        memcpy(entry.sha, e + 40, 20);
+        uint16_t flags = be16(e + 60);
+        size_t p = pos + FIXED;
+        uint16_t extended = 0;
+        if (version >= 3 && (flags & 0x4000)) {
+            if (size - p < 2) return false;
+            extended = be16(base + p);
+            p += 2;
+        }
+
+        if (version == 4) {
+            // The name drops `strip` bytes from the end of the previous one
+            size_t strip = 0;
+            unsigned char c;
+            do {
+                if (p >= size) return false;
+                c = base[p++];
+                strip = (strip << 7) | (c & 127);
+                if (c & 128) ++strip;
+            } while (c & 128);
+            const void* end = memchr(base + p, 0, size - p);
+            if (!end || strip > previous.size()) return false;
+            size_t len = static_cast<const unsigned char*>(end) - (base + p);
+            entry.path = previous.substr(0, previous.size() - strip) + data.substr(p, len);
+            pos = p + len + 1;
+        } else {
+            const void* end = memchr(base + p, 0, size - p);
+            if (!end) return false;
+            size_t len = static_cast<const unsigned char*>(end) - (base + p);
+            entry.path = data.substr(p, len);
+            pos += ((p - pos) + len + 8) & ~(size_t)7;  // padded with 1 to 8 NULs
+            if (pos > size) return false;
+        }
+        previous = entry.path;
+
+        uint32_t type = entry.mode & 0170000;
+        entry.skip = type == 0160000 || type == 0040000 || (extended & 0x4000);
+        entry.conflict = ((flags >> 12) & 3) != 0;
+        // Stages of a conflict follow each other
+        if (!index.entries.empty() && index.entries.back().path == entry.path) {
+            index.entries.back().conflict = true;
+            continue;
+        }
+        index.entries.push_back(std::move(entry));
+    }
+    return true;
+}
+
+// ======================
+// Ignore Rules
+// ======================
+
+struct IgnorePattern {
+    std::string glob;
+    bool negate;
+    bool dir_only;
+    bool anchored;  // had a '/': matched against the path below the file's folder
+};
+
+struct IgnoreList {
+    std::string base;  // folder the patterns are relative to
+    std::vector<IgnorePattern> patterns;
+};
+
+static void parse_ignore(const std::string& text, const std::string& base, IgnoreList& out) {
+    out.base = base;
+    out.patterns.clear();
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos) end = text.size();
+        std::string line = text.substr(start, end - start);
+        start = end + 1;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        while (!line.empty() && line.back() == ' ' && (line.size() < 2 || line[line.size() - 2] != '\\'))
+            line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+
+        IgnorePattern pattern{line, false, false, false};
+        std::string& glob = pattern.glob;
+        if (glob[0] == '!') {
+            pattern.negate = true;
+            glob.erase(0, 1);
+        } else if (glob[0] == '\\' && glob.size() > 1 && (glob[1] == '!' || glob[1] == '#')) {
+            glob.erase(0, 1);
+        }
+        if (!glob.empty() && glob.back() == '/') {
+            pattern.dir_only = true;
+            glob.pop_back();
+        }
+        pattern.anchored = glob.find('/') != std::string::npos;
+        if (!glob.empty() && glob[0] == '/') glob.erase(0, 1);
+        if (!glob.empty()) out.patterns.push_back(std::move(pattern));
+    }
+}
+
+// Shell glob as gitignore uses it: '*' and '?' stop at '/', "**" does not
+static bool glob_match(const char* p, const char* t) {
+    for (; *p; ++p, ++t) {
+        switch (*p) {
+            case '?':
+                if (!*t || *t == '/') return false;
+                break;
+            case '*':
+                if (p[1] == '*') {
+                    const char* rest = p + 2;
+                    if (*rest == '/' && glob_match(rest + 1, t)) return true;  // "**/" over no folder
+                    for (const char* s = t;; ++s) {
+                        if (glob_match(rest, s)) return true;
+                        if (!*s) return false;
+                    }
+                }
+                for (const char* s = t;; ++s) {
+                    if (glob_match(p + 1, s)) return true;
+                    if (!*s || *s == '/') return false;
+                }
+            case '[': {
+                if (!*t || *t == '/') return false;
+                const char* q = p + 1;
+                bool negate = *q == '!' || *q == '^';
+                if (negate) ++q;
+                bool hit = false;
+                for (bool first = true; *q && (first || *q != ']'); ++q, first = false) {
+                    char lo = *q;
+                    if (lo == '\\' && q[1]) lo = *++q;
+                    char hi = lo;
+                    if (q[1] == '-' && q[2] && q[2] != ']') {
+                        q += 2;
+                        hi = *q;
+                        if (hi == '\\' && q[1]) hi = *++q;
+                    }
+                    if (*t >= lo && *t <= hi) hit = true;
+                }
+                if (!*q || hit == negate) return false;
+                p = q;
+                break;
+            }
+            case '\\':
+                if (p[1]) ++p;
+                [[fallthrough]];
+            default:
+                if (*p != *t) return false;
+        }
+    }
+    return !*t;
+}
+
+// 1 excluded, 0 kept by a negation, -1 no pattern matched. The last
+// matching pattern decides.
+static int match_ignore(const IgnoreList& list, const std::string& rel, bool is_dir) {
+    if (list.patterns.empty()) return -1;
+    std::string sub = list.base.empty() ? rel : rel.substr(list.base.size() + 1);
+    size_t slash = sub.rfind('/');
+    const char* name = sub.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+    for (size_t i = list.patterns.size(); i-- > 0;) {
+        const IgnorePattern& pattern = list.patterns[i];
+        if (pattern.dir_only && !is_dir) continue;
+        if (glob_match(pattern.glob.c_str(), pattern.anchored ? sub.c_str() : name))
+            return pattern.negate ? 0 : 1;
+    }
+    return -1;
+}
+
+// ======================
+// Work Tree
+// ======================
+
+// State of one session, touched only by the worker thread
+struct Repo {
+    bool valid = false;
+    std::string folder;     // as opened
+    std::string work_tree;
+    std::string git_dir;
+    std::string prefix;     // folder relative to work_tree, "" at the top
+    GitIndex index;
+    IgnoreList info_exclude, user_exclude;
+    std::unordered_map<std::string, IgnoreList> ignores;  // .gitignore by folder
+};
+
+static std::string parent_of(const std::string& rel) {
+    size_t slash = rel.rfind('/');
+    return slash == std::string::npos ? std::string() : rel.substr(0, slash);
+}
+
+static bool locate_repo(const std::string& folder, std::string& work_tree, std::string& git_dir) {
+    std::string dir = folder;
+    while (dir.size() > 1 && dir.back() == '/') dir.pop_back();
+    for (;;) {
+        std::string dot_git = dir + "/.git";
+        struct stat st;
+        if (stat(dot_git.c_str(), &st) == 0) {
+            work_tree = dir;
+            if (S_ISDIR(st.st_mode)) {
+                git_dir = dot_git;
+                return true;
+            }
+            // "gitdir: <path>", relative to the work tree
+            std::string text;
+            if (!read_file(dot_git, text) || text.compare(0, 8, "gitdir: ") != 0) return false;
+            git_dir = text.substr(8);
+            while (!git_dir.empty() && (git_dir.back() == '\n' || git_dir.back() == '\r')) git_dir.pop_back();
+            if (!git_dir.empty() && git_dir[0] != '/') git_dir = dir + "/" + git_dir;
+            return !git_dir.empty();
+        }
+        // A repository at the root is not looked for
+        size_t slash = dir.rfind('/');
+        if (slash == std::string::npos || slash == 0) return false;
+        dir.resize(slash);
+    }
+}
+
+std::string find_git_dir(const std::string& folder) {
+    std::string work_tree, git_dir;
+    return locate_repo(folder, work_tree, git_dir) ? git_dir : std::string();
+}
+
+static const IgnoreList& ignore_list(Repo& repo, const std::string& dir) {
+    auto found = repo.ignores.find(dir);
+    if (found != repo.ignores.end()) return found->second;
+    IgnoreList& list = repo.ignores[dir];
+    std::string text;
+    if (read_file(repo.work_tree + "/" + (dir.empty() ? "" : dir + "/") + ".gitignore", text))
+        parse_ignore(text, dir, list);
+    else
+        list.base = dir;
+    return list;
+}
+
+// Excluded by patterns alone; a folder above being excluded is not looked at
+static bool excluded_here(Repo& repo, const std::string& rel, bool is_dir) {
+    for (std::string dir = parent_of(rel);; dir = parent_of(dir)) {
+        int r = match_ignore(ignore_list(repo, dir), rel, is_dir);
+        if (r >= 0) return r == 1;
+        if (dir.empty()) break;
+    }
+    int r = match_ignore(repo.info_exclude, rel, is_dir);
+    if (r < 0) r = match_ignore(repo.user_exclude, rel, is_dir);
+    return r == 1;
+}
+
+// Excluded itself or inside an excluded folder
+static bool excluded(Repo& repo, const std::string& rel, bool is_dir) {
+    size_t slash = 0;
+    while ((slash = rel.find('/', slash)) != std::string::npos) {
+        if (excluded_here(repo, rel.substr(0, slash), true)) return true;
+        ++slash;
+    }
+    return excluded_here(repo, rel, is_dir);
+}
+
+static bool open_repo(const std::string& folder, Repo& repo) {
+    repo = Repo();
+    repo.folder = folder;
+    if (!locate_repo(folder, repo.work_tree, repo.git_dir)) return false;
+    repo.prefix = folder.size() > repo.work_tree.size() ? folder.substr(repo.work_tree.size() + 1) : "";
+
+    std::string text;
+    if (read_file(repo.git_dir + "/info/exclude", text)) parse_ignore(text, "", repo.info_exclude);
+    const char* xdg = getenv("XDG_CONFIG_HOME");
+    const char* home = getenv("HOME");
+    std::string user = xdg && *xdg ? std::string(xdg) + "/git/ignore"
+                                   : std::string(home ? home : ".") + "/.config/git/ignore";
+    if (read_file(user, text)) parse_ignore(text, "", repo.user_exclude);
+    repo.valid = true;
+    return true;
+}
+
+static bool load_index(Repo& repo) {
+    std::string path = repo.git_dir + "/index";
+    struct stat st;
+    std::string data;
+    repo.index.entries.clear();
+    repo.index.mtime = -1;
+    if (stat(path.c_str(), &st) != 0) return true;  // nothing staged yet
+    repo.index.mtime = stat_mtime_ns(st);
+    return read_file(path, data) && parse_index(data, repo.index);
+}
+
+static bool index_changed(const Repo& repo) {
+    struct stat st;
+    long long now = stat((repo.git_dir + "/index").c_str(), &st) == 0 ? stat_mtime_ns(st) : -1;
+    return now != repo.index.mtime;
+}
+
+static bool blob_id(const std::string& path, const struct stat& st, unsigned char out[20]) {
+    std::string content;
+    if (S_ISLNK(st.st_mode)) {
+        std::vector<char> target(st.st_size + 1);
+        ssize_t n = readlink(path.c_str(), target.data(), target.size());
+        if (n < 0) return false;
+        content.assign(target.data(), n);
+    } else if (!read_file(path, content)) {
+        return false;
+    }
+    Sha1 sha;
+    std::string header = "blob " + std::to_string(content.size());
+    sha.update(header.c_str(), header.size() + 1);
+    sha.update(content.data(), content.size());
+    sha.finish(out);
+    return true;
+}
+
+static GitState compare_entry(const Repo& repo, const IndexEntry& entry) {
+    if (entry.skip) return GIT_CLEAN;
+    if (entry.conflict) return GIT_MODIFIED;
+    std::string path = repo.work_tree + "/" + entry.path;
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0) return GIT_DELETED;
+    bool link = (entry.mode & 0170000) == 0120000;
+    if (link ? !S_ISLNK(st.st_mode) : !S_ISREG(st.st_mode)) return GIT_MODIFIED;
+    if (!link && ((st.st_mode & 0100) != 0) != ((entry.mode & 0100) != 0)) return GIT_MODIFIED;
+    if ((uint32_t)st.st_size != entry.size) return GIT_MODIFIED;
+
+    long long mtime = stat_mtime_ns(st);
+    bool same = (uint32_t)(mtime / 1000000000LL) == entry.mtime_s &&
+                (!entry.mtime_ns || (uint32_t)(mtime % 1000000000LL) == entry.mtime_ns) &&
+                (!entry.ino || (uint32_t)st.st_ino == entry.ino);
+    // Written in the same instant as the index, the stat data cannot vouch for it
+    if (same && mtime < repo.index.mtime) return GIT_CLEAN;
+
+    unsigned char id[20];
+    if (!blob_id(path, st, id)) return GIT_MODIFIED;
+    return memcmp(id, entry.sha, 20) == 0 ? GIT_CLEAN : GIT_MODIFIED;
+}
+
+// Below the opened folder, relative to it
+static bool folder_rel(const Repo& repo, const std::string& rel, std::string& out) {
+    if (repo.prefix.empty()) {
+        out = rel;
+        return true;
+    }
+    if (rel.size() <= repo.prefix.size() || rel.compare(0, repo.prefix.size(), repo.prefix) != 0 ||
+        rel[repo.prefix.size()] != '/')
+        return false;
+    out = rel.substr(repo.prefix.size() + 1);
+    return true;
+}
+
+static void emit(const Repo& repo, const std::string& rel, GitState state, GitStatusUpdate& out) {
+    std::string key;
+    if (folder_rel(repo, rel, key)) out.states.emplace_back(std::move(key), state);
+}
+
+// ======================
+// Worker
+// ======================
+
+struct GitRequest {
+    unsigned long generation;
+    std::string folder;              // set for a new folder
+    std::vector<std::string> paths;  // otherwise, absolute paths to look at again
+};
+
+// Never destroyed: the worker may still be waiting on it at exit
+struct GitShared {
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<GitRequest> requests;
+    std::deque<GitStatusUpdate> updates;
+    unsigned long generation = 0;
+    GitStatusReady ready = nullptr;
+    bool notified = false;
+    bool running = false;
+};
+
+static GitShared& shared() {
+    static GitShared* s = new GitShared;
+    return *s;
+}
+
+static bool current(unsigned long generation) {
+    GitShared& s = shared();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.generation == generation;
+}
+
+static void publish(unsigned long generation, GitStatusUpdate&& update) {
+    GitShared& s = shared();
+    GitStatusReady ready;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (s.generation != generation) return;
+        s.updates.push_back(std::move(update));
+        if (s.notified) return;
+        s.notified = true;
+        ready = s.ready;
+    }
+    Fl::awake(ready, nullptr);
+}
+
+// A folder holding nothing tracked: untracked if anything in it is not
+// excluded, ignored if all of it is, GIT_CLEAN if it holds no files at all
+static GitState untracked_dir_state(Repo& repo, DIR* d, const std::string& rel) {
+    GitState state = GIT_CLEAN;
+    while (struct dirent* e = readdir(d)) {
+        if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) continue;
+        std::string child = rel + "/" + e->d_name;
+        bool is_dir = dir_entry_is_dir(d, e, false) == 1;
+        if (excluded_here(repo, child, is_dir)) {
+            state = GIT_IGNORED;
+            continue;
+        }
+        if (!is_dir) return GIT_UNTRACKED;
+        if (DIR* sub = open_dir_at(dirfd(d), e->d_name)) {
+            GitState inner = untracked_dir_state(repo, sub, child);
+            closedir(sub);
+            if (inner == GIT_UNTRACKED) return inner;
+            if (inner == GIT_IGNORED) state = inner;
+        }
+    }
+    return state;
+}
+
+// Untracked and excluded entries below `d`. Symlinks are files to git, so
+// only real directories are entered.
+static bool walk_untracked(Repo& repo, DIR* d, const std::string& rel, bool dir_excluded,
+                           unsigned long generation, GitStatusUpdate& out) {
+    if (!current(generation)) return false;
+    while (struct dirent* e = readdir(d)) {
+        if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..") || !strcmp(e->d_name, ".git")) continue;
+        std::string child = rel.empty() ? e->d_name : rel + "/" + e->d_name;
+        if (repo.index.find(child)) continue;  // tracked, or a submodule
+
+        bool is_dir = dir_entry_is_dir(d, e, false) == 1;
+        if (is_dir && repo.index.holds_under(child)) {
+            bool sub_excluded = dir_excluded || excluded_here(repo, child, true);
+            if (DIR* sub = open_dir_at(dirfd(d), e->d_name)) {
+                bool going = walk_untracked(repo, sub, child, sub_excluded, generation, out);
+                closedir(sub);
+                if (!going) return false;
+            }
+            continue;
+        }
+        // Nothing tracked inside: a folder counts whole, as git shows it
+        GitState state = GIT_UNTRACKED;
+        if (dir_excluded || excluded_here(repo, child, is_dir)) {
+            state = GIT_IGNORED;
+        } else if (is_dir) {
+            DIR* sub = open_dir_at(dirfd(d), e->d_name);
+            if (!sub) continue;
+            state = untracked_dir_state(repo, sub, child);
+            closedir(sub);
+        }
+        if (state != GIT_CLEAN) emit(repo, child, state, out);
+    }
+    return true;
+}
+
+static bool full_status(Repo& repo, unsigned long generation, GitStatusUpdate& out) {
+    out.full = true;
+    out.states.clear();
+    repo.ignores.clear();
+    if (!load_index(repo)) return true;  // unreadable: show nothing rather than everything as new
+
+    for (const IndexEntry& entry : repo.index.entries) {
+        std::string key;
+        if (!folder_rel(repo, entry.path, key)) continue;
+        GitState state = compare_entry(repo, entry);
+        if (state != GIT_CLEAN) out.states.emplace_back(std::move(key), state);
+    }
+    if (!current(generation)) return false;
+
+    DIR* d = open_dir_at(AT_FDCWD, repo.folder.c_str());
+    if (!d) return true;
+    bool top_excluded = !repo.prefix.empty() && excluded(repo, repo.prefix, true);
+    bool done = walk_untracked(repo, d, repo.prefix, top_excluded, generation, out);
+    closedir(d);
+    return done;
+}
+
+static void recheck_paths(Repo& repo, const std::vector<std::string>& paths, GitStatusUpdate& out) {
+    const std::string top = repo.work_tree + "/";
+    for (const std::string& path : paths) {
+        if (path.compare(0, top.size(), top) != 0) continue;
+        std::string rel = path.substr(top.size());
+        if (rel == ".git" || !rel.compare(0, 5, ".git/")) continue;
+        std::string key;
+        if (!folder_rel(repo, rel, key)) continue;
+
+        if (const IndexEntry* entry = repo.index.find(rel)) {
+            out.states.emplace_back(key, compare_entry(repo, *entry));
+            continue;
+        }
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0) {
+            // A folder of tracked files may have gone with this path
+            out.states.emplace_back(key, GIT_CLEAN);
+            std::string prefix = rel + "/";
+            for (const IndexEntry& entry : repo.index.entries) {
+                if (!entry.path.compare(0, prefix.size(), prefix)) emit(repo, entry.path, GIT_DELETED, out);
+            }
+            continue;
+        }
+        bool is_dir = S_ISDIR(st.st_mode);
+        GitState state = GIT_CLEAN;
+        if (is_dir && repo.index.holds_under(rel)) {
+            // Its entries are looked at on their own
+        } else if (excluded(repo, rel, is_dir)) {
+            state = GIT_IGNORED;
+        } else if (!is_dir) {
+            state = GIT_UNTRACKED;
+        } else {
+            if (DIR* d = open_dir_at(AT_FDCWD, path.c_str())) {
+                state = untracked_dir_state(repo, d, rel);
+                closedir(d);
+            }
+        }
+        out.states.emplace_back(key, state);
+    }
+}
+
+// Whether any of `paths` changes the rules: a .gitignore, or the index
+static bool rules_changed(const Repo& repo, const std::vector<std::string>& paths) {
+    for (const std::string& path : paths) {
+        size_t slash = path.rfind('/');
+        if (!path.compare(slash + 1, std::string::npos, ".gitignore")) return true;
+    }
+    return index_changed(repo);
+}
+
+// ======================
+// Session Cache
+// ======================
+
+// Layout, little endian: "FLG1", u32 folder length, folder, u32 count,
+// then per path u8 state, u32 length, path
+
+static std::string cache_dir() {
+    const char* home = getenv("HOME");
+    return std::string(home ? home : ".") + "/.flick/git";
+}
+
+static std::string cache_file(const std::string& folder) {
+    return cache_dir() + "/" + hashed_name(folder) + ".gs";
+}
+
+static void save_cache(const std::string& folder, const GitStatusUpdate& update) {
+    std::string out("FLG1");
+    put_string(out, folder);
+    put_u32(out, (uint32_t)update.states.size());
+    for (const auto& state : update.states) {
+        out += static_cast<char>(state.second);
+        put_string(out, state.first);
+    }
+
+    std::string dir = cache_dir();
+    mkdir(dir.substr(0, dir.rfind('/')).c_str(), 0700);
+    mkdir(dir.c_str(), 0700);
+    write_file_atomic(cache_file(folder), out);
+}
+
+static bool load_cache(const std::string& folder, GitStatusUpdate& update) {
+    std::string data;
+    if (!read_file(cache_file(folder), data) || data.compare(0, 4, "FLG1") != 0) return false;
+    ByteReader in{data, 4};
+    std::string stored_folder;
+    uint32_t count;
+    // A hash collision names another folder's cache
+    if (!in.string(stored_folder) || stored_folder != folder || !in.u32(count)) return false;
+    update.full = true;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint8_t state;
+        std::string rel;
+        if (!in.u8(state) || !in.string(rel) || state > GIT_IGNORED) return false;
+        update.states.emplace_back(std::move(rel), (GitState)state);
+    }
+    return true;
+}
+
+static void git_status_main() {
+    GitShared& s = shared();
+    Repo repo;
+    std::unique_lock<std::mutex> lock(s.mutex);
+    for (;;) {
+        s.wake.wait(lock, [&s] { return !s.requests.empty(); });
+        GitRequest request = std::move(s.requests.front());
+        s.requests.pop_front();
+        lock.unlock();
+
+        GitStatusUpdate update;
+        if (!request.folder.empty()) {
+            if (!open_repo(request.folder, repo)) {
+                update.full = true;
+                publish(request.generation, std::move(update));
+            } else {
+                GitStatusUpdate cached;
+                if (load_cache(repo.folder, cached)) publish(request.generation, std::move(cached));
+                if (full_status(repo, request.generation, update)) {
+                    save_cache(repo.folder, update);
+                    publish(request.generation, std::move(update));
+                }
+            }
+        } else if (repo.valid) {
+            if (rules_changed(repo, request.paths)) {
+                if (full_status(repo, request.generation, update)) {
+                    save_cache(repo.folder, update);
+                    publish(request.generation, std::move(update));
+                }
+            } else {
+                recheck_paths(repo, request.paths, update);
+                publish(request.generation, std::move(update));
+            }
+        }
+        lock.lock();
+    }
+}
+
+static void queue_git_request(GitRequest&& request) {
+    GitShared& s = shared();
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!s.running) {
+            s.running = true;
+            std::thread(git_status_main).detach();
+        }
+        // Paths waiting already are looked at together
+        if (request.folder.empty() && !s.requests.empty() && s.requests.back().folder.empty()) {
+            std::vector<std::string>& paths = s.requests.back().paths;
+            paths.insert(paths.end(), request.paths.begin(), request.paths.end());
+        } else {
+            s.requests.push_back(std::move(request));
+        }
+    }
+    s.wake.notify_one();
+}
+
+void start_git_status(const std::string& folder, GitStatusReady ready) {
+    GitShared& s = shared();
+    unsigned long generation;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        generation = ++s.generation;
+        s.requests.clear();
+        s.updates.clear();
+        s.ready = ready;
+    }
+    queue_git_request(GitRequest{generation, folder, {}});
+}
+
+void recheck_git_status(const std::vector<std::string>& paths) {
+    if (paths.empty()) return;
+    unsigned long generation;
+    {
+        GitShared& s = shared();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        generation = s.generation;
+    }
+    queue_git_request(GitRequest{generation, std::string(), paths});
+}
+
+bool take_git_status(GitStatusUpdate& out) {
+    GitShared& s = shared();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.updates.empty()) {
+        s.notified = false;
+        return false;
+    }
+    out = std::move(s.updates.front());
+    s.updates.pop_front();
+    return true;
+}
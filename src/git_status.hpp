@@ -0,0 +1,41 @@
+#pragma once
+#include <string>
+#include <utility>
+#include <vector>
+
+enum GitState : unsigned char {
+    GIT_CLEAN,
+    GIT_MODIFIED,   // tracked and different from the index, or in conflict
+    GIT_DELETED,    // tracked and gone from the work tree
+    GIT_UNTRACKED,  // not in the index; a folder holding nothing tracked counts whole
+    GIT_IGNORED     // excluded by .gitignore, info/exclude or the user's ignore file;
+                    // an excluded folder counts whole
+};
+
+// Changed states by path relative to the folder. A full update replaces
+// everything known; otherwise GIT_CLEAN drops a path.
+struct GitStatusUpdate {
+    std::vector<std::pair<std::string, GitState>> states;
+    bool full = false;
+};
+
+// Posted through Fl::awake when updates are waiting to be taken
+typedef void (*GitStatusReady)(void* data);
+
+// Repository metadata directory of the work tree holding `folder`, "" if
+// there is none. A .git file (worktrees, submodules) is followed.
+std::string find_git_dir(const std::string& folder);
+
+// Work out the status of `folder` on a background thread, without running
+// git. .git/index is parsed and its stat data compared with the work tree;
+// only files whose stat data differ are hashed. The result of the last
+// session, if any, is handed over first and the fresh one follows.
+// Starting another folder drops what was queued for the previous one.
+void start_git_status(const std::string& folder, GitStatusReady ready);
+
+// Look at these paths again, e.g. after watch events. A changed index or
+// ignore file makes it a full pass.
+void recheck_git_status(const std::vector<std::string>& paths);
+
+// Main thread: take the next update, if any
+bool take_git_status(GitStatusUpdate& out);
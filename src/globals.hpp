@@ -8,13 +8,14 @@
 // Forward declarations
 class Fl_Double_Window;
 class Fl_Menu_Bar;
-class Fl_Tree;
+class TreeView;
 class Fl_Menu_Button;
 class Fl_Box;
 class Fl_Text_Buffer;
 class My_Text_Editor;
 class Fl_Widget;
 class TabBar;
+struct Tab;
 
 // Theme enum declaration
 enum Theme { THEME_DARK, THEME_LIGHT };
@@ -22,12 +23,14 @@ enum Theme { THEME_DARK, THEME_LIGHT };
 // Global variable declarations
 extern Fl_Double_Window *win;
 extern Fl_Menu_Bar    *menu;
-extern Fl_Tree        *file_tree;
+extern TreeView       *file_tree;
 extern int font_size;
 extern Fl_Menu_Button *context_menu;
 extern My_Text_Editor  *editor;
 extern Fl_Text_Buffer  *buffer;
 extern Fl_Text_Buffer  *style_buffer;
+extern Fl_Text_Buffer  *untitled_buffer;
+extern Fl_Text_Buffer  *untitled_style_buffer;
 extern bool text_changed;
 extern bool switching_tabs;
 extern char current_file[FL_PATH_MAX];
@@ -54,6 +57,9 @@ extern int             window_h;
 
 // Function declarations
 void style_init();
+void attach_document(Fl_Text_Buffer* doc, Fl_Text_Buffer* style);
+void show_untitled_document();
+bool load_tab_document(Tab* tab);
 void update_linenumber_width();
 void set_font_size(int sz);
 void save_font_size(int sz);
@@ -84,15 +90,18 @@ void paste_cb(Fl_Widget*, void*);
 void select_all_cb(Fl_Widget*, void*);
 void count_in_file(const char* file, const char* search, int* count);
 void replace_in_file(const char* file, const char* search, const char* replace);
-int highlight_in_buffer(const char* search, int* first_pos);
+int highlight_in_buffer(const char* search, int* first_pos, int* first_len = nullptr);
 void count_in_folder(const char* folder, const char* search, int* count);
 void replace_in_folder(const char* folder, const char* search, const char* replace);
 void find_cb(Fl_Widget*, void*);
 void replace_cb(Fl_Widget*, void*);
 void global_search_cb(Fl_Widget*, void*);
+void batch_replace_cb(Fl_Widget*, void*);
+void match_case_cb(Fl_Widget*, void*);
+void whole_word_cb(Fl_Widget*, void*);
 void load_folder(const char* folder);
 void load_last_folder_if_any(void);
-void refresh_tree_item(class Fl_Tree_Item* it);
+void refresh_tree_item(int node);
 void tree_cb(Fl_Widget* w, void*);
 
 // Dock button functions
@@ -0,0 +1,139 @@
+#include "line_layout.hpp"
+#include "globals.hpp"
+#include "editor_window.hpp"
+#include <FL/Fl.H>
+#include <FL/Fl_Text_Buffer.H>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Byte length of each line of the shown document
+static Fl_Text_Buffer* measured_doc = nullptr;
+static std::vector<int> line_lengths;
+static size_t long_lines = 0;   // how many are longer than LONG_LINE_COLUMNS
+static bool long_mode = false;  // as the editor is set up
+// A line and where it starts, to find other lines from nearby
+static int anchor_line = 0, anchor_pos = 0;
+
+// Lengths of the '\n' separated pieces of text
+static void split_lengths(const char* text, int length, std::vector<int>& out) {
+    const char* p = text;
+    const char* end = text + length;
+    for (;;) {
+        const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+        out.push_back(static_cast<int>((nl ? nl : end) - p));
+        if (!nl) break;
+        p = nl + 1;
+    }
+}
+
+// The line holding `pos` and where it starts, walking the lengths from
+// the anchor
+static int find_line(int pos, int& start) {
+    int line = anchor_line;
+    start = anchor_pos;
+    if (line >= (int)line_lengths.size()) line = start = 0;
+    while (line > 0 && pos < start) {
+        --line;
+        start -= line_lengths[line] + 1;
+    }
+    while (line + 1 < (int)line_lengths.size() && pos > start + line_lengths[line]) {
+        start += line_lengths[line] + 1;
+        ++line;
+    }
+    anchor_line = line;
+    anchor_pos = start;
+    return line;
+}
+
+static void set_wrap_mode(bool long_now) {
+    long_mode = long_now;
+    // Wrapping a line means measuring all of it on every change
+    if (editor) editor->wrap_mode(long_mode ? Fl_Text_Display::WRAP_NONE : Fl_Text_Display::WRAP_AT_BOUNDS, 0);
+}
+
+static void follow_long_lines(void*) {
+    if ((long_lines > 0) != long_mode) {
+        set_wrap_mode(long_lines > 0);
+        style_init();  // highlighting is off in long-line mode
+        update_status();
+    }
+}
+
+static void layout_modified(int pos, int inserted, int deleted, int, const char* deleted_text, void*) {
+    if (!inserted && !deleted) return;  // restyled only
+
+    // The lengths still describe the text before the edit
+    int start;
+    int line = find_line(pos, start);
+    int column = pos - start;
+    int old_lines = 1, after_newline = -1;
+    for (int i = 0; deleted_text && i < deleted; ++i) {
+        if (deleted_text[i] == '\n') {
+            ++old_lines;
+            after_newline = deleted - i - 1;
+        }
+    }
+    old_lines = std::min(old_lines, (int)line_lengths.size() - line);
+    int last = line + old_lines - 1;
+    // What followed the deleted text on its last line
+    int rest = line_lengths[last] - (after_newline < 0 ? column + deleted : after_newline);
+
+    std::vector<int> fresh;
+    char* text = measured_doc->text_range(pos, pos + inserted);
+    split_lengths(text ? text : "", text ? inserted : 0, fresh);
+    free(text);
+    fresh.front() += column;
+    fresh.back() += std::max(rest, 0);
+
+    for (int i = line; i <= last; ++i) long_lines -= line_lengths[i] > LONG_LINE_COLUMNS;
+    for (int length : fresh) long_lines += length > LONG_LINE_COLUMNS;
+    if ((int)fresh.size() == old_lines) {
+        std::copy(fresh.begin(), fresh.end(), line_lengths.begin() + line);
+    } else {
+        line_lengths.erase(line_lengths.begin() + line, line_lengths.begin() + last + 1);
+        line_lengths.insert(line_lengths.begin() + line, fresh.begin(), fresh.end());
+    }
+
+    // The wrap mode changes once the display is done with this edit
+    if ((long_lines > 0) != long_mode) {
+        Fl::remove_timeout(follow_long_lines);
+        Fl::add_timeout(0.0, follow_long_lines);
+    }
+}
+
+void line_layout_attach(Fl_Text_Buffer* doc) {
+    if (measured_doc == doc) return;
+    if (measured_doc) measured_doc->remove_modify_callback(layout_modified, nullptr);
+    doc->add_modify_callback(layout_modified, nullptr);
+    measured_doc = doc;
+
+    line_lengths.clear();
+    char* text = doc->text();
+    split_lengths(text ? text : "", text ? doc->length() : 0, line_lengths);
+    free(text);
+    long_lines = 0;
+    for (int length : line_lengths) long_lines += length > LONG_LINE_COLUMNS;
+    anchor_line = anchor_pos = 0;
+    if ((long_lines > 0) != long_mode) set_wrap_mode(long_lines > 0);
+}
+
+bool long_line_mode() {
+    return long_mode;
+}
+
+void line_layout_locate(int pos, int& line, int& column) {
+    if (line_lengths.empty()) {
+        line = column = 0;
+        return;
+    }
+    int start;
+    line = find_line(pos, start);
+    column = pos - start;
+}
+
+int line_layout_line_count(Fl_Text_Buffer* doc) {
+    if (doc != measured_doc) return doc->count_lines(0, doc->length()) + 1;
+    return (int)line_lengths.size();
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+class Fl_Text_Buffer;
+
+// Lines longer than this many bytes put a document in long-line mode: it
+// is shown without wrapping or highlighting
+const int LONG_LINE_COLUMNS = 4096;
+
+// Measure the lines of `doc`, which the editor is about to show, and keep
+// the measurements in step with its edits: an edit costs the text it
+// inserted and deleted, never a rescan of its line. The editor's wrap mode
+// follows whether any line is long.
+void line_layout_attach(Fl_Text_Buffer* doc);
+
+// Whether the shown document is in long-line mode
+bool long_line_mode();
+
+// Line and column, from 0, of `pos` in the shown document, found from the
+// measured lengths rather than by counting through the text
+void line_layout_locate(int pos, int& line, int& column);
+
+// Lines in `doc`; counted from the measurements if it is the shown document
+int line_layout_line_count(Fl_Text_Buffer* doc);
@@ -0,0 +1,139 @@
+#include "lz_codec.hpp"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace LzCodec {
+
+// Stream layout: varint original size, then sequences of
+//   token (literal count << 4 | match length - 4), extra literal count
+//   bytes, literals, 2-byte offset, extra match length bytes.
+// Counts of 15 continue in following bytes (runs of 255 plus a remainder).
+// The final sequence has literals only and ends the stream.
+
+static const int HASH_BITS = 16;
+static const size_t MIN_MATCH = 4;
+static const size_t MAX_OFFSET = 65535;
+static const size_t TAIL_LITERALS = 8;
+static const size_t MAX_EXPANSION = 255;  // output bytes per stream byte, at most
+
+static inline uint32_t read32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash32(uint32_t v) {
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static void put_count(std::string& out, size_t n) {
+    while (n >= 255) {
+        out += static_cast<char>(255);
+        n -= 255;
+    }
+    out += static_cast<char>(n);
+}
+
+static void put_sequence(std::string& out, const unsigned char* lit, size_t lit_len,
+                         size_t offset, size_t match_len) {
+    size_t m = match_len ? match_len - MIN_MATCH : 0;
+    unsigned char token = static_cast<unsigned char>(
+        ((lit_len < 15 ? lit_len : 15) << 4) | (m < 15 ? m : 15));
+    out += static_cast<char>(token);
+    if (lit_len >= 15) put_count(out, lit_len - 15);
+    out.append(reinterpret_cast<const char*>(lit), lit_len);
+    if (!match_len) return;
+    out += static_cast<char>(offset & 0xFF);
+    out += static_cast<char>(offset >> 8);
+    if (m >= 15) put_count(out, m - 15);
+}
+
+std::string compress(const char* data, size_t size) {
+    std::string out;
+    out.reserve(size / 2 + 16);
+    for (size_t n = size; ; n >>= 7) {
+        if (n < 0x80) { out += static_cast<char>(n); break; }
+        out += static_cast<char>((n & 0x7F) | 0x80);
+    }
+
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(data);
+    std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0); // position + 1, 0 = empty
+    size_t anchor = 0, ip = 0;
+    const size_t limit = size > TAIL_LITERALS ? size - TAIL_LITERALS : 0;
+    while (ip < limit) {
+        uint32_t seq = read32(in + ip);
+        uint32_t& slot = table[hash32(seq)];
+        size_t cand = slot;
+        slot = static_cast<uint32_t>(ip + 1);
+        if (cand && ip - (cand - 1) <= MAX_OFFSET && read32(in + cand - 1) == seq) {
+            size_t ref = cand - 1;
+            size_t len = MIN_MATCH;
+            while (ip + len < size && in[ref + len] == in[ip + len]) ++len;
+            put_sequence(out, in + anchor, ip - anchor, ip - ref, len);
+            ip += len;
+            anchor = ip;
+        } else {
+            // Skip faster through data that does not compress
+            ip += 1 + ((ip - anchor) >> 6);
+        }
+    }
+    put_sequence(out, in + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+static bool get_count(const std::string& s, size_t& p, size_t& n) {
+    unsigned char b;
+    do {
+        if (p >= s.size()) return false;
+        b = static_cast<unsigned char>(s[p++]);
+        n += b;
+    } while (b == 255);
+    return true;
+}
+
+bool decompress(const std::string& packed, std::string& out) {
+    size_t p = 0, size = 0;
+    for (int shift = 0; ; shift += 7) {
+        if (p >= packed.size() || shift > 63) return false;
+        unsigned char b = static_cast<unsigned char>(packed[p++]);
+        size |= static_cast<size_t>(b & 0x7F) << shift;
+        if (!(b & 0x80)) break;
+    }
+    // No stream byte stands for more than 255 output bytes, so a larger
+    // size is corrupt and must not reach resize()
+    if (size / MAX_EXPANSION > packed.size() - p) return false;
+    out.resize(size);
+    char* dst = size ? &out[0] : nullptr;
+    size_t op = 0;
+
+    while (p < packed.size()) {
+        unsigned char token = static_cast<unsigned char>(packed[p++]);
+        size_t lit = token >> 4;
+        if (lit == 15 && !get_count(packed, p, lit)) return false;
+        if (lit > packed.size() - p || lit > size - op) return false;
+        if (lit) memcpy(dst + op, packed.data() + p, lit);
+        p += lit;
+        op += lit;
+        if (p == packed.size()) break; // final literal run
+
+        if (packed.size() - p < 2) return false;
+        size_t offset = static_cast<unsigned char>(packed[p]) |
+                        (static_cast<size_t>(static_cast<unsigned char>(packed[p + 1])) << 8);
+        p += 2;
+        size_t len = token & 15;
+        if (len == 15 && !get_count(packed, p, len)) return false;
+        len += MIN_MATCH;
+        if (offset == 0 || offset > op || len > size - op) return false;
+        const char* ref = dst + op - offset;
+        if (offset >= len) {
+            memcpy(dst + op, ref, len);
+        } else {
+            for (size_t i = 0; i < len; ++i) dst[op + i] = ref[i]; // overlapping run
+        }
+        op += len;
+    }
+    return op == size;
+}
+
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Small LZ77 block codec in the spirit of LZ4: byte-aligned sequences of
+// literals plus (offset, length) back-references within a 64 KB window.
+// Built for speed on source text rather than ratio.
+namespace LzCodec {
+    std::string compress(const char* data, size_t size);
+
+    // False if `packed` is truncated or corrupt
+    bool decompress(const std::string& packed, std::string& out);
+}
@@ -0,0 +1,135 @@
+#include "path_index.hpp"
+#include <FL/Fl.H>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+// Builds in flight check the generation and give up once it moves on
+static std::atomic<unsigned> index_generation{0};
+static std::mutex index_mutex;
+static std::shared_ptr<const PathIndex> finished_index;
+
+std::string_view PathIndex::path(size_t i) const {
+    return std::string_view(paths.data() + starts[i]);
+}
+
+static char fold(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// Symlinked directories are listed but not entered, so a link back up the
+// tree cannot loop
+static bool enter_dir(DIR* d, const struct dirent* e) {
+#ifdef _DIRENT_HAVE_D_TYPE
+    if (e->d_type == DT_DIR) return true;
+    if (e->d_type != DT_UNKNOWN) return false;
+#endif
+    struct stat st;
+    return fstatat(dirfd(d), e->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+}
+
+static void add_path(PathIndex& index, const std::string& rel, size_t name_offset, bool is_dir) {
+    index.starts.push_back(index.paths.size());
+    index.name_offsets.push_back((uint32_t)name_offset);
+    index.dirs.push_back(is_dir);
+    index.paths.append(rel).push_back('\0');
+    for (char c : rel) index.folded.push_back(fold(c));
+    index.folded.push_back('\0');
+}
+
+static bool index_dir(DIR* d, const std::string& rel, ScanFilter filter, unsigned generation, PathIndex& index) {
+    if (index_generation.load(std::memory_order_relaxed) != generation) return false;
+
+    struct Entry {
+        std::string name;
+        bool is_dir;
+        bool enter;
+    };
+    std::vector<Entry> entries;
+    while (struct dirent* e = readdir(d)) {
+        if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) continue;
+        int is_dir = dir_entry_is_dir(d, e);
+        if (is_dir < 0 || !filter(e->d_name, is_dir == 1)) continue;
+        entries.push_back({e->d_name, is_dir == 1, is_dir == 1 && enter_dir(d, e)});
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        if (a.is_dir != b.is_dir) return a.is_dir;
+        return a.name < b.name;
+    });
+
+    for (const Entry& entry : entries) {
+        std::string path = rel.empty() ? entry.name : rel + "/" + entry.name;
+        add_path(index, path, path.size() - entry.name.size(), entry.is_dir);
+        if (!entry.enter) continue;
+        if (DIR* sub = open_dir_at(dirfd(d), entry.name.c_str())) {
+            bool going = index_dir(sub, path, filter, generation, index);
+            closedir(sub);
+            if (!going) return false;
+        }
+    }
+    return true;
+}
+
+void build_path_index(const std::string& folder, ScanFilter filter, ScanReady ready) {
+    unsigned generation = ++index_generation;
+    std::thread([folder, filter, ready, generation] {
+        auto index = std::make_shared<PathIndex>();
+        index->folder = folder;
+        DIR* d = open_dir_at(AT_FDCWD, folder.c_str());
+        bool done = d && index_dir(d, "", filter, generation, *index);
+        if (d) closedir(d);
+        if (!done) return;
+        {
+            std::lock_guard<std::mutex> lock(index_mutex);
+            if (index_generation != generation) return;
+            finished_index = std::move(index);
+        }
+        Fl::awake(ready, nullptr);
+    }).detach();
+}
+
+std::shared_ptr<const PathIndex> finished_path_index() {
+    std::lock_guard<std::mutex> lock(index_mutex);
+    return finished_index;
+}
+
+void PathFilter::reset() {
+    index_.reset();
+    query_.clear();
+    matches_.clear();
+}
+
+const std::vector<uint32_t>& PathFilter::update(const std::shared_ptr<const PathIndex>& index,
+                                                const std::string& query) {
+    std::string folded;
+    for (char c : query) folded.push_back(fold(c));
+    bool in_path = folded.find('/') != std::string::npos;
+
+    // Every match of the longer query matched the shorter one
+    bool narrowing = index == index_ && !query_.empty() && folded.size() >= query_.size() &&
+                     !folded.compare(0, query_.size(), query_) &&
+                     in_path == (query_.find('/') != std::string::npos);
+    std::vector<uint32_t> candidates;
+    if (narrowing) {
+        candidates.swap(matches_);
+    } else {
+        candidates.resize(index ? index->size() : 0);
+        for (size_t i = 0; i < candidates.size(); ++i) candidates[i] = (uint32_t)i;
+    }
+
+    matches_.clear();
+    if (index && !folded.empty()) {
+        for (uint32_t i : candidates) {
+            std::string_view path(index->folded.data() + index->starts[i]);
+            if (path.find(folded, in_path ? 0 : index->name_offsets[i]) != std::string_view::npos)
+                matches_.push_back(i);
+        }
+    }
+    index_ = index;
+    query_ = folded;
+    return matches_;
+}
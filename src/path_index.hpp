@@ -0,0 +1,43 @@
+#pragma once
+#include "dir_scanner.hpp"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Every entry the file tree would list under a folder, read on a background
+// thread so that filtering the tree never touches the disk. Paths are
+// relative to the folder and in tree order: each directory's entries follow
+// it, directories first, then by name.
+struct PathIndex {
+    std::string folder;
+    std::string paths;          // each path followed by '\0'
+    std::string folded;         // the same, ASCII lowercased, for matching
+    std::vector<size_t> starts; // where each path begins
+    std::vector<uint32_t> name_offsets;  // where its last component begins
+    std::vector<bool> dirs;
+
+    size_t size() const { return starts.size(); }
+    std::string_view path(size_t i) const;
+};
+
+// Read the index of `folder` on a background thread and post `ready`
+// through Fl::awake when it is done. Starting another build abandons this one.
+void build_path_index(const std::string& folder, ScanFilter filter, ScanReady ready);
+
+// Main thread: the index the last build produced, once it is done
+std::shared_ptr<const PathIndex> finished_path_index();
+
+// Narrows an index as a query grows. A query extending the previous one is
+// matched against the previous matches only. A query with a '/' matches
+// anywhere in the path, any other only in the entry's name; case is ignored.
+class PathFilter {
+public:
+    const std::vector<uint32_t>& update(const std::shared_ptr<const PathIndex>& index, const std::string& query);
+    void reset();
+
+private:
+    std::shared_ptr<const PathIndex> index_;
+    std::string query_;  // folded
+    std::vector<uint32_t> matches_;
+};
@@ -1,9 +1,12 @@
 #include "tab_bar.hpp"
 #include "globals.hpp"
 #include "colors.hpp"
+#include "tab_memory.hpp"
 #include <FL/fl_draw.H>
 #include <FL/Fl.H>
+#include <FL/filename.H>
 #include <algorithm>
+#include <cstdio>
 #include <filesystem>
 #include <fstream>
 #include <sstream>
@@ -69,7 +72,7 @@ void TabButton::draw() {
 
     // Draw filename
     fl_color(text_color);
-    fl_font(FL_HELVETICA, 13);
+    fl_font(tab->saving ? FL_HELVETICA_ITALIC : FL_HELVETICA, 13);  // italic while being written
 
     std::string display_name = tab->filename;
     if (tab->is_modified) {
@@ -126,9 +129,11 @@ TabBar::~TabBar() {
     }
 }
 
-void TabBar::add_tab(const std::string& filename, const std::string& filepath) {
+void TabBar::add_tab(const std::string& filename, const std::string& filepath,
+                     Fl_Text_Buffer* content) {
     // Check if tab already exists
     if (find_tab_by_filepath(filepath)) {
+        delete content;
         set_active_tab(filepath);
         return;
     }
@@ -146,11 +151,11 @@ void TabBar::add_tab(const std::string& filename, const std::string& filepath) {
     }
     
     // Create new tab
-    Tab* new_tab = new Tab(display_name, filepath, true);
+    Tab* new_tab = new Tab(display_name, filepath, true, false, content);
     tabs.push_back(new_tab);
     
     // Load file content into the tab's buffer
-    if (std::filesystem::exists(filepath)) {
+    if (!content && std::filesystem::exists(filepath)) {
         new_tab->buffer->loadfile(filepath.c_str());
     }
     
@@ -161,6 +166,14 @@ void TabBar::add_tab(const std::string& filename, const std::string& filepath) {
     }
 }
 
+void TabBar::add_stub_tab(const std::string& filepath) {
+    if (find_tab_by_filepath(filepath)) return;
+    Tab* stub = new Tab(std::filesystem::path(filepath).filename().string(), filepath);
+    stub->loaded = false;
+    tabs.push_back(stub);
+    relayout_tabs();
+}
+
 void TabBar::remove_tab(const std::string& filepath) {
     int index = find_tab_index_by_filepath(filepath);
     if (index == -1) return;
@@ -185,6 +198,21 @@ void TabBar::remove_tab(const std::string& filepath) {
     redraw();
 }
 
+void TabBar::move_tab_path(const std::string& from, const std::string& to) {
+    bool moved = false;
+    for (Tab* tab : tabs) {
+        const std::string& path = tab->filepath;
+        bool inside = path.size() > from.size() && path[from.size()] == '/' && !path.compare(0, from.size(), from);
+        if (path != from && !inside) continue;
+        std::string old_path = path;
+        tab->filepath = to + old_path.substr(from.size());
+        tab->filename = std::filesystem::path(tab->filepath).filename().string();
+        moved = true;
+        if (on_tab_moved) on_tab_moved(old_path, tab->filepath);
+    }
+    if (moved) relayout_tabs();
+}
+
 void TabBar::set_active_tab(const std::string& filepath) {
     for (Tab* tab : tabs) {
         tab->is_active = (tab->filepath == filepath);
@@ -197,6 +225,7 @@ void TabBar::update_tab_modified(const std::string& filepath, bool modified) {
     Tab* tab = find_tab_by_filepath(filepath);
     if (tab) {
         tab->is_modified = modified;
+        if (modified) tab->revision++;
         redraw();
     }
 }
@@ -210,6 +239,10 @@ Tab* TabBar::get_active_tab() {
     return nullptr;
 }
 
+Tab* TabBar::get_tab(const std::string& filepath) {
+    return find_tab_by_filepath(filepath);
+}
+
 std::vector<Tab*> TabBar::get_all_tabs() {
     return tabs;
 }
@@ -285,6 +318,14 @@ void TabBar::create_tab_buttons() {
             }
         };
         
+        // Path and how much of the document is held in memory
+        char size[32], tip[FL_PATH_MAX + 64];
+        format_bytes(tab_resident_bytes(tab), size, sizeof(size));
+        if (tab->loaded) snprintf(tip, sizeof(tip), "%s\n%s in memory", tab->filepath.c_str(), size);
+        else if (!tab->packed.empty()) snprintf(tip, sizeof(tip), "%s\n%s in memory (compressed)", tab->filepath.c_str(), size);
+        else snprintf(tip, sizeof(tip), "%s\nNot loaded", tab->filepath.c_str());
+        btn->copy_tooltip(tip);
+        
         add(btn);
         tab_buttons.push_back(btn);
         current_x += tab_width;
@@ -514,10 +555,10 @@ void TabBar::load_tab_state() {
     
     file.close();
     
-    // Load tabs
+    // Restore tabs as stubs; only the active one is read now
     for (const std::string& filepath : tab_filepaths) {
         if (std::filesystem::exists(filepath)) {
-            add_tab("", filepath);
+            add_stub_tab(filepath);
         }
     }
     
@@ -13,17 +13,29 @@ struct Tab {
     std::string filepath;
     bool is_active;
     bool is_modified;
-    Fl_Text_Buffer* buffer;
+    Fl_Text_Buffer* buffer;        // the document; the editor shows it directly
+    Fl_Text_Buffer* style_buffer;  // syntax styles for buffer
+    int insert_position = 0;       // cursor restored when the tab is shown again
+    bool loaded = true;            // false for a restored or evicted tab whose text is not in buffer
+    std::string packed;            // compressed text of an evicted tab with unsaved edits
+    unsigned long last_used = 0;   // activation order, oldest is evicted first
+    unsigned long revision = 0;    // bumped on every edit; a save only clears edits it includes
+    bool saving = false;           // a save of this file is being written
+    bool close_after_save = false; // closed with "Save": goes once the save succeeds
+    long long disk_size = -1;      // file size and mtime (ns) when last read or written,
+    long long disk_mtime = 0;      // to tell changes made by others from our own
+    bool disk_changed = false;     // file changed on disk while the tab had unsaved edits
     
-    Tab(const std::string& file, const std::string& path, bool active = false, bool modified = false)
+    Tab(const std::string& file, const std::string& path, bool active = false, bool modified = false,
+        Fl_Text_Buffer* content = nullptr)
         : filename(file), filepath(path), is_active(active), is_modified(modified) {
-        buffer = new Fl_Text_Buffer();
+        buffer = content ? content : new Fl_Text_Buffer();
+        style_buffer = new Fl_Text_Buffer();
     }
     
     ~Tab() {
-        if (buffer) {
-            delete buffer;
-        }
+        delete buffer;
+        delete style_buffer;
     }
 };
 
@@ -50,13 +62,22 @@ public:
     ~TabBar();
     
     // Tab management
-    void add_tab(const std::string& filename, const std::string& filepath);
+    // The tab takes ownership of `content` (freed if the tab already exists);
+    // without it the file is read from disk
+    void add_tab(const std::string& filename, const std::string& filepath,
+                 Fl_Text_Buffer* content = nullptr);
+    // Restored tab holding only its path; the file is read on first activation
+    void add_stub_tab(const std::string& filepath);
     void remove_tab(const std::string& filepath);
     void set_active_tab(const std::string& filepath);
     void update_tab_modified(const std::string& filepath, bool modified);
+    // A file or folder was renamed or moved on disk: tabs of `from`, or of
+    // files inside it, take the new path; on_tab_moved is called for each
+    void move_tab_path(const std::string& from, const std::string& to);
     
     // Get current active tab
     Tab* get_active_tab();
+    Tab* get_tab(const std::string& filepath);
     std::vector<Tab*> get_all_tabs();
     
     // Buffer management
@@ -70,6 +91,7 @@ public:
     // Callbacks
     std::function<void(const std::string& filepath)> on_tab_selected;
     std::function<void(const std::string& filepath)> on_tab_closed;
+    // After move_tab_path, or with old_path == new_path after a tab was dragged
     std::function<void(const std::string& old_path, const std::string& new_path)> on_tab_moved;
     
     void relayout_tabs();
@@ -0,0 +1,142 @@
+#include "tab_memory.hpp"
+#include "globals.hpp"
+#include "edit_journal.hpp"
+#include "lz_codec.hpp"
+#include "tab_bar.hpp"
+#include "utils.hpp"
+#include <FL/Fl.H>
+#include <FL/Fl_Text_Buffer.H>
+#include <FL/filename.H>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static const size_t DEFAULT_TAB_BUDGET_MB = 256;
+static const double BUDGET_CHECK_DELAY = 0.5;
+
+static unsigned long use_clock = 0;
+static bool check_pending = false;
+
+const char* tab_budget_path() {
+    static char path[FL_PATH_MAX];
+    const char* home = getenv("HOME");
+    if (home) snprintf(path, sizeof(path), "%s/.flick_tab_budget", home);
+    else strncpy(path, ".flick_tab_budget", sizeof(path));
+    return path;
+}
+
+// Budget in megabytes; read once, 0 turns eviction off
+size_t load_tab_budget() {
+    static long mb = -1;
+    if (mb < 0) {
+        mb = (long)DEFAULT_TAB_BUDGET_MB;
+        FILE* fp = fopen(tab_budget_path(), "r");
+        if (fp) {
+            if (fscanf(fp, "%ld", &mb) != 1 || mb < 0) mb = (long)DEFAULT_TAB_BUDGET_MB;
+            fclose(fp);
+        }
+    }
+    return (size_t)mb * 1024 * 1024;
+}
+
+void format_bytes(size_t bytes, char* out, size_t size) {
+    if (bytes < 1024) snprintf(out, size, "%zu B", bytes);
+    else if (bytes < 1024 * 1024) snprintf(out, size, "%.1f KB", bytes / 1024.0);
+    else snprintf(out, size, "%.1f MB", bytes / (1024.0 * 1024.0));
+}
+
+size_t tab_resident_bytes(const Tab* tab) {
+    if (!tab->loaded) return tab->packed.size();
+    return (size_t)tab->buffer->length() + (size_t)tab->style_buffer->length();
+}
+
+size_t total_resident_bytes() {
+    size_t total = 0;
+    if (tab_bar) {
+        for (Tab* tab : tab_bar->get_all_tabs()) total += tab_resident_bytes(tab);
+    }
+    return total;
+}
+
+void touch_tab(Tab* tab) {
+    tab->last_used = ++use_clock;
+}
+
+// Fresh buffers give the memory back; text() on the old ones would keep
+// their undo history
+static void release_buffers(Tab* tab) {
+    journal_untrack(tab->buffer, tab->filepath);  // a journal of unsaved edits stays on disk
+    delete tab->buffer;
+    delete tab->style_buffer;
+    tab->buffer = new Fl_Text_Buffer();
+    tab->style_buffer = new Fl_Text_Buffer();
+    tab->loaded = false;
+}
+
+static void pack_tab(Tab* tab) {
+    char* text = tab->buffer->text();
+    tab->packed = LzCodec::compress(text, (size_t)tab->buffer->length());  // NUL bytes included
+    free(text);
+    release_buffers(tab);
+}
+
+bool unpack_tab(Tab* tab) {
+    if (tab->loaded || tab->packed.empty()) return false;
+    std::string text;
+    if (!LzCodec::decompress(tab->packed, text)) return false;
+    // Sized, so NUL bytes survive; not an edit the user can undo
+    tab->buffer->canUndo(0);
+    tab->buffer->insert(0, text.data(), (int)text.size());
+    tab->buffer->canUndo(1);
+    journal_track(tab->buffer, tab->filepath);
+    tab->packed.clear();
+    tab->packed.shrink_to_fit();
+    tab->loaded = true;
+    request_tab_budget_check();
+    return true;
+}
+
+Fl_Text_Buffer* resident_tab_buffer(Tab* tab) {
+    if (tab->loaded || unpack_tab(tab)) return tab->buffer;
+    return nullptr;
+}
+
+void enforce_tab_budget() {
+    size_t budget = load_tab_budget();
+    if (!tab_bar || !budget) return;
+    size_t total = total_resident_bytes();
+    if (total <= budget) return;
+
+    // Never the shown document, nor one still on its way in
+    std::vector<Tab*> candidates;
+    for (Tab* tab : tab_bar->get_all_tabs()) {
+        if (tab->loaded && !tab->is_active && tab->buffer != buffer)
+            candidates.push_back(tab);
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Tab* a, const Tab* b) { return a->last_used < b->last_used; });
+
+    for (Tab* tab : candidates) {
+        if (total <= budget) break;
+        size_t before = tab_resident_bytes(tab);
+        if (tab->is_modified) pack_tab(tab);
+        else release_buffers(tab);
+        total -= before - tab_resident_bytes(tab);
+    }
+}
+
+static void budget_check_cb(void*) {
+    check_pending = false;
+    enforce_tab_budget();
+    // Tab tooltips report the sizes; status bar shows the new total
+    if (tab_bar) tab_bar->relayout_tabs();
+    update_status();
+}
+
+void request_tab_budget_check() {
+    if (check_pending) return;
+    check_pending = true;
+    Fl::add_timeout(BUDGET_CHECK_DELAY, budget_check_cb);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+
+struct Tab;
+class Fl_Text_Buffer;
+
+// Memory budget for open documents. When tabs hold more than the budget,
+// inactive ones are released least recently used first: clean tabs drop
+// their text and are read from disk again, tabs with unsaved edits keep a
+// compressed copy that is unpacked when they are next needed.
+
+// Bytes held by a tab: text and styles, or its compressed copy
+size_t tab_resident_bytes(const Tab* tab);
+size_t total_resident_bytes();
+
+// Mark a tab as just used; the eviction order follows this
+void touch_tab(Tab* tab);
+
+// Restore a compressed tab's text into its buffer; false if it has none
+bool unpack_tab(Tab* tab);
+
+// Buffer holding a tab's current text (unpacking it if compressed), or
+// nullptr when its text only lives on disk
+Fl_Text_Buffer* resident_tab_buffer(Tab* tab);
+
+// Release inactive tabs until the budget is met; request_ runs it on the
+// next idle moment so bursts of activity only pay once
+void enforce_tab_budget();
+void request_tab_budget_check();
+
+size_t load_tab_budget();
+const char* tab_budget_path();
+void format_bytes(size_t bytes, char* out, size_t size);
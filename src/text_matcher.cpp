@@ -0,0 +1,268 @@
+#include "text_matcher.hpp"
+#include <algorithm>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace SearchReplace {
+
+// Simple case folding, statuses C and S of CaseFolding.txt (Unicode 14.0),
+// as runs of code points that fold by the same offset. A run with step 2
+// covers alternating upper/lower pairs: only every other code point folds.
+struct FoldRun {
+    uint32_t first, last;
+    uint8_t step;
+    int32_t delta;
+};
+
+static const FoldRun fold_runs[] = {
+    {0xB5, 0xB5, 1, 775}, {0xC0, 0xD6, 1, 32}, {0xD8, 0xDE, 1, 32},
+    {0x100, 0x12E, 2, 1}, {0x132, 0x136, 2, 1}, {0x139, 0x147, 2, 1},
+    {0x14A, 0x176, 2, 1}, {0x178, 0x178, 1, -121}, {0x179, 0x17D, 2, 1},
+    {0x17F, 0x17F, 1, -268}, {0x181, 0x181, 1, 210}, {0x182, 0x184, 2, 1},
+    {0x186, 0x186, 1, 206}, {0x187, 0x187, 1, 1}, {0x189, 0x18A, 1, 205},
+    {0x18B, 0x18B, 1, 1}, {0x18E, 0x18E, 1, 79}, {0x18F, 0x18F, 1, 202},
+    {0x190, 0x190, 1, 203}, {0x191, 0x191, 1, 1}, {0x193, 0x193, 1, 205},
+    {0x194, 0x194, 1, 207}, {0x196, 0x196, 1, 211}, {0x197, 0x197, 1, 209},
+    {0x198, 0x198, 1, 1}, {0x19C, 0x19C, 1, 211}, {0x19D, 0x19D, 1, 213},
+    {0x19F, 0x19F, 1, 214}, {0x1A0, 0x1A4, 2, 1}, {0x1A6, 0x1A6, 1, 218},
+    {0x1A7, 0x1A7, 1, 1}, {0x1A9, 0x1A9, 1, 218}, {0x1AC, 0x1AC, 1, 1},
+    {0x1AE, 0x1AE, 1, 218}, {0x1AF, 0x1AF, 1, 1}, {0x1B1, 0x1B2, 1, 217},
+    {0x1B3, 0x1B5, 2, 1}, {0x1B7, 0x1B7, 1, 219}, {0x1B8, 0x1B8, 1, 1},
+    {0x1BC, 0x1BC, 1, 1}, {0x1C4, 0x1C4, 1, 2}, {0x1C5, 0x1C5, 1, 1},
+    {0x1C7, 0x1C7, 1, 2}, {0x1C8, 0x1C8, 1, 1}, {0x1CA, 0x1CA, 1, 2},
+    {0x1CB, 0x1DB, 2, 1}, {0x1DE, 0x1EE, 2, 1}, {0x1F1, 0x1F1, 1, 2},
+    {0x1F2, 0x1F4, 2, 1}, {0x1F6, 0x1F6, 1, -97}, {0x1F7, 0x1F7, 1, -56},
+    {0x1F8, 0x21E, 2, 1}, {0x220, 0x220, 1, -130}, {0x222, 0x232, 2, 1},
+    {0x23A, 0x23A, 1, 10795}, {0x23B, 0x23B, 1, 1}, {0x23D, 0x23D, 1, -163},
+    {0x23E, 0x23E, 1, 10792}, {0x241, 0x241, 1, 1}, {0x243, 0x243, 1, -195},
+    {0x244, 0x244, 1, 69}, {0x245, 0x245, 1, 71}, {0x246, 0x24E, 2, 1},
+    {0x345, 0x345, 1, 116}, {0x370, 0x372, 2, 1}, {0x376, 0x376, 1, 1},
+    {0x37F, 0x37F, 1, 116}, {0x386, 0x386, 1, 38}, {0x388, 0x38A, 1, 37},
+    {0x38C, 0x38C, 1, 64}, {0x38E, 0x38F, 1, 63}, {0x391, 0x3A1, 1, 32},
+    {0x3A3, 0x3AB, 1, 32}, {0x3C2, 0x3C2, 1, 1}, {0x3CF, 0x3CF, 1, 8},
+    {0x3D0, 0x3D0, 1, -30}, {0x3D1, 0x3D1, 1, -25}, {0x3D5, 0x3D5, 1, -15},
+    {0x3D6, 0x3D6, 1, -22}, {0x3D8, 0x3EE, 2, 1}, {0x3F0, 0x3F0, 1, -54},
+    {0x3F1, 0x3F1, 1, -48}, {0x3F4, 0x3F4, 1, -60}, {0x3F5, 0x3F5, 1, -64},
+    {0x3F7, 0x3F7, 1, 1}, {0x3F9, 0x3F9, 1, -7}, {0x3FA, 0x3FA, 1, 1},
+    {0x3FD, 0x3FF, 1, -130}, {0x400, 0x40F, 1, 80}, {0x410, 0x42F, 1, 32},
+    {0x460, 0x480, 2, 1}, {0x48A, 0x4BE, 2, 1}, {0x4C0, 0x4C0, 1, 15},
+    {0x4C1, 0x4CD, 2, 1}, {0x4D0, 0x52E, 2, 1}, {0x531, 0x556, 1, 48},
+    {0x10A0, 0x10C5, 1, 7264}, {0x10C7, 0x10C7, 1, 7264},
+    {0x10CD, 0x10CD, 1, 7264}, {0x13F8, 0x13FD, 1, -8},
+    {0x1C80, 0x1C80, 1, -6222}, {0x1C81, 0x1C81, 1, -6221},
+    {0x1C82, 0x1C82, 1, -6212}, {0x1C83, 0x1C84, 1, -6210},
+    {0x1C85, 0x1C85, 1, -6211}, {0x1C86, 0x1C86, 1, -6204},
+    {0x1C87, 0x1C87, 1, -6180}, {0x1C88, 0x1C88, 1, 35267},
+    {0x1C90, 0x1CBA, 1, -3008}, {0x1CBD, 0x1CBF, 1, -3008},
+    {0x1E00, 0x1E94, 2, 1}, {0x1E9B, 0x1E9B, 1, -58},
+    {0x1E9E, 0x1E9E, 1, -7615}, {0x1EA0, 0x1EFE, 2, 1},
+    {0x1F08, 0x1F0F, 1, -8}, {0x1F18, 0x1F1D, 1, -8}, {0x1F28, 0x1F2F, 1, -8},
+    {0x1F38, 0x1F3F, 1, -8}, {0x1F48, 0x1F4D, 1, -8}, {0x1F59, 0x1F5F, 2, -8},
+    {0x1F68, 0x1F6F, 1, -8}, {0x1F88, 0x1F8F, 1, -8}, {0x1F98, 0x1F9F, 1, -8},
+    {0x1FA8, 0x1FAF, 1, -8}, {0x1FB8, 0x1FB9, 1, -8}, {0x1FBA, 0x1FBB, 1, -74},
+    {0x1FBC, 0x1FBC, 1, -9}, {0x1FBE, 0x1FBE, 1, -7173},
+    {0x1FC8, 0x1FCB, 1, -86}, {0x1FCC, 0x1FCC, 1, -9}, {0x1FD8, 0x1FD9, 1, -8},
+    {0x1FDA, 0x1FDB, 1, -100}, {0x1FE8, 0x1FE9, 1, -8},
+    {0x1FEA, 0x1FEB, 1, -112}, {0x1FEC, 0x1FEC, 1, -7},
+    {0x1FF8, 0x1FF9, 1, -128}, {0x1FFA, 0x1FFB, 1, -126},
+    {0x1FFC, 0x1FFC, 1, -9}, {0x2126, 0x2126, 1, -7517},
+    {0x212A, 0x212A, 1, -8383}, {0x212B, 0x212B, 1, -8262},
+    {0x2132, 0x2132, 1, 28}, {0x2160, 0x216F, 1, 16}, {0x2183, 0x2183, 1, 1},
+    {0x24B6, 0x24CF, 1, 26}, {0x2C00, 0x2C2F, 1, 48}, {0x2C60, 0x2C60, 1, 1},
+    {0x2C62, 0x2C62, 1, -10743}, {0x2C63, 0x2C63, 1, -3814},
+    {0x2C64, 0x2C64, 1, -10727}, {0x2C67, 0x2C6B, 2, 1},
+    {0x2C6D, 0x2C6D, 1, -10780}, {0x2C6E, 0x2C6E, 1, -10749},
+    {0x2C6F, 0x2C6F, 1, -10783}, {0x2C70, 0x2C70, 1, -10782},
+    {0x2C72, 0x2C72, 1, 1}, {0x2C75, 0x2C75, 1, 1},
+    {0x2C7E, 0x2C7F, 1, -10815}, {0x2C80, 0x2CE2, 2, 1},
+    {0x2CEB, 0x2CED, 2, 1}, {0x2CF2, 0x2CF2, 1, 1}, {0xA640, 0xA66C, 2, 1},
+    {0xA680, 0xA69A, 2, 1}, {0xA722, 0xA72E, 2, 1}, {0xA732, 0xA76E, 2, 1},
+    {0xA779, 0xA77B, 2, 1}, {0xA77D, 0xA77D, 1, -35332},
+    {0xA77E, 0xA786, 2, 1}, {0xA78B, 0xA78B, 1, 1},
+    {0xA78D, 0xA78D, 1, -42280}, {0xA790, 0xA792, 2, 1},
+    {0xA796, 0xA7A8, 2, 1}, {0xA7AA, 0xA7AA, 1, -42308},
+    {0xA7AB, 0xA7AB, 1, -42319}, {0xA7AC, 0xA7AC, 1, -42315},
+    {0xA7AD, 0xA7AD, 1, -42305}, {0xA7AE, 0xA7AE, 1, -42308},
+    {0xA7B0, 0xA7B0, 1, -42258}, {0xA7B1, 0xA7B1, 1, -42282},
+    {0xA7B2, 0xA7B2, 1, -42261}, {0xA7B3, 0xA7B3, 1, 928},
+    {0xA7B4, 0xA7C2, 2, 1}, {0xA7C4, 0xA7C4, 1, -48},
+    {0xA7C5, 0xA7C5, 1, -42307}, {0xA7C6, 0xA7C6, 1, -35384},
+    {0xA7C7, 0xA7C9, 2, 1}, {0xA7D0, 0xA7D0, 1, 1}, {0xA7D6, 0xA7D8, 2, 1},
+    {0xA7F5, 0xA7F5, 1, 1}, {0xAB70, 0xABBF, 1, -38864},
+    {0xFF21, 0xFF3A, 1, 32}, {0x10400, 0x10427, 1, 40},
+    {0x104B0, 0x104D3, 1, 40}, {0x10570, 0x1057A, 1, 39},
+    {0x1057C, 0x1058A, 1, 39}, {0x1058C, 0x10592, 1, 39},
+    {0x10594, 0x10595, 1, 39}, {0x10C80, 0x10CB2, 1, 64},
+    {0x118A0, 0x118BF, 1, 32}, {0x16E40, 0x16E5F, 1, 32},
+    {0x1E900, 0x1E921, 1, 34},
+};
+
+uint32_t fold_codepoint(uint32_t cp) {
+    if (cp < 0x80) return ascii_lower(static_cast<unsigned char>(cp));
+    const FoldRun* end = fold_runs + sizeof(fold_runs) / sizeof(fold_runs[0]);
+    const FoldRun* run = std::upper_bound(fold_runs, end, cp,
+        [](uint32_t c, const FoldRun& r) { return c < r.first; });
+    if (run == fold_runs) return cp;
+    --run;
+    if (cp > run->last || (cp - run->first) % run->step) return cp;
+    return static_cast<uint32_t>(static_cast<int32_t>(cp) + run->delta);
+}
+
+// Decode one UTF-8 sequence. Invalid bytes decode to a value outside the
+// Unicode range so they only ever match themselves.
+static uint32_t decode_utf8(const unsigned char* s, size_t len, size_t* used) {
+    unsigned char c = s[0];
+    *used = 1;
+    if (c < 0x80) return c;
+    auto cont = [&](size_t i) { return i < len && (s[i] & 0xC0) == 0x80; };
+    if ((c & 0xE0) == 0xC0 && cont(1)) {
+        uint32_t cp = ((c & 0x1Fu) << 6) | (s[1] & 0x3Fu);
+        if (cp >= 0x80) { *used = 2; return cp; }
+    } else if ((c & 0xF0) == 0xE0 && cont(1) && cont(2)) {
+        uint32_t cp = ((c & 0x0Fu) << 12) | ((s[1] & 0x3Fu) << 6) | (s[2] & 0x3Fu);
+        if (cp >= 0x800) { *used = 3; return cp; }
+    } else if ((c & 0xF8) == 0xF0 && cont(1) && cont(2) && cont(3)) {
+        uint32_t cp = ((c & 0x07u) << 18) | ((s[1] & 0x3Fu) << 12) |
+                      ((s[2] & 0x3Fu) << 6) | (s[3] & 0x3Fu);
+        if (cp >= 0x10000 && cp < 0x110000) { *used = 4; return cp; }
+    }
+    return 0x110000 + c;
+}
+
+#if defined(__SSE2__)
+// Lowercase 'A'..'Z' in 16 bytes: shift the range to the bottom of the
+// signed byte domain so one signed compare selects it
+static inline __m128i fold16(__m128i x) {
+    __m128i shifted = _mm_add_epi8(x, _mm_set1_epi8(static_cast<char>(0x80 - 'A')));
+    __m128i upper = _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(-128 + 26)));
+    return _mm_or_si128(x, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+#endif
+
+Matcher::Matcher(const std::string& pattern, const Options& opts)
+    : pattern_(pattern), opts_(opts) {
+    if (opts_.match_case) return;
+    bool ascii = true;
+    for (unsigned char c : pattern_) {
+        if (c >= 0x80) { ascii = false; break; }
+    }
+    if (ascii) {
+        fold_ascii_ = true;
+        for (char& c : pattern_) c = static_cast<char>(ascii_lower(static_cast<unsigned char>(c)));
+        return;
+    }
+    utf8_ = true;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(pattern_.data());
+    size_t i = 0, used = 0;
+    while (i < pattern_.size()) {
+        folded_.push_back(fold_codepoint(decode_utf8(p + i, pattern_.size() - i, &used)));
+        i += used;
+    }
+}
+
+size_t Matcher::max_match_length() const {
+    return utf8_ ? folded_.size() * 4 : pattern_.size();
+}
+
+bool Matcher::word_bounded(const char* text, size_t len, size_t pos, size_t mlen) const {
+    if (!opts_.whole_word) return true;
+    const unsigned char* t = reinterpret_cast<const unsigned char*>(text);
+    const unsigned char first = pattern_.front(), last = pattern_.back();
+    // Only edges that are word characters need a boundary next to them
+    if (is_word_byte(first) && pos > 0 && is_word_byte(t[pos - 1])) return false;
+    if (is_word_byte(last) && pos + mlen < len && is_word_byte(t[pos + mlen])) return false;
+    return true;
+}
+
+size_t Matcher::find_bytes(const char* text, size_t len, size_t from) const {
+    const size_t m = pattern_.size();
+    if (m > len || from > len - m) return npos;
+    const unsigned char* t = reinterpret_cast<const unsigned char*>(text);
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(pattern_.data());
+    const bool fold = fold_ascii_;
+    auto middle_equal = [&](const unsigned char* at) {
+        if (!fold) return m < 3 || memcmp(at + 1, p + 1, m - 2) == 0;
+        for (size_t j = 1; j + 1 < m; ++j)
+            if (ascii_lower(at[j]) != p[j]) return false;
+        return true;
+    };
+
+    size_t i = from;
+#if defined(__SSE2__)
+    // Compare the first and last pattern byte against 16 candidate starts
+    // at once; only survivors of both filters are verified byte by byte
+    const __m128i vf = _mm_set1_epi8(static_cast<char>(p[0]));
+    const __m128i vl = _mm_set1_epi8(static_cast<char>(p[m - 1]));
+    for (; i + m - 1 + 16 <= len; i += 16) {
+        __m128i bf = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t + i));
+        __m128i bl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t + i + m - 1));
+        if (fold) {
+            bf = fold16(bf);
+            bl = fold16(bl);
+        }
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(bf, vf), _mm_cmpeq_epi8(bl, vl))));
+        while (mask) {
+            unsigned bit = static_cast<unsigned>(__builtin_ctz(mask));
+            if (middle_equal(t + i + bit)) return i + bit;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i + m <= len; ++i) {
+        unsigned char f = fold ? ascii_lower(t[i]) : t[i];
+        unsigned char l = fold ? ascii_lower(t[i + m - 1]) : t[i + m - 1];
+        if (f == p[0] && l == p[m - 1] && middle_equal(t + i)) return i;
+    }
+    return npos;
+}
+
+bool Matcher::match_utf8_at(const char* text, size_t len, size_t pos, size_t* match_len) const {
+    const unsigned char* t = reinterpret_cast<const unsigned char*>(text);
+    size_t i = pos, used = 0;
+    for (uint32_t want : folded_) {
+        if (i >= len) return false;
+        if (fold_codepoint(decode_utf8(t + i, len - i, &used)) != want) return false;
+        i += used;
+    }
+    *match_len = i - pos;
+    return true;
+}
+
+size_t Matcher::find_utf8(const char* text, size_t len, size_t from, size_t* match_len) const {
+    const unsigned char* t = reinterpret_cast<const unsigned char*>(text);
+    for (size_t i = from; i < len; ++i) {
+        if ((t[i] & 0xC0) == 0x80) continue; // not a sequence start
+        if (match_utf8_at(text, len, i, match_len)) return i;
+    }
+    return npos;
+}
+
+size_t Matcher::find(const char* text, size_t len, size_t from, size_t* match_len) const {
+    if (pattern_.empty()) return npos;
+    while (from <= len) {
+        size_t mlen = pattern_.size();
+        size_t pos = utf8_ ? find_utf8(text, len, from, &mlen) : find_bytes(text, len, from);
+        if (pos == npos) return npos;
+        if (word_bounded(text, len, pos, mlen)) {
+            if (match_len) *match_len = mlen;
+            return pos;
+        }
+        from = pos + 1;
+    }
+    return npos;
+}
+
+int Matcher::count(const char* text, size_t len) const {
+    int n = 0;
+    size_t pos = 0, mlen = 0;
+    while ((pos = find(text, len, pos, &mlen)) != npos) {
+        ++n;
+        pos += mlen ? mlen : 1;
+    }
+    return n;
+}
+
+}
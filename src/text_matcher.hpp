@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace SearchReplace {
+
+struct Options {
+    bool match_case = true;
+    bool whole_word = false;
+};
+
+// Word characters for whole-word matching; bytes >= 0x80 count as word
+// characters so multi-byte UTF-8 letters are never split
+inline bool is_word_byte(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+           (c >= 'A' && c <= 'Z') || c == '_' || c >= 0x80;
+}
+
+inline unsigned char ascii_lower(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+// Simple Unicode case folding: CaseFolding.txt statuses C and S, so U+0130
+// stays itself (its mapping to 'i' is the Turkic status T)
+uint32_t fold_codepoint(uint32_t cp);
+
+// Compiled single-pattern search. ASCII patterns use an SSE2 scan that folds
+// case on the fly; non-ASCII patterns without match_case take a UTF-8 path
+// that decodes and folds code points.
+class Matcher {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    Matcher(const std::string& pattern, const Options& opts = Options());
+
+    bool empty() const { return pattern_.empty(); }
+    const Options& options() const { return opts_; }
+
+    // Longest byte span a match can cover in the text
+    size_t max_match_length() const;
+
+    // Offset of the first match at or after `from`, or npos. The byte length
+    // of the match is stored in *match_len (it can differ from the pattern
+    // length when UTF-8 case folding maps between encodings of different size).
+    size_t find(const char* text, size_t len, size_t from, size_t* match_len) const;
+
+    int count(const char* text, size_t len) const;
+
+private:
+    size_t find_bytes(const char* text, size_t len, size_t from) const;
+    size_t find_utf8(const char* text, size_t len, size_t from, size_t* match_len) const;
+    bool match_utf8_at(const char* text, size_t len, size_t pos, size_t* match_len) const;
+    bool word_bounded(const char* text, size_t len, size_t pos, size_t mlen) const;
+
+    std::string pattern_;          // lowercased when case is ignored on the ASCII path
+    Options opts_;
+    bool fold_ascii_ = false;
+    bool utf8_ = false;
+    std::vector<uint32_t> folded_; // folded code points for the UTF-8 path
+};
+
+}
@@ -0,0 +1,430 @@
+#include "tree_view.hpp"
+#include <FL/fl_draw.H>
+#include <algorithm>
+
+static const int INDENT = 16;  // per level, and the width of the expander
+
+TreeView::TreeView(int X, int Y, int W, int H, const char* L)
+    : Fl_Group(X, Y, W, H, L) {
+    int sb = Fl::scrollbar_size();
+    vscroll_ = new Fl_Scrollbar(X + W - sb, Y, sb, H);
+    vscroll_->type(FL_VERTICAL);
+    vscroll_->callback(scroll_cb, this);
+    hscroll_ = new Fl_Scrollbar(X, Y + H - sb, W - sb, sb);
+    hscroll_->type(FL_HORIZONTAL);
+    hscroll_->callback(scroll_cb, this);
+    hscroll_->hide();
+    end();
+
+    color(FL_BACKGROUND2_COLOR);
+    selection_color(FL_SELECTION_COLOR);
+    clear();
+}
+
+// ======================
+// Structure
+// ======================
+
+void TreeView::clear() {
+    nodes_.assign(1, Node());
+    nodes_[TREE_ROOT].open = true;
+    free_.clear();
+    selected_ = TREE_NONE;
+    callback_node_ = TREE_NONE;
+    top_row_ = 0;
+    hpos_ = 0;
+    max_width_ = 0;
+    redraw();
+}
+
+int TreeView::new_node() {
+    int node;
+    if (!free_.empty()) {
+        node = free_.back();
+        free_.pop_back();
+        nodes_[node] = Node();
+    } else {
+        node = (int)nodes_.size();
+        nodes_.emplace_back();
+    }
+    return node;
+}
+
+void TreeView::free_subtree(int node) {
+    std::vector<int> stack(1, node);
+    while (!stack.empty()) {
+        int n = stack.back();
+        stack.pop_back();
+        stack.insert(stack.end(), nodes_[n].kids.begin(), nodes_[n].kids.end());
+        nodes_[n] = Node();
+        free_.push_back(n);
+    }
+}
+
+// A node's rows count toward its parent's only while the parent is open
+void TreeView::rows_changed(int node, int delta) {
+    for (int p = nodes_[node].parent; p != TREE_NONE && nodes_[p].open; p = nodes_[p].parent)
+        nodes_[p].rows += delta;
+}
+
+void TreeView::attach(int node, int parent, int pos) {
+    std::vector<int>& kids = nodes_[parent].kids;
+    if (pos < 0 || pos > (int)kids.size()) pos = (int)kids.size();
+    kids.insert(kids.begin() + pos, node);
+    for (int i = pos; i < (int)kids.size(); ++i) nodes_[kids[i]].pos = i;
+    nodes_[node].parent = parent;
+    rows_changed(node, nodes_[node].rows);
+}
+
+void TreeView::detach(int node) {
+    rows_changed(node, -nodes_[node].rows);
+    std::vector<int>& kids = nodes_[nodes_[node].parent].kids;
+    int pos = nodes_[node].pos;
+    kids.erase(kids.begin() + pos);
+    for (int i = pos; i < (int)kids.size(); ++i) nodes_[kids[i]].pos = i;
+    nodes_[node].parent = TREE_NONE;
+}
+
+int TreeView::add(int parent, const char* label, int pos) {
+    int node = new_node();
+    nodes_[node].label = label ? label : "";
+    attach(node, parent, pos);
+    redraw();
+    return node;
+}
+
+void TreeView::remove(int node) {
+    if (node == TREE_ROOT) return;
+    if (selected_ != TREE_NONE && contains(node, selected_)) selected_ = TREE_NONE;
+    if (callback_node_ != TREE_NONE && contains(node, callback_node_)) callback_node_ = TREE_NONE;
+    detach(node);
+    free_subtree(node);
+    redraw();
+}
+
+// `pos` indexes the parent's children as they are now, `node` included
+void TreeView::move(int node, int parent, int pos) {
+    if (nodes_[node].parent == parent && pos > nodes_[node].pos) --pos;
+    detach(node);
+    attach(node, parent, pos);
+    redraw();
+}
+
+int TreeView::depth(int node) const {
+    int d = 0;
+    for (; node != TREE_ROOT && node != TREE_NONE; node = nodes_[node].parent) ++d;
+    return d;
+}
+
+void TreeView::label(int node, const char* text) {
+    nodes_[node].label = text ? text : "";
+    redraw();
+}
+
+void TreeView::node_color(int node, Fl_Color c) {
+    if (nodes_[node].color == c) return;
+    nodes_[node].color = c;
+    redraw();
+}
+
+bool TreeView::contains(int ancestor, int node) const {
+    for (; node != TREE_NONE; node = nodes_[node].parent) {
+        if (node == ancestor) return true;
+    }
+    return false;
+}
+
+// ======================
+// Expansion
+// ======================
+
+void TreeView::open(int node) {
+    Node& n = nodes_[node];
+    if (n.open) return;
+    int extra = 0;
+    for (int kid : n.kids) extra += nodes_[kid].rows;
+    n.open = true;
+    n.rows += extra;
+    rows_changed(node, extra);
+    redraw();
+}
+
+void TreeView::close(int node) {
+    Node& n = nodes_[node];
+    if (!n.open || node == TREE_ROOT) return;
+    int extra = n.rows - 1;
+    n.open = false;
+    n.rows = 1;
+    rows_changed(node, -extra);
+    redraw();
+}
+
+// Open everything below `node` and recount it bottom-up: O(subtree)
+int TreeView::open_below(int node) {
+    if (nodes_[node].kids.empty()) return nodes_[node].rows;
+    nodes_[node].open = true;
+    int rows = 1;
+    for (size_t i = 0; i < nodes_[node].kids.size(); ++i) rows += open_below(nodes_[node].kids[i]);
+    nodes_[node].rows = rows;
+    return rows;
+}
+
+void TreeView::open_subtree(int node) {
+    int before = nodes_[node].rows;
+    open_below(node);
+    rows_changed(node, nodes_[node].rows - before);
+    redraw();
+}
+
+// ======================
+// Rows
+// ======================
+
+bool TreeView::is_shown(int node) const {
+    if (node == TREE_ROOT || node == TREE_NONE) return false;
+    for (int p = nodes_[node].parent; p != TREE_NONE; p = nodes_[p].parent) {
+        if (!nodes_[p].open) return false;
+    }
+    return true;
+}
+
+// Descend by subtracting whole subtrees: O(depth x siblings), not O(rows)
+int TreeView::node_for_row(int row) const {
+    if (row < 0 || row >= rows()) return TREE_NONE;
+    int node = TREE_ROOT;
+    for (;;) {
+        const std::vector<int>& kids = nodes_[node].kids;
+        size_t i = 0;
+        for (; i < kids.size(); ++i) {
+            int kid_rows = nodes_[kids[i]].rows;
+            if (row < kid_rows) break;
+            row -= kid_rows;
+        }
+        if (i == kids.size()) return TREE_NONE;
+        if (row == 0) return kids[i];
+        --row;  // the kid's own row
+        node = kids[i];
+    }
+}
+
+int TreeView::row_of(int node) const {
+    int row = -1;  // the root takes no row
+    for (int cur = node; cur != TREE_ROOT; cur = nodes_[cur].parent) {
+        const Node& parent = nodes_[nodes_[cur].parent];
+        row += 1;
+        for (int i = 0; i < nodes_[cur].pos; ++i) row += nodes_[parent.kids[i]].rows;
+    }
+    return row;
+}
+
+int TreeView::next_row(int node) const {
+    if (nodes_[node].open && !nodes_[node].kids.empty()) return nodes_[node].kids[0];
+    while (node != TREE_ROOT) {
+        const Node& parent = nodes_[nodes_[node].parent];
+        int next = nodes_[node].pos + 1;
+        if (next < (int)parent.kids.size()) return parent.kids[next];
+        node = nodes_[node].parent;
+    }
+    return TREE_NONE;
+}
+
+int TreeView::view_w() const {
+    return w() - (vscroll_->visible() ? vscroll_->w() : 0);
+}
+
+int TreeView::view_h() const {
+    return h() - (hscroll_->visible() ? hscroll_->h() : 0);
+}
+
+int TreeView::visible_rows() const {
+    return std::max(1, view_h() / row_height());
+}
+
+int TreeView::node_at(int y_pos) const {
+    if (y_pos < y() || y_pos >= y() + view_h()) return TREE_NONE;
+    return node_for_row(top_row_ + (y_pos - y()) / row_height());
+}
+
+void TreeView::scroll_to_row(int row) {
+    top_row_ = std::max(0, std::min(row, rows() - visible_rows()));
+    vscroll_->value(top_row_, visible_rows(), 0, rows());
+    redraw();
+}
+
+void TreeView::hposition(int pos) {
+    hpos_ = std::max(0, std::min(pos, max_width_ - view_w()));
+    hscroll_->value(hpos_, view_w(), 0, max_width_);
+    redraw();
+}
+
+void TreeView::select(int node) {
+    if (selected_ == node) return;
+    selected_ = node;
+    redraw();
+}
+
+void TreeView::show_node(int node) {
+    if (!is_shown(node)) return;
+    int row = row_of(node);
+    int visible = visible_rows();
+    if (row < top_row_ || row >= top_row_ + visible) scroll_to_row(row - visible / 2);
+}
+
+// ======================
+// Drawing and events
+// ======================
+
+void TreeView::resize(int X, int Y, int W, int H) {
+    Fl_Widget::resize(X, Y, W, H);
+    update_scrollbars();
+}
+
+void TreeView::update_scrollbars() {
+    int sb = Fl::scrollbar_size();
+    int total_h = rows() * row_height();
+    bool need_v = total_h > h();
+    bool need_h = max_width_ > w() - (need_v ? sb : 0);
+    if (need_h && !need_v) need_v = total_h > h() - sb;
+
+    vscroll_->resize(x() + w() - sb, y(), sb, h() - (need_h ? sb : 0));
+    hscroll_->resize(x(), y() + h() - sb, w() - (need_v ? sb : 0), sb);
+    if (need_v) vscroll_->show(); else vscroll_->hide();
+    if (need_h) hscroll_->show(); else hscroll_->hide();
+
+    top_row_ = std::max(0, std::min(top_row_, rows() - visible_rows()));
+    hpos_ = std::max(0, std::min(hpos_, max_width_ - view_w()));
+    vscroll_->value(top_row_, visible_rows(), 0, rows());
+    hscroll_->value(hpos_, view_w(), 0, max_width_);
+}
+
+void TreeView::draw() {
+    update_scrollbars();
+    int vw = view_w(), vh = view_h(), rh = row_height();
+
+    fl_push_clip(x(), y(), vw, vh);
+    fl_color(color());
+    fl_rectf(x(), y(), vw, vh);
+    fl_font(labelfont(), labelsize());
+
+    int widest = max_width_;
+    int node = node_for_row(top_row_);
+    for (int row_y = y(); node != TREE_NONE && row_y < y() + vh; row_y += rh, node = next_row(node)) {
+        const Node& n = nodes_[node];
+        int indent = x() - hpos_ + 4 + (depth(node) - 1) * INDENT;
+        Fl_Color fg = n.color ? n.color : labelcolor();
+        if (node == selected_) {
+            fl_color(selection_color());
+            fl_rectf(x(), row_y, vw, rh);
+            fg = fl_contrast(fg, selection_color());
+        }
+        if (!n.kids.empty()) {
+            // Expander: right-pointing when closed, down when open
+            int cx = indent + INDENT / 2, cy = row_y + rh / 2;
+            fl_color(fl_color_average(fg, color(), 0.6f));
+            if (n.open) fl_polygon(cx - 4, cy - 2, cx + 4, cy - 2, cx, cy + 3);
+            else fl_polygon(cx - 2, cy - 4, cx + 3, cy, cx - 2, cy + 4);
+        }
+        fl_color(fg);
+        int text_x = indent + INDENT;
+        fl_draw(n.label.c_str(), text_x, row_y + (rh + fl_height()) / 2 - fl_descent());
+        widest = std::max(widest, text_x + (int)fl_width(n.label.c_str()) + 8 + hpos_ - x());
+    }
+    fl_pop_clip();
+
+    if (vscroll_->visible() && hscroll_->visible()) {
+        fl_color(color());
+        fl_rectf(x() + vw, y() + vh, w() - vw, h() - vh);
+    }
+    if (widest != max_width_) {
+        max_width_ = widest;
+        update_scrollbars();
+    }
+    draw_children();
+}
+
+void TreeView::notify(int node, TreeReason reason) {
+    callback_node_ = node;
+    callback_reason_ = reason;
+    do_callback();
+}
+
+void TreeView::toggle(int node) {
+    if (nodes_[node].open) {
+        close(node);
+        notify(node, TREE_REASON_CLOSED);
+    } else {
+        open(node);
+        notify(node, TREE_REASON_OPENED);
+    }
+}
+
+int TreeView::handle_key(int key) {
+    int row = selected_ != TREE_NONE && is_shown(selected_) ? row_of(selected_) : -1;
+    int target = TREE_NONE;
+    switch (key) {
+    case FL_Up:        target = node_for_row(std::max(0, row - 1)); break;
+    case FL_Down:      target = node_for_row(row + 1); break;
+    case FL_Page_Up:   target = node_for_row(std::max(0, row - visible_rows())); break;
+    case FL_Page_Down: target = node_for_row(std::min(rows() - 1, row + visible_rows())); break;
+    case FL_Home:      target = node_for_row(0); break;
+    case FL_End:       target = node_for_row(rows() - 1); break;
+    case FL_Left:
+        if (row < 0) return 0;
+        if (nodes_[selected_].open && !nodes_[selected_].kids.empty()) toggle(selected_);
+        else if (nodes_[selected_].parent != TREE_ROOT) target = nodes_[selected_].parent;
+        break;
+    case FL_Right:
+        if (row < 0 || nodes_[selected_].kids.empty()) return row >= 0;
+        if (!nodes_[selected_].open) toggle(selected_);
+        else target = nodes_[selected_].kids[0];
+        break;
+    case FL_Enter:
+    case ' ':
+        if (row < 0) return 0;
+        if (!nodes_[selected_].kids.empty()) toggle(selected_);
+        else notify(selected_, TREE_REASON_SELECTED);
+        return 1;
+    default:
+        return 0;
+    }
+    if (target != TREE_NONE) {
+        select(target);
+        show_node(target);
+    }
+    return 1;
+}
+
+int TreeView::handle(int e) {
+    switch (e) {
+    case FL_PUSH: {
+        if (Fl_Group::handle(e)) return 1;  // a scrollbar
+        if (Fl::visible_focus()) take_focus();
+        int node = node_at(Fl::event_y());
+        if (node == TREE_NONE || Fl::event_button() != FL_LEFT_MOUSE) return 1;
+        select(node);
+        // Folders open and close from anywhere on their row
+        if (!nodes_[node].kids.empty()) toggle(node);
+        else notify(node, TREE_REASON_SELECTED);
+        return 1;
+    }
+    case FL_MOUSEWHEEL:
+        if (Fl::event_dy()) scroll_to_row(top_row_ + Fl::event_dy() * 3);
+        if (Fl::event_dx()) hposition(hpos_ + Fl::event_dx() * INDENT);
+        return 1;
+    case FL_FOCUS:
+    case FL_UNFOCUS:
+        return Fl::visible_focus() ? 1 : 0;
+    case FL_KEYDOWN:
+        if (handle_key(Fl::event_key())) return 1;
+        break;
+    }
+    return Fl_Group::handle(e);
+}
+
+void TreeView::scroll_cb(Fl_Widget* w, void* data) {
+    TreeView* view = static_cast<TreeView*>(data);
+    Fl_Scrollbar* bar = static_cast<Fl_Scrollbar*>(w);
+    if (bar == view->vscroll_) view->top_row_ = bar->value();
+    else view->hpos_ = bar->value();
+    view->redraw();
+}
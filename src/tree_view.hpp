@@ -0,0 +1,115 @@
+#pragma once
+#include <FL/Fl.H>
+#include <FL/Fl_Group.H>
+#include <FL/Fl_Scrollbar.H>
+#include <string>
+#include <vector>
+
+// Nodes are indices into the view's node array. A removed node's index is
+// reused, so holders must drop it when the node goes.
+enum { TREE_NONE = -1, TREE_ROOT = 0 };
+
+enum TreeReason { TREE_REASON_NONE, TREE_REASON_SELECTED, TREE_REASON_OPENED, TREE_REASON_CLOSED };
+
+// Tree widget for very large hierarchies. Nodes live in one flat array with
+// parent and child indices, and each node counts the rows its subtree shows,
+// so finding the row at a scroll position costs O(depth), opening or
+// closing updates only ancestors, and drawing visits only the rows in view.
+// The root is never shown; its children are the top rows.
+class TreeView : public Fl_Group {
+public:
+    TreeView(int X, int Y, int W, int H, const char* L = nullptr);
+
+    // Widget children (the scrollbars), not nodes
+    using Fl_Group::children;
+    using Fl_Group::child;
+    using Fl_Group::label;
+
+    void draw() override;
+    int handle(int e) override;
+    void resize(int X, int Y, int W, int H) override;
+
+    // Structure
+    void clear();                                    // leaves only the root
+    int add(int parent, const char* label, int pos = -1);  // -1 appends
+    void remove(int node);                           // with its subtree
+    void move(int node, int parent, int pos);
+
+    int parent(int node) const { return nodes_[node].parent; }
+    int children(int node) const { return (int)nodes_[node].kids.size(); }
+    int child(int node, int i) const { return nodes_[node].kids[i]; }
+    int index_in_parent(int node) const { return nodes_[node].pos; }
+    int depth(int node) const;
+
+    const std::string& label(int node) const { return nodes_[node].label; }
+    void label(int node, const char* text);
+    // Bits for the owner's use; the view only stores them
+    unsigned flags(int node) const { return nodes_[node].flags; }
+    void flags(int node, unsigned f) { nodes_[node].flags = f; }
+    // Label colour of one row; 0 uses labelcolor()
+    void node_color(int node, Fl_Color c);
+
+    // Expansion. These do not call the callback.
+    bool is_open(int node) const { return nodes_[node].open; }
+    void open(int node);
+    void close(int node);
+    void open_subtree(int node);  // `node` and every node below with children
+
+    // Selection and scrolling
+    int selected() const { return selected_; }
+    void select(int node);        // does not call the callback
+    void show_node(int node);     // scroll a shown node into view
+    int node_at(int y) const;     // node on the row at window y, or TREE_NONE
+    int rows() const { return nodes_[TREE_ROOT].rows - 1; }
+    int hposition() const { return hpos_; }
+    void hposition(int pos);
+    int row_height() const { return labelsize() + 6; }
+
+    // What the last callback was about
+    int callback_node() const { return callback_node_; }
+    TreeReason callback_reason() const { return callback_reason_; }
+
+private:
+    struct Node {
+        std::string label;
+        std::vector<int> kids;
+        int parent = TREE_NONE;
+        int pos = 0;       // index in the parent's kids
+        int rows = 1;      // rows shown by the subtree: itself, plus its children while open
+        unsigned flags = 0;
+        Fl_Color color = 0;
+        bool open = false;
+    };
+
+    std::vector<Node> nodes_;
+    std::vector<int> free_;
+    int selected_ = TREE_NONE;
+    int top_row_ = 0;
+    int hpos_ = 0;
+    int max_width_ = 0;  // widest row drawn so far, for the horizontal scrollbar
+    int callback_node_ = TREE_NONE;
+    TreeReason callback_reason_ = TREE_REASON_NONE;
+    Fl_Scrollbar* vscroll_;
+    Fl_Scrollbar* hscroll_;
+
+    int new_node();
+    void free_subtree(int node);
+    void attach(int node, int parent, int pos);
+    void detach(int node);
+    void rows_changed(int node, int delta);
+    int open_below(int node);
+    bool contains(int ancestor, int node) const;
+    bool is_shown(int node) const;
+    int node_for_row(int row) const;
+    int row_of(int node) const;
+    int next_row(int node) const;
+    int visible_rows() const;
+    int view_w() const;
+    int view_h() const;
+    void scroll_to_row(int row);
+    void update_scrollbars();
+    void notify(int node, TreeReason reason);
+    void toggle(int node);
+    int handle_key(int key);
+    static void scroll_cb(Fl_Widget* w, void* data);
+};
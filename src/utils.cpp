@@ -6,6 +6,15 @@
 #include "tab_bar.hpp"
 #include "custom_title_bar.hpp"
 #include "colors.hpp"
+#include "file_loader.hpp"
+#include "file_saver.hpp"
+#include "edit_journal.hpp"
+#include "dir_watcher.hpp"
+#include "tab_memory.hpp"
+#include "tree_view.hpp"
+#include "diff_gutter.hpp"
+#include "line_layout.hpp"
+#include "file_io.hpp"
 #include <thread>
 #include <FL/Fl_Text_Display.H>
 #include <FL/Fl.H>
@@ -17,6 +26,7 @@
 #include <cctype>
 #include <cstdio>
 #include <cstdlib>
+#include <cstdint>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -24,6 +34,9 @@
 #include <direct.h>
 #endif
 #include <string>
+#include <filesystem>
+#include <set>
+#include <unordered_map>
 
 #if defined(FL_MAJOR_VERSION) && ((FL_MAJOR_VERSION > 1) || (FL_MAJOR_VERSION == 1 && FL_MINOR_VERSION >= 5))
 #  define HAVE_SCROLLBUTTONS 1
@@ -72,10 +85,24 @@ static bool is_type(const char *s) {
     return false;
 }
 
-static void style_parse(const char *text, char *style, int length) {
-    char current = 'A';
+// `current` is the state the text starts in: 'C' or 'D' inside a block
+// comment or string carried over from the line before
+static void style_parse(const char *text, char *style, int length, char current = 'A') {
     int col = 0;
+    int line_begin = 0, line_end = -1;
     for (int i = 0; i < length; ++i) {
+        while (line_end < i) {
+            line_begin = line_end + 1;
+            const char* nl = static_cast<const char*>(memchr(text + line_begin, '\n', length - line_begin));
+            line_end = nl ? static_cast<int>(nl - text) : length;
+        }
+        if (i - line_begin >= LONG_LINE_COLUMNS && i < line_end) {
+            // The rest of a long line stays plain; its state does not carry over
+            memset(style + i, 'A', line_end - i);
+            i = line_end - 1;
+            current = 'A';
+            continue;
+        }
         char c = text[i];
         if (current == 'B') { // line comment
             style[i] = 'B';
@@ -141,10 +168,12 @@ static void style_parse(const char *text, char *style, int length) {
                 buf[j++] = text[i+j];
             buf[j] = '\0';
 
-            // Check for function call (identifier followed by '(')
+            // Check for function call (identifier followed by '(' on the
+            // same line, so a line's styles depend on no line after it)
             bool is_function_call = false;
             int next_pos = i + j;
-            while (next_pos < length && std::isspace(static_cast<unsigned char>(text[next_pos])))
+            while (next_pos < length && text[next_pos] != '\n' &&
+                   std::isspace(static_cast<unsigned char>(text[next_pos])))
                 next_pos++;
             if (next_pos < length && text[next_pos] == '(')
                 is_function_call = true;
@@ -173,35 +202,38 @@ static void style_parse(const char *text, char *style, int length) {
 static const size_t MAX_FILE_SIZE_FOR_SYNTAX_HIGHLIGHT = 1024 * 1024; // 1MB
 static const size_t MAX_FILE_SIZE_FOR_IMMEDIATE_LOAD = 512 * 1024; // 512KB
 
-void style_init() {
-    // Check file size, delay syntax highlighting for large files
-    if (buffer && buffer->length() > MAX_FILE_SIZE_FOR_SYNTAX_HIGHLIGHT) {
-        // For large files, only set basic styles, delay detailed syntax highlighting
+// Detailed syntax highlighting of a large file, once it has been shown
+static void style_parse_later(void*) {
+    if (buffer && buffer->length() > 0 && !long_line_mode()) {
         char *text = buffer->text();
         int length = buffer->length();
         char *style = new char[length + 1];
         memset(style, 'A', length);
+        style_parse(text, style, length);
         style_buffer->text(style);
         delete[] style;
         free(text);
+        if (editor) {
+            editor->damage(FL_DAMAGE_ALL);
+        }
+    }
+}
+
+void style_init() {
+    Fl::remove_timeout(style_parse_later);
+    // Check file size, delay syntax highlighting for large files; long
+    // lines are not highlighted at all
+    if (buffer && ((size_t)buffer->length() > MAX_FILE_SIZE_FOR_SYNTAX_HIGHLIGHT || long_line_mode())) {
+        // Only set basic styles
+        int length = buffer->length();
+        char *style = new char[length + 1];
+        memset(style, 'A', length);
+        style[length] = '\0';
+        style_buffer->text(style);
+        delete[] style;
         update_linenumber_width();
         
-        // Delay detailed syntax highlighting
-        Fl::add_timeout(1.0, [](void*) {
-            if (buffer && buffer->length() > 0) {
-                char *text = buffer->text();
-                int length = buffer->length();
-                char *style = new char[length + 1];
-                memset(style, 'A', length);
-                style_parse(text, style, length);
-                style_buffer->text(style);
-                delete[] style;
-                free(text);
-                if (editor) {
-                    editor->damage(FL_DAMAGE_ALL);
-                }
-            }
-        });
+        if (!long_line_mode()) Fl::add_timeout(1.0, style_parse_later);
         return;
     }
     
@@ -216,6 +248,53 @@ void style_init() {
     update_linenumber_width();
 }
 
+// Comment or string state a line starts in, from the style of the newline
+// that ends the line before it
+static char carried_state(char newline_style) {
+    return newline_style == 'C' || newline_style == 'D' ? newline_style : 'A';
+}
+
+static void restyle_range(int start, int end, char state) {
+    char *text = buffer->text_range(start, end);
+    int length = end - start;
+    char *style = new char[length + 1];
+    memset(style, 'A', length);
+    style_parse(text, style, length, state);
+    style_buffer->replace(start, end, style);
+    delete[] style;
+    free(text);
+    if (editor) editor->redisplay_range(start, end);
+}
+
+// Keep the styles in step with an edit: only the lines it touched are
+// parsed again, and the text after them only when the comment or string
+// state carried past them changed
+static void style_update(int pos, int inserted, int deleted) {
+    if (style_buffer->length() != buffer->length() - inserted + deleted) {
+        style_init();  // out of step already
+        return;
+    }
+    if (inserted) {
+        char *plain = new char[inserted + 1];
+        memset(plain, 'A', inserted);
+        plain[inserted] = '\0';
+        style_buffer->replace(pos, pos + deleted, plain);
+        delete[] plain;
+    } else {
+        style_buffer->remove(pos, pos + deleted);
+    }
+    if (long_line_mode()) return;  // shown plain
+
+    int length = buffer->length();
+    int start = buffer->line_start(pos);
+    int end = buffer->line_end(pos + inserted);
+    if (end < length) ++end;  // the newline carries the state on
+    char before = end > start ? carried_state(style_buffer->byte_at(end - 1)) : 'A';
+    restyle_range(start, end, start > 0 ? carried_state(style_buffer->byte_at(start - 1)) : 'A');
+    char after = end > start ? carried_state(style_buffer->byte_at(end - 1)) : 'A';
+    if (end < length && after != before) restyle_range(end, length, after);
+}
+
 const char* font_size_path() {
     static char path[FL_PATH_MAX];
     const char* home = getenv("HOME");
@@ -245,7 +324,7 @@ int load_font_size() {
 void update_linenumber_width() {
     if (!editor || !buffer) return;
 
-    int lines = buffer->count_lines(0, buffer->length()) + 1;
+    int lines = line_layout_line_count(buffer);
     int digits = 1;
     for (int temp = lines; temp >= 10; temp /= 10) digits++;
 
@@ -254,7 +333,8 @@ void update_linenumber_width() {
     int width = digits * char_width + 6;  // Adjustable padding
     if (width < 20) width = 20;
 
-    editor->linenumber_width(width);
+    // Setting it lays the editor out again
+    if (editor->linenumber_width() != width) editor->linenumber_width(width);
 }
 
 void set_font_size(int sz) {
@@ -307,20 +387,120 @@ void save_last_folder() {
 void load_last_file_if_any() {
     FILE* fp = fopen(last_file_path(), "r");
     if (fp) {
-        if (fgets(current_file, sizeof(current_file), fp)) {
-            size_t len = strlen(current_file);
-            if (len && current_file[len-1] == '\n') current_file[len-1] = '\0';
+        char path[FL_PATH_MAX] = "";
+        if (fgets(path, sizeof(path), fp)) {
+            size_t len = strlen(path);
+            if (len && path[len-1] == '\n') path[len-1] = '\0';
         }
         fclose(fp);
-        if (current_file[0]) {
-            buffer->loadfile(current_file);
-            text_changed = false;
-            update_title();
-            style_init();
-            last_save_time = 0;
-            update_status();
+        // Goes through the tabs so a restored tab is selected, not overwritten
+        if (path[0] && access(path, F_OK) == 0) load_file(path);
+    }
+}
+
+// Size and modification time of a file, to tell our own writes from others'
+static bool disk_stamp(const std::string& path, long long& size, long long& mtime) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    size = (long long)st.st_size;
+    mtime = stat_mtime_ns(st);
+    return true;
+}
+
+static void record_disk_stamp(Tab* tab) {
+    if (!disk_stamp(tab->filepath, tab->disk_size, tab->disk_mtime)) {
+        tab->disk_size = -1;
+        tab->disk_mtime = 0;
+    }
+    tab->disk_changed = false;
+    diff_gutter_base_changed(tab->filepath);
+}
+
+// A deleted file has nothing newer to offer
+static bool changed_on_disk(const Tab* tab) {
+    long long size, mtime;
+    if (!disk_stamp(tab->filepath, size, mtime)) return false;
+    return size != tab->disk_size || mtime != tab->disk_mtime;
+}
+
+// Give a recovered text to its document: the open tab, a restored stub, a
+// new tab, or the untitled buffer
+static void restore_document(const std::string& path, Fl_Text_Buffer* doc) {
+    if (path.empty() || !tab_bar) {
+        // Journalled as an edit of the untitled buffer; sized, so NUL bytes survive
+        char* text = doc->text();
+        untitled_buffer->replace(0, untitled_buffer->length(), text, doc->length());
+        free(text);
+        delete doc;
+        return;
+    }
+    Tab* tab = tab_bar->get_tab(path);
+    if (tab && tab->loaded) {
+        char* text = doc->text();
+        tab->buffer->replace(0, tab->buffer->length(), text, doc->length());
+        free(text);
+        delete doc;
+        if (tab->buffer != buffer) tab->style_buffer->text("");  // restyled when shown
+    } else if (tab) {
+        if (tab->is_active) cancel_file_load();  // the file itself is out of date
+        delete tab->buffer;
+        tab->buffer = doc;
+        tab->packed.clear();
+        tab->loaded = true;
+        journal_track(doc, path);
+        journal_rewrite(path);
+        if (tab->is_active && tab_bar->on_tab_selected) tab_bar->on_tab_selected(path);
+    } else {
+        tab_bar->add_tab("", path, doc);
+        journal_track(doc, path);
+        journal_rewrite(path);
+    }
+    tab_bar->update_tab_modified(path, true);
+    if (path == current_file) text_changed = true;
+    if (Tab* restored = tab_bar->get_tab(path)) record_disk_stamp(restored);
+}
+
+// A path beside `path` for a recovered copy, free on disk and in the tabs
+static std::string recovered_copy_path(const std::string& path) {
+    for (int n = 1; ; ++n) {
+        std::string copy = path + ".recovered" + (n > 1 ? std::to_string(n) : "");
+        long long size, mtime;
+        if (!disk_stamp(copy, size, mtime) && !(tab_bar && tab_bar->get_tab(copy))) return copy;
+    }
+}
+
+// Put back unsaved edits journalled by a session that did not exit cleanly
+void recover_unsaved_documents() {
+    std::vector<RecoveredDocument> stale;
+    std::vector<RecoveredDocument> found = journal_recover(&stale);
+    if (!stale.empty()) {
+        // Their edits were made to text that is gone; the files keep what is
+        // on disk, and the edits stay journalled unless given up
+        int r = fl_choice("Unsaved changes to %d file(s) were found, but the files\n"
+                          "changed on disk since. Open the changes as copies beside\n"
+                          "the files, replayed onto them as they are now?\n"
+                          "Kept changes are offered again next time.",
+                          "Keep", "Discard", "Open Copies", (int)stale.size());
+        for (RecoveredDocument& rec : stale) {
+            if (r == 2) restore_document(recovered_copy_path(rec.path), rec.doc);
+            else delete rec.doc;
+            if (r != 0) journal_remove(rec);
+        }
+    }
+    if (!found.empty()) {
+        int r = fl_choice("Flick did not exit cleanly.\nRecover unsaved changes to %d document(s)?",
+                          "Discard", "Recover", NULL, (int)found.size());
+        for (RecoveredDocument& rec : found) {
+            if (r == 1) {
+                restore_document(rec.path, rec.doc);
+            } else {
+                delete rec.doc;
+                journal_discard(rec.path);
+            }
         }
     }
+    update_title();
+    update_status();
 }
 
 void update_title() {
@@ -333,15 +513,18 @@ void update_title() {
     if (title_bar) {
         title_bar->set_title(title);
     }
+    // The title follows current_file, and so does the diff gutter
+    diff_gutter_follow();
 }
 
 void update_status() {
     if (!status_left || !status_right || !editor) return;
     int pos = editor->insert_position();
-    int line = buffer->count_lines(0, pos) + 1;
-    int col = pos - buffer->line_start(pos) + 1;
+    int line, col;
+    line_layout_locate(pos, line, col);
     char left[64];
-    snprintf(left, sizeof(left), "Ln %d, Col %d", line, col);
+    snprintf(left, sizeof(left), "Ln %d, Col %d%s", line + 1, col + 1,
+             long_line_mode() ? " | Long lines, no wrap" : "");
     status_left->copy_label(left);
 
     char timebuf[64] = "Never";
@@ -349,8 +532,12 @@ void update_status() {
         std::tm *tm = std::localtime(&last_save_time);
         if (tm) strftime(timebuf, sizeof(timebuf), "%H:%M:%S", tm);
     }
-    char right[128];
-    snprintf(right, sizeof(right), "%s | Last: %s", text_changed ? "Modified" : "Saved", timebuf);
+    char resident[32];
+    format_bytes(total_resident_bytes(), resident, sizeof(resident));
+    char right[160];
+    const char* state = current_file[0] && file_save_pending(current_file) ? "Saving..." :
+                        text_changed ? "Modified" : "Saved";
+    snprintf(right, sizeof(right), "%s | Last: %s | Tabs: %s", state, timebuf, resident);
     status_right->copy_label(right);
     status_left->redraw();
     status_right->redraw();
@@ -359,7 +546,8 @@ void update_status() {
 // Global flag to prevent marking tabs as modified during file loading
 static bool loading_file = false;
 
-void changed_cb(int, int, int, int, const char*, void*) {
+void changed_cb(int pos, int inserted, int deleted, int, const char*, void*) {
+    if (!inserted && !deleted) return;  // selection or style only
     text_changed = true;
     // Update tab bar modified status only if not loading a file and not switching tabs
     if (tab_bar && current_file[0] && !loading_file && !switching_tabs) {
@@ -367,18 +555,20 @@ void changed_cb(int, int, int, int, const char*, void*) {
         // Don't update the tab buffer here - it will be updated when switching tabs
     }
     update_title();
-    style_init();
+    style_update(pos, inserted, deleted);
     update_linenumber_width();
     update_status();
 }
 
 void new_cb(Fl_Widget*, void*) {
-    if (text_changed) {
+    // Open tabs keep their documents; only untitled text can be lost here
+    if (buffer == untitled_buffer && text_changed) {
         int r = fl_choice("Discard changes?", "Cancel", "Discard", NULL);
         if (r == 0) return;
     }
+    show_untitled_document();
+    if (tab_bar) tab_bar->set_active_tab("");
     buffer->text("");
-    current_file[0] = '\0';
     text_changed = false;
     update_title();
     style_init();
@@ -386,77 +576,260 @@ void new_cb(Fl_Widget*, void*) {
     update_status();
 }
 
-void load_file(const char *file) {
-    // Check file size
-    struct stat st;
-    if (stat(file, &st) == 0 && st.st_size > MAX_FILE_SIZE_FOR_IMMEDIATE_LOAD) {
-        // Show loading progress for large files
-        if (status_left) {
-            status_left->copy_label("Loading large file...");
-            status_left->redraw();
+// Buffer currently reporting edits through changed_cb
+static Fl_Text_Buffer* tracked_buffer = nullptr;
+
+// Point the editor at a document and its style buffer. Only pointers move,
+// so switching documents does not depend on their size.
+void attach_document(Fl_Text_Buffer* doc, Fl_Text_Buffer* style) {
+    if (tracked_buffer != doc) {
+        if (tracked_buffer) tracked_buffer->remove_modify_callback(changed_cb, nullptr);
+        doc->add_modify_callback(changed_cb, nullptr);
+        tracked_buffer = doc;
+    }
+    // Measured after changed_cb is added: newer modify callbacks run first,
+    // so the status bar sees the lengths after each edit
+    line_layout_attach(doc);
+    diff_gutter_attach(doc);
+    buffer = doc;
+    style_buffer = style;
+    if (editor) {
+        editor->buffer(doc);
+        editor->highlight_data(style, style_table, style_table_size, 'A', nullptr, nullptr);
+    }
+}
+
+// Show the document that has no file yet
+void show_untitled_document() {
+    attach_document(untitled_buffer, untitled_style_buffer);
+    current_file[0] = '\0';
+    if (style_buffer->length() != buffer->length()) style_init();
+}
+
+// Open `path` as a new tab that owns `doc`, and show it
+static void open_document(const char* path, Fl_Text_Buffer* doc) {
+    loading_file = true;  // Prevent marking as modified during loading
+    if (tab_bar) {
+        tab_bar->add_tab("", path, doc);
+        tab_bar->update_tab_modified(path, false);
+        Tab* tab = tab_bar->get_tab(path);
+        if (tab && tab->buffer == doc) {  // not freed as a duplicate
+            journal_track(doc, path);
+            record_disk_stamp(tab);
         }
-        
-        // Asynchronously load large files
-        std::thread([file]() {
-            loading_file = true;  // Prevent marking as modified during loading
-            if (buffer->loadfile(file) == 0) {
-                strncpy(current_file, file, sizeof(current_file));
-                text_changed = false;
-                
-                // Update UI in main thread
-                Fl::awake([](void*) {
-                    // Add to tab bar
-                    if (tab_bar) {
-                        tab_bar->add_tab("", current_file);
-                        // Update the tab's buffer with the loaded content
-                        Fl_Text_Buffer* tab_buffer = tab_bar->get_tab_buffer(current_file);
-                        if (tab_buffer) {
-                            tab_buffer->text(buffer->text());
-                        }
-                        // Ensure the tab is not marked as modified after loading
-                        tab_bar->update_tab_modified(current_file, false);
-                    }
-                    update_title();
-                    save_last_file();
-                    style_init();
-                    last_save_time = 0;
-                    update_status();
-                    loading_file = false;  // Re-enable modification tracking
-                });
-            } else {
-                Fl::awake([](void*) {
-                    fl_alert("Cannot open file");
-                    loading_file = false;  // Re-enable modification tracking
-                });
-            }
-        }).detach();
     } else {
-        // Normal loading for small files
-        loading_file = true;  // Prevent marking as modified during loading
-        if (buffer->loadfile(file) == 0) {
-            strncpy(current_file, file, sizeof(current_file));
-            text_changed = false;
-            // Add to tab bar
-            if (tab_bar) {
-                tab_bar->add_tab("", file);
-                // Update the tab's buffer with the loaded content
-                Fl_Text_Buffer* tab_buffer = tab_bar->get_tab_buffer(file);
-                if (tab_buffer) {
-                    tab_buffer->text(buffer->text());
-                }
-                // Ensure the tab is not marked as modified after loading
-                tab_bar->update_tab_modified(file, false);
-            }
-            update_title();
-            save_last_file();
-            style_init();
-            last_save_time = 0;
-            update_status();
+        // Without a tab bar the editor keeps a single document
+        attach_document(doc, style_buffer);
+        strncpy(current_file, path, sizeof(current_file) - 1);
+        current_file[sizeof(current_file) - 1] = '\0';
+        style_init();
+    }
+    text_changed = false;
+    update_title();
+    save_last_file();
+    last_save_time = 0;
+    update_status();
+    loading_file = false;  // Re-enable modification tracking
+}
+
+static void file_load_progress(const std::string& path, size_t done, size_t total) {
+    if (!status_left) return;
+    char msg[FL_PATH_MAX + 32];
+    int percent = total ? (int)(done * 100 / total) : 0;
+    snprintf(msg, sizeof(msg), "Loading %s... %d%%", fl_filename_name(path.c_str()), percent);
+    status_left->copy_label(msg);
+    status_left->redraw();
+}
+
+// A restored tab selected while its file loads in the background, and the
+// document shown then; the tab is selected once loaded if that is still shown
+static std::string selected_when_loaded;
+static Fl_Text_Buffer* shown_when_selected = nullptr;
+
+// A restored tab takes over the buffer read for it
+static void adopt_tab_document(Tab* tab, Fl_Text_Buffer* loaded) {
+    Fl_Text_Buffer* stub = tab->buffer;
+    tab->buffer = loaded;
+    tab->loaded = true;
+    delete stub;  // never shown: stubs are not attached to the editor
+    journal_track(loaded, tab->filepath);
+    record_disk_stamp(tab);
+    if (tab->filepath != selected_when_loaded) return;
+    selected_when_loaded.clear();
+    if (buffer != shown_when_selected) return;  // another document was picked since
+    tab_bar->set_active_tab(tab->filepath);
+    if (tab_bar->on_tab_selected) tab_bar->on_tab_selected(tab->filepath);
+}
+
+static void file_load_done(const std::string& path, Fl_Text_Buffer* loaded) {
+    if (!loaded) {
+        if (path == selected_when_loaded) selected_when_loaded.clear();
+        fl_alert("Cannot open '%s'", path.c_str());
+        update_status();
+        return;
+    }
+    if (loaded->input_file_was_transcoded && loaded->transcoding_warning_action)
+        loaded->transcoding_warning_action(loaded);
+    Tab* stub = tab_bar ? tab_bar->get_tab(path) : nullptr;
+    if (stub && !stub->loaded) adopt_tab_document(stub, loaded);
+    else open_document(path.c_str(), loaded);
+}
+
+bool load_tab_document(Tab* tab) {
+    // Evicted with unsaved edits: the text is held compressed
+    if (unpack_tab(tab)) return true;
+    struct stat st;
+    if (stat(tab->filepath.c_str(), &st) == 0 && (size_t)st.st_size > MAX_FILE_SIZE_FOR_IMMEDIATE_LOAD) {
+        start_file_load(tab->filepath.c_str(), file_load_done, file_load_progress);
+        file_load_progress(tab->filepath, 0, (size_t)st.st_size);
+        // Typing still goes to the shown document, so its tab stays selected
+        selected_when_loaded = tab->filepath;
+        shown_when_selected = buffer;
+        tab_bar->set_active_tab(current_file);
+        return false;
+    }
+    // A missing file leaves an empty document, as before
+    tab->buffer->loadfile(tab->filepath.c_str());
+    tab->loaded = true;
+    journal_track(tab->buffer, tab->filepath);
+    record_disk_stamp(tab);
+    return true;
+}
+
+// Bring a document up to date with its file by replacing only the span
+// that differs: one undoable edit, and the cursor and scroll position
+// outside the span stay where they were
+static bool reload_from_disk(Tab* tab) {
+    Fl_Text_Buffer fresh;
+    fresh.transcoding_warning_action = nullptr;
+    if (fresh.loadfile(tab->filepath.c_str()) != 0) return false;
+    char* now = tab->buffer->text();
+    char* next = fresh.text();
+    size_t old_len = strlen(now), new_len = strlen(next);
+
+    size_t prefix = 0;
+    while (prefix < old_len && prefix < new_len && now[prefix] == next[prefix]) ++prefix;
+    size_t suffix = 0;
+    while (suffix < old_len - prefix && suffix < new_len - prefix &&
+           now[old_len - 1 - suffix] == next[new_len - 1 - suffix]) ++suffix;
+    // Split on character boundaries
+    auto continuation = [](char c) { return (c & 0xC0) == 0x80; };
+    while (prefix > 0 && ((prefix < old_len && continuation(now[prefix])) ||
+                          (prefix < new_len && continuation(next[prefix])))) --prefix;
+    while (suffix > 0 && continuation(now[old_len - suffix])) --suffix;
+
+    if (prefix != old_len || prefix != new_len) {
+        bool shown = tab->buffer == buffer;
+        std::string middle(next + prefix, new_len - suffix - prefix);
+        loading_file = true;  // not a user edit
+        tab->buffer->replace((int)prefix, (int)(old_len - suffix), middle.c_str());
+        loading_file = false;
+        if (shown) text_changed = false;
+        else tab->style_buffer->text("");  // restyled when shown
+    }
+    free(now);
+    free(next);
+    tab_bar->update_tab_modified(tab->filepath, false);
+    journal_discard(tab->filepath);  // matches the disk again
+    record_disk_stamp(tab);
+    update_title();
+    update_status();
+    return true;
+}
+
+// Unsaved edits meet a newer file: let the user pick which one stays
+void resolve_disk_conflict_cb(void*) {
+    Tab* tab = current_file[0] && tab_bar ? tab_bar->get_tab(current_file) : nullptr;
+    if (!tab || !tab->disk_changed || tab->buffer != buffer) return;
+    tab->disk_changed = false;
+    int r = fl_choice("'%s' changed on disk, and this tab has unsaved changes.",
+                      "Keep Mine", "Reload", NULL, fl_filename_name(tab->filepath.c_str()));
+    if (r == 1) reload_from_disk(tab);
+    else record_disk_stamp(tab);  // the next save overwrites the file on purpose
+}
+
+static DirWatcher* tab_watcher = nullptr;
+static std::set<std::string> touched_files;  // paths waiting for check_touched_files
+
+static std::string parent_dir(const std::string& path) {
+    std::string dir = std::filesystem::path(path).parent_path().string();
+    return dir.empty() ? "." : dir;
+}
+
+// Runs shortly after a burst of events, once per file
+static void check_touched_files(void*) {
+    std::set<std::string> paths;
+    paths.swap(touched_files);
+    for (const std::string& path : paths) {
+        Tab* tab = tab_bar ? tab_bar->get_tab(path) : nullptr;
+        // Our own save lands through its completion, which records the stamp
+        if (!tab || file_save_pending(path) || !changed_on_disk(tab)) continue;
+        if (!tab->loaded) {
+            // Stubs read the new file when shown; compressed edits must be asked about
+            if (!tab->packed.empty()) tab->disk_changed = true;
+        } else if (!tab->is_modified) {
+            reload_from_disk(tab);
         } else {
-            fl_alert("Cannot open '%s'", file);
+            tab->disk_changed = true;
         }
-        loading_file = false;  // Re-enable modification tracking
     }
+    resolve_disk_conflict_cb(nullptr);
+}
+
+static void tab_files_changed(const std::vector<DirEvent>& events, void*) {
+    if (!tab_bar) return;
+    for (const DirEvent& ev : events) {
+        for (Tab* tab : tab_bar->get_all_tabs()) {
+            if ((ev.events & WATCH_OVERFLOW) ||
+                (ev.name == tab->filename && ev.dir == parent_dir(tab->filepath)))
+                touched_files.insert(tab->filepath);
+        }
+    }
+    // A write often arrives as several events; look once they settle
+    Fl::remove_timeout(check_touched_files);
+    Fl::add_timeout(0.1, check_touched_files);
+}
+
+// Watch the directories holding open tabs' files
+void update_tab_watches() {
+    if (!tab_bar) return;
+    if (!tab_watcher)
+        tab_watcher = new DirWatcher(WATCH_CHANGED | WATCH_CREATED | WATCH_MOVED_TO, tab_files_changed);
+    std::set<std::string> wanted;
+    for (Tab* tab : tab_bar->get_all_tabs()) wanted.insert(parent_dir(tab->filepath));
+    for (const std::string& dir : tab_watcher->dirs())
+        if (!wanted.count(dir)) tab_watcher->remove(dir);
+    for (const std::string& dir : wanted) tab_watcher->add(dir);
+}
+
+void load_file(const char *file) {
+    // Opening anything else supersedes a load still in flight
+    cancel_file_load();
+
+    // Already open: switch to it and keep any unsaved edits
+    if (tab_bar && tab_bar->get_tab(file)) {
+        tab_bar->set_active_tab(file);
+        if (tab_bar->on_tab_selected) tab_bar->on_tab_selected(file);
+        return;
+    }
+
+    // Check file size
+    struct stat st;
+    if (stat(file, &st) == 0 && st.st_size > MAX_FILE_SIZE_FOR_IMMEDIATE_LOAD) {
+        // Large files are read off-thread into a private buffer
+        start_file_load(file, file_load_done, file_load_progress);
+        file_load_progress(file, 0, (size_t)st.st_size);
+        return;
+    }
+
+    // Small files load directly into the buffer their tab will own
+    Fl_Text_Buffer* doc = new Fl_Text_Buffer();
+    if (doc->loadfile(file) != 0) {
+        delete doc;
+        fl_alert("Cannot open '%s'", file);
+        return;
+    }
+    open_document(file, doc);
 }
 
 void open_cb(Fl_Widget*, void*) {
@@ -479,73 +852,30 @@ void refresh_folder_cb(Fl_Widget*, void*) {
 }
 
 void refresh_subdir_cb(Fl_Widget*, void* data) {
-    Fl_Tree_Item* it = static_cast<Fl_Tree_Item*>(data);
-    if (!it || !current_folder[0]) return;
+    int it = (int)(intptr_t)data;
+    if (it == TREE_NONE || !current_folder[0]) return;
 
     refresh_tree_item(it);
 }
 
-static void item_abs_path(Fl_Tree_Item* it, char* out, size_t sz);
-
-static void remove_recursive(const char* path) {
-    struct stat st;
-    if (stat(path, &st) != 0) return;
-    if (S_ISDIR(st.st_mode)) {
-        DIR* d = opendir(path);
-        if (d) {
-            struct dirent* e;
-            while ((e = readdir(d))) {
-                if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) continue;
-                char sub[FL_PATH_MAX * 2];
-                snprintf(sub, sizeof(sub), "%s/%s", path, e->d_name);
-                remove_recursive(sub);
-            }
-            closedir(d);
-        }
-#ifdef _WIN32
-        _rmdir(path);
-#else
-        rmdir(path);
-#endif
-    } else {
-        remove(path);
-    }
+void delete_cb(Fl_Widget* w, void* data) {
+    if (!current_folder[0]) return;
+    tree_delete_item_cb(w, data);
 }
 
-void delete_cb(Fl_Widget*, void* data) {
-    Fl_Tree_Item* it = static_cast<Fl_Tree_Item*>(data);
-    if (!it || !current_folder[0]) return;
-    char target[FL_PATH_MAX * 2];
-    item_abs_path(it, target, sizeof(target));
-    char msg[FL_PATH_MAX];
-    snprintf(msg, sizeof(msg), "Delete '%s'?", it->label());
-    if (fl_choice("%s", "Cancel", "OK", NULL, msg) != 1) return;
-    remove_recursive(target);
-    Fl_Tree_Item* parent = it->parent();
-    if (!parent) parent = file_tree->root();
-    refresh_tree_item(parent);
-}
-
-static void item_abs_path(Fl_Tree_Item* it, char* out, size_t sz) {
-    char rel[FL_PATH_MAX] = "";
-    if (it != file_tree->root()) {
-        file_tree->item_pathname(rel, sizeof(rel), it);
-        const char* root_lbl = file_tree->root()->label();
-        if (root_lbl && *root_lbl) {
-            size_t len = strlen(root_lbl);
-            if (!strncmp(rel, root_lbl, len) && rel[len] == '/')
-                memmove(rel, rel + len + 1, strlen(rel + len + 1) + 1);
-        }
-    }
-    if (*rel)
-        snprintf(out, sz, "%s/%s", current_folder, rel);
+static void item_abs_path(int it, char* out, size_t sz) {
+    std::string rel;
+    for (; it != TREE_ROOT && it != TREE_NONE; it = file_tree->parent(it))
+        rel = rel.empty() ? file_tree->label(it) : file_tree->label(it) + "/" + rel;
+    if (!rel.empty())
+        snprintf(out, sz, "%s/%s", current_folder, rel.c_str());
     else
         snprintf(out, sz, "%s", current_folder);
 }
 
 void new_file_cb(Fl_Widget*, void* data) {
-    Fl_Tree_Item* it = static_cast<Fl_Tree_Item*>(data);
-    if (!it || !current_folder[0]) return;
+    int it = (int)(intptr_t)data;
+    if (it == TREE_NONE || !current_folder[0]) return;
     const char* name = fl_input("File name:", "");
     if (!name || !*name) return;
     char dir[FL_PATH_MAX * 2];
@@ -554,7 +884,7 @@ void new_file_cb(Fl_Widget*, void* data) {
     if (stat(dir, &st) == 0 && !S_ISDIR(st.st_mode)) {
         char* slash = strrchr(dir, '/');
         if (slash) *slash = '\0';
-        it = it->parent() ? it->parent() : file_tree->root();
+        it = file_tree->parent(it) != TREE_NONE ? file_tree->parent(it) : TREE_ROOT;
     }
     char path[FL_PATH_MAX * 2];
     if (snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path)) {
@@ -567,8 +897,8 @@ void new_file_cb(Fl_Widget*, void* data) {
 }
 
 void new_folder_cb(Fl_Widget*, void* data) {
-    Fl_Tree_Item* it = static_cast<Fl_Tree_Item*>(data);
-    if (!it || !current_folder[0]) return;
+    int it = (int)(intptr_t)data;
+    if (it == TREE_NONE || !current_folder[0]) return;
     const char* name = fl_input("Folder name:", "");
     if (!name || !*name) return;
     char dir[FL_PATH_MAX * 2];
@@ -577,7 +907,7 @@ void new_folder_cb(Fl_Widget*, void* data) {
     if (stat(dir, &st) == 0 && !S_ISDIR(st.st_mode)) {
         char* slash = strrchr(dir, '/');
         if (slash) *slash = '\0';
-        it = it->parent() ? it->parent() : file_tree->root();
+        it = file_tree->parent(it) != TREE_NONE ? file_tree->parent(it) : TREE_ROOT;
     }
     char path[FL_PATH_MAX * 2];
     if (snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path)) {
@@ -592,29 +922,93 @@ void new_folder_cb(Fl_Widget*, void* data) {
     refresh_tree_item(it);
 }
 
+// Runs on the main thread once the worker has written the file
+static void file_save_done(const std::string& path, unsigned long revision, const std::string& error) {
+    Tab* tab = tab_bar ? tab_bar->get_tab(path) : nullptr;
+    if (tab && !file_save_pending(path)) {
+        tab->saving = false;
+        tab_bar->redraw();
+    }
+    if (!error.empty()) {
+        if (tab) tab->close_after_save = false;
+        fl_alert("Cannot save '%s'\n%s", path.c_str(), error.c_str());
+        update_status();
+        return;
+    }
+    // Edits made while the file was being written keep the tab unsaved
+    if (tab) {
+        journal_saved(path, tab->revision == revision);
+        record_disk_stamp(tab);
+    }
+    if (tab && tab->revision == revision) {
+        tab_bar->update_tab_modified(path, false);
+        if (path == current_file) text_changed = false;
+    }
+    last_save_time = std::time(nullptr);
+    update_title();
+    update_status();
+
+    if (tab && tab->close_after_save && !file_save_pending(path)) {
+        tab->close_after_save = false;
+        if (!tab->is_modified && tab_bar->on_tab_closed) tab_bar->on_tab_closed(path);
+    }
+}
+
+// Hand `doc` to the save worker; false if the user would rather not
+// overwrite a file someone else changed since we read it
+static bool start_document_save(const char* file, Fl_Text_Buffer* doc, Tab* tab) {
+    if (tab && tab->disk_size >= 0 && !file_save_pending(file) && changed_on_disk(tab)) {
+        int r = fl_choice("'%s' changed on disk since it was opened.\nOverwrite it?",
+                          "Cancel", "Overwrite", NULL, fl_filename_name(file));
+        if (r != 1) return false;
+    }
+
+    // Snapshot the text now; the worker writes it while editing goes on
+    start_file_save(file, doc->text(), (size_t)doc->length(), tab ? tab->revision : 0, file_save_done);
+    if (tab) {
+        tab->saving = true;
+        tab_bar->redraw();
+    }
+    return true;
+}
+
 void save_to(const char *file) {
-    int result = buffer->savefile(file);
-    if (result == 0) {
-        strncpy(current_file, file, sizeof(current_file));
-        text_changed = false;
-        
-        // Update tab bar modified status and buffer
-        if (tab_bar) {
-            tab_bar->update_tab_modified(file, false);
-            // Update the tab's buffer with the saved content
-            Fl_Text_Buffer* tab_buffer = tab_bar->get_tab_buffer(file);
-            if (tab_buffer) {
-                tab_buffer->text(buffer->text());
-            }
+    if (buffer == untitled_buffer && tab_bar) {
+        // The untitled document becomes a tab for its new file and a
+        // fresh untitled buffer takes its place
+        Fl_Text_Buffer* doc = untitled_buffer;
+        journal_untrack(doc, "");
+        journal_discard("");
+        untitled_buffer = new Fl_Text_Buffer();
+        journal_track(untitled_buffer, "");
+        if (Tab* open = tab_bar->get_tab(file)) {
+            // Saved over a file that is already open: that tab now shows
+            // what is being written
+            char* text = doc->text();
+            open->buffer->text(text);
+            free(text);
+            open->style_buffer->text("");
+            tab_bar->set_active_tab(file);
+            tab_bar->on_tab_selected(file);
+            delete doc;
+        } else {
+            tab_bar->add_tab("", file, doc);
+            attach_document(doc, tab_bar->get_tab(file)->style_buffer);
+            style_init();
+            // Journalled in full until the save lands; the file may not exist yet
+            journal_track(doc, file);
+            journal_rewrite(file);
         }
-        
-        update_title();
-        save_last_file();
-        last_save_time = std::time(nullptr);
-        update_status();
-    } else {
-        fl_alert("Cannot save '%s'", file);
+        untitled_style_buffer->text("");
     }
+    strncpy(current_file, file, sizeof(current_file));
+
+    Tab* tab = tab_bar ? tab_bar->get_tab(file) : nullptr;
+    if (!start_document_save(file, buffer, tab)) return;
+
+    update_title();
+    save_last_file();
+    update_status();
 }
 
 void save_cb(Fl_Widget*, void*) {
@@ -628,62 +1022,53 @@ void save_cb(Fl_Widget*, void*) {
 }
 
 void close_current_tab_cb(Fl_Widget*, void*) {
-    if (current_file[0] && tab_bar) {
-        // Use the same logic as the tab close button
-        std::string filepath = std::string(current_file);
-        
-        // Check if this is the current file and has unsaved changes
-        if (text_changed) {
-            int r = fl_choice("Save changes before closing?", "Cancel", "Save", "Don't Save");
-            if (r == 0) return; // Cancel - don't close the tab
-            if (r == 1) {
-                // Save the file
-                save_cb(nullptr, nullptr);
-                // Check if save was successful
-                if (text_changed) return; // Save failed or was cancelled
-            }
-        }
-        
-        // Remove the tab from the tab bar
-        tab_bar->remove_tab(filepath);
-        
-        // Check if there are other tabs available
-        std::vector<Tab*> all_tabs = tab_bar->get_all_tabs();
-        if (!all_tabs.empty()) {
-            // Switch to the first available tab
-            Tab* first_tab = all_tabs[0];
-            std::string new_filepath = first_tab->filepath;
-            
-            // Switch to the new tab's buffer
-            Fl_Text_Buffer* tab_buffer = tab_bar->get_tab_buffer(new_filepath);
-            if (tab_buffer) {
-                buffer->text(tab_buffer->text());
-                strcpy(current_file, new_filepath.c_str());
-                
-                // Restore the modified state from the tab
-                text_changed = first_tab->is_modified;
-                
-                update_title();
-                update_status();
-            }
-        } else {
-            // No tabs left, clear the editor
-            buffer->text("");
-            current_file[0] = '\0';
-            text_changed = false;
-            update_title();
-            update_status();
-        }
-    }
+    // Same path as the tab close button, including the unsaved-changes prompt
+    if (current_file[0] && tab_bar && tab_bar->on_tab_closed)
+        tab_bar->on_tab_closed(std::string(current_file));
 }
 
 void quit_cb(Fl_Widget*, void*) {
-    if (text_changed) {
-        int r = fl_choice("Save changes before quitting?", "Cancel", "Save", "Don't Save");
+    // Every document with unsaved edits, not only the one shown
+    std::vector<Tab*> modified;
+    if (tab_bar) {
+        for (Tab* tab : tab_bar->get_all_tabs())
+            if (tab->is_modified) modified.push_back(tab);
+    }
+    bool untitled_modified = untitled_buffer && untitled_buffer->length() > 0;
+    int count = (int)modified.size() + (untitled_modified ? 1 : 0);
+    bool discard = false;
+    if (count) {
+        int r = count == 1 ? fl_choice("Save changes before quitting?", "Cancel", "Save", "Don't Save")
+                           : fl_choice("Save changes to %d documents before quitting?",
+                                       "Cancel", "Save", "Don't Save", count);
         if (r == 0) return;
-        if (r == 1) save_cb(NULL, NULL);
+        discard = r == 2;
+        if (r == 1) {
+            // A tab whose text only lives in its journal cannot be saved; the journal stays
+            for (Tab* tab : modified) {
+                if (Fl_Text_Buffer* doc = resident_tab_buffer(tab))
+                    start_document_save(tab->filepath.c_str(), doc, tab);
+            }
+            if (untitled_modified) {
+                show_untitled_document();
+                if (tab_bar) tab_bar->set_active_tab("");
+                save_cb(NULL, NULL);
+            }
+        }
+    }
+    // Let saves still being written reach the disk
+    wait_for_file_saves();
+    // Journals go only with documents that match their files now, or whose
+    // changes were let go; a failed or cancelled save stays recoverable
+    if (tab_bar) {
+        for (Tab* tab : tab_bar->get_all_tabs())
+            if (discard || !tab->is_modified) journal_discard(tab->filepath);
     }
+    if (discard || !untitled_buffer || untitled_buffer->length() == 0) journal_discard("");
+    journal_shutdown();
     save_last_file();
+    save_tree_snapshot();
+    save_tree_expansion_state();
 
     // Save tab state before quitting
     if (tab_bar) {
@@ -823,6 +1208,7 @@ void apply_theme(Theme theme) {
         }
     }
     current_theme = theme;
+    if (file_tree) restyle_file_tree();
     if (win) win->redraw();
 }
 
@@ -834,19 +1220,100 @@ void copy_cb(Fl_Widget*, void*)       { Fl_Text_Editor::kf_copy(0, static_cast<F
 void paste_cb(Fl_Widget*, void*)      { Fl_Text_Editor::kf_paste(0, static_cast<Fl_Text_Editor*>(editor)); }
 void select_all_cb(Fl_Widget*, void*) { Fl_Text_Editor::kf_select_all(0, static_cast<Fl_Text_Editor*>(editor)); }
 
-static bool replace_all(std::string& data, const std::string& search,
+// Shared by the Find menu toggles and every search entry point below
+static SearchReplace::Options search_options;
+
+void match_case_cb(Fl_Widget*, void*)  { search_options.match_case = !search_options.match_case; }
+void whole_word_cb(Fl_Widget*, void*)  { search_options.whole_word = !search_options.whole_word; }
+
+static bool replace_all(std::string& data, const SearchReplace::Matcher& matcher,
                         const std::string& replace) {
+    std::string out;
     bool changed = false;
-    size_t pos = 0;
-    while ((pos = data.find(search, pos)) != std::string::npos) {
-        data.replace(pos, search.length(), replace);
-        pos += replace.length();
+    size_t last = 0, pos = 0, len = 0;
+    while ((pos = matcher.find(data.data(), data.size(), last, &len)) != SearchReplace::Matcher::npos) {
+        out.append(data, last, pos - last);
+        out += replace;
+        last = pos + len;
         changed = true;
     }
-    return changed;
+    if (!changed) return false;
+    out.append(data, last, std::string::npos);
+    data.swap(out);
+    return true;
 }
 
-void count_in_file(const char* file, const char* search, int* count) {
+// Open documents by normalized path, built once per operation so a folder
+// walk looks each file up instead of normalizing every tab's path for it.
+// The shown file maps to nullptr: its document is the editor buffer.
+typedef std::unordered_map<std::string, Tab*> OpenTabs;
+
+static OpenTabs index_open_tabs() {
+    OpenTabs tabs;
+    if (current_file[0]) tabs[SearchReplace::overlayKey(current_file)] = nullptr;
+    if (tab_bar) {
+        for (Tab* tab : tab_bar->get_all_tabs()) tabs.emplace(SearchReplace::overlayKey(tab->filepath), tab);
+    }
+    return tabs;
+}
+
+// Buffer holding the open document for `file`: the editor buffer for the
+// active file, the tab buffer for background tabs, nullptr when not open.
+// `tab` is set to the background tab.
+static Fl_Text_Buffer* open_buffer_for(const OpenTabs& tabs, const char* file, Tab** tab) {
+    auto it = tabs.find(SearchReplace::overlayKey(file));
+    if (it == tabs.end()) return nullptr;
+    *tab = it->second;
+    return it->second ? resident_tab_buffer(it->second) : buffer;
+}
+
+// Every open document, keyed for SearchReplace overlay lookups
+static SearchReplace::Overlay open_documents() {
+    SearchReplace::Overlay docs;
+    if (tab_bar) {
+        for (Tab* tab : tab_bar->get_all_tabs()) {
+            // Stubs have nothing newer than the disk
+            if (Fl_Text_Buffer* doc = resident_tab_buffer(tab))
+                docs[SearchReplace::overlayKey(tab->filepath)].buffer = doc;
+        }
+    }
+    if (current_file[0]) docs[SearchReplace::overlayKey(current_file)].buffer = buffer;
+    return docs;
+}
+
+// Background tabs edited by a replace are now unsaved; the editor buffer
+// reports its own edits through changed_cb
+static void mark_replaced(const SearchReplace::Overlay& docs) {
+    if (!tab_bar) return;
+    for (Tab* tab : tab_bar->get_all_tabs()) {
+        auto it = docs.find(SearchReplace::overlayKey(tab->filepath));
+        if (it != docs.end() && it->second.changed && it->second.buffer != buffer) {
+            tab_bar->update_tab_modified(tab->filepath, true);
+            tab->style_buffer->text("");  // restyled when the tab is shown
+        }
+    }
+}
+
+// Bring a document into the editor, switching tabs when it is already open
+// so unsaved edits are kept
+static void show_document(const char* path) {
+    Tab* tab = nullptr;
+    if (open_buffer_for(index_open_tabs(), path, &tab) == buffer) return;
+    if (tab) {
+        std::string filepath = tab->filepath;
+        tab_bar->set_active_tab(filepath);
+        if (tab_bar->on_tab_selected) tab_bar->on_tab_selected(filepath);
+        return;
+    }
+    load_file(path);
+}
+
+static void count_in_file(const OpenTabs& tabs, const char* file, const char* search, int* count) {
+    Tab* tab = nullptr;
+    if (Fl_Text_Buffer* open = open_buffer_for(tabs, file, &tab)) {
+        *count += SearchReplace::findInBuffer(open, search, search_options);
+        return;
+    }
     FILE* fp = fopen(file, "rb");
     if (!fp) return;
     fseek(fp, 0, SEEK_END);
@@ -855,15 +1322,36 @@ void count_in_file(const char* file, const char* search, int* count) {
     std::string data(len, '\0');
     fread(data.data(), 1, len, fp);
     fclose(fp);
-    size_t pos = 0;
-    while ((pos = data.find(search, pos)) != std::string::npos) {
-        ++*count;
-        pos += strlen(search);
+    *count += SearchReplace::Matcher(search, search_options).count(data.data(), data.size());
+}
+
+// Where the replacement text went in the editor buffer by the last replace
+static std::vector<SearchReplace::Hit> replaced_spans;
+
+static void note_replaced_spans(const std::vector<SearchReplace::Hit>& hits, int inserted) {
+    replaced_spans.clear();
+    int shift = 0;  // earlier replacements move the later hits
+    for (const SearchReplace::Hit& h : hits) {
+        replaced_spans.push_back({h.pos + shift, inserted});
+        shift += inserted - h.len;
     }
 }
 
-void replace_in_file(const char* file, const char* search,
-                     const char* replace) {
+static void replace_in_file(const OpenTabs& tabs, const char* file, const char* search,
+                            const char* replace) {
+    // Open documents take the replace as an undoable edit instead of
+    // having the file rewritten underneath them
+    Tab* tab = nullptr;
+    if (Fl_Text_Buffer* open = open_buffer_for(tabs, file, &tab)) {
+        std::vector<SearchReplace::Hit> hits;
+        SearchReplace::scanBuffer(open, SearchReplace::Matcher(search, search_options), hits);
+        if (open == buffer) note_replaced_spans(hits, (int)strlen(replace));
+        if (SearchReplace::replaceHits(open, hits, replace) && open != buffer && tab) {
+            tab_bar->update_tab_modified(tab->filepath, true);
+            tab->style_buffer->text("");  // restyled when the tab is shown
+        }
+        return;
+    }
     FILE* fp = fopen(file, "rb");
     if (!fp) return;
     fseek(fp, 0, SEEK_END);
@@ -873,50 +1361,46 @@ void replace_in_file(const char* file, const char* search,
     fread(data.data(), 1, len, fp);
     fclose(fp);
 
-    if (replace_all(data, search, replace)) {
+    if (replace_all(data, SearchReplace::Matcher(search, search_options), replace)) {
         fp = fopen(file, "wb");
         if (fp) {
             fwrite(data.data(), 1, data.size(), fp);
             fclose(fp);
         }
-        if (strcmp(file, current_file) == 0) {
-            buffer->text(data.c_str());
-            text_changed = false;
-            update_title();
-            style_init();
-            last_save_time = std::time(nullptr);
-            update_status();
-        }
     }
 }
 
-int highlight_in_buffer(const char* search, int* first_pos) {
+void count_in_file(const char* file, const char* search, int* count) {
+    count_in_file(index_open_tabs(), file, search, count);
+}
+
+void replace_in_file(const char* file, const char* search, const char* replace) {
+    replace_in_file(index_open_tabs(), file, search, replace);
+}
+
+// Restyle the editor buffer with `hits` marked
+static void highlight_hits(const std::vector<SearchReplace::Hit>& hits) {
     style_init();
-    char* text = buffer->text();
-    char* style = style_buffer->text();
-    int len = buffer->length();
-    size_t slen = strlen(search);
-    int count = 0;
-    if (first_pos) *first_pos = -1;
-    for (int i = 0; i <= len - (int)slen; ) {
-        if (strncmp(text + i, search, slen) == 0) {
-            if (first_pos && *first_pos == -1) *first_pos = i;
-            for (size_t k = 0; k < slen && i + (int)k < len; ++k)
-                style[i + k] = 'G';
-            i += slen;
-            ++count;
-        } else {
-            ++i;
-        }
+    if (!hits.empty()) {
+        char* style = style_buffer->text();
+        for (const SearchReplace::Hit& h : hits)
+            memset(style + h.pos, 'G', h.len);
+        style_buffer->text(style);
+        free(style);
     }
-    style_buffer->text(style);
-    free(style);
-    free(text);
     editor->damage(FL_DAMAGE_ALL);
-    return count;
 }
 
-void count_in_folder(const char* folder, const char* search, int* count) {
+int highlight_in_buffer(const char* search, int* first_pos, int* first_len) {
+    std::vector<SearchReplace::Hit> hits;
+    SearchReplace::scanBuffer(buffer, SearchReplace::Matcher(search, search_options), hits);
+    if (first_pos) *first_pos = hits.empty() ? -1 : hits.front().pos;
+    if (first_len && !hits.empty()) *first_len = hits.front().len;
+    highlight_hits(hits);
+    return (int)hits.size();
+}
+
+static void count_in_folder(const OpenTabs& tabs, const char* folder, const char* search, int* count) {
     DIR* d = opendir(folder);
     if (!d) return;
     struct dirent* e;
@@ -927,15 +1411,19 @@ void count_in_folder(const char* folder, const char* search, int* count) {
         struct stat st;
         if (stat(path, &st) != 0) continue;
         if (S_ISDIR(st.st_mode))
-            count_in_folder(path, search, count);
+            count_in_folder(tabs, path, search, count);
         else if (S_ISREG(st.st_mode))
-            count_in_file(path, search, count);
+            count_in_file(tabs, path, search, count);
     }
     closedir(d);
 }
 
-void replace_in_folder(const char* folder, const char* search,
-                       const char* replace) {
+void count_in_folder(const char* folder, const char* search, int* count) {
+    count_in_folder(index_open_tabs(), folder, search, count);
+}
+
+static void replace_in_folder(const OpenTabs& tabs, const char* folder, const char* search,
+                              const char* replace) {
     DIR* d = opendir(folder);
     if (!d) return;
     struct dirent* e;
@@ -946,13 +1434,17 @@ void replace_in_folder(const char* folder, const char* search,
         struct stat st;
         if (stat(path, &st) != 0) continue;
         if (S_ISDIR(st.st_mode))
-            replace_in_folder(path, search, replace);
+            replace_in_folder(tabs, path, search, replace);
         else if (S_ISREG(st.st_mode))
-            replace_in_file(path, search, replace);
+            replace_in_file(tabs, path, search, replace);
     }
     closedir(d);
 }
 
+void replace_in_folder(const char* folder, const char* search, const char* replace) {
+    replace_in_folder(index_open_tabs(), folder, search, replace);
+}
+
 void find_cb(Fl_Widget*, void*) {
     if (!current_folder[0]) {
         fl_alert("No folder opened");
@@ -962,10 +1454,10 @@ void find_cb(Fl_Widget*, void*) {
     if (!term || !*term) return;
     int total = 0;
     count_in_folder(current_folder, term, &total);
-    int first_pos = -1;
-    int current = highlight_in_buffer(term, &first_pos);
+    int first_pos = -1, first_len = 0;
+    int current = highlight_in_buffer(term, &first_pos, &first_len);
     if (first_pos >= 0) {
-        buffer->select(first_pos, first_pos + strlen(term));
+        buffer->select(first_pos, first_pos + first_len);
         editor->insert_position(first_pos);
         int line = buffer->count_lines(0, first_pos);
         int lines_vis = editor->h() / (editor->textsize() + 4);
@@ -1000,14 +1492,18 @@ void replace_cb(Fl_Widget*, void*) {
     char msg[128];
     snprintf(msg, sizeof(msg), "Replace %d occurrences?", total);
     if (fl_choice("%s", "Cancel", "OK", NULL, msg) != 1) return;
+    replaced_spans.clear();
     if (current_folder[0])
         replace_in_folder(current_folder, find, repl);
     else
         replace_in_file(current_file, find, repl);
-    int first_pos = -1;
-    highlight_in_buffer(repl, &first_pos);
+    // The inserted text itself, not whatever the options make of it
+    highlight_hits(replaced_spans);
+    int first_pos = replaced_spans.empty() ? -1 : replaced_spans.front().pos;
+    int first_len = replaced_spans.empty() ? 0 : replaced_spans.front().len;
+    replaced_spans.clear();
     if (first_pos >= 0) {
-        buffer->select(first_pos, first_pos + strlen(repl));
+        buffer->select(first_pos, first_pos + first_len);
         editor->insert_position(first_pos);
         int line = buffer->count_lines(0, first_pos);
         int lines_vis = editor->h() / (editor->textsize() + 4);
@@ -1019,6 +1515,50 @@ void replace_cb(Fl_Widget*, void*) {
     fl_message("Replace complete");
 }
 
+// Parse "old=new old2=new2" into replacement pairs
+static SearchReplace::ReplacePairs parse_replace_pairs(const char* spec) {
+    SearchReplace::ReplacePairs pairs;
+    const char* p = spec;
+    while (*p) {
+        while (*p && std::isspace(static_cast<unsigned char>(*p))) ++p;
+        const char* start = p;
+        while (*p && !std::isspace(static_cast<unsigned char>(*p))) ++p;
+        std::string token(start, p - start);
+        size_t eq = token.find('=');
+        if (eq == std::string::npos || eq == 0) continue;
+        pairs.emplace_back(token.substr(0, eq), token.substr(eq + 1));
+    }
+    return pairs;
+}
+
+void batch_replace_cb(Fl_Widget*, void*) {
+    if (!current_folder[0] && !current_file[0]) {
+        fl_alert("No file opened");
+        return;
+    }
+    const char* spec = fl_input("Replace pairs (old=new, separated by spaces):", "");
+    if (!spec || !*spec) return;
+    SearchReplace::ReplacePairs pairs = parse_replace_pairs(spec);
+    if (pairs.empty()) {
+        fl_alert("Expected pairs in the form old=new");
+        return;
+    }
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Apply %d replacement pairs?", (int)pairs.size());
+    if (fl_choice("%s", "Cancel", "OK", NULL, msg) != 1) return;
+
+    int total = 0;
+    if (current_folder[0]) {
+        SearchReplace::Overlay docs = open_documents();
+        total = SearchReplace::replaceManyInFolder(current_folder, pairs, nullptr, search_options, &docs);
+        mark_replaced(docs);
+    } else {
+        total = SearchReplace::replaceManyInBuffer(buffer, pairs, search_options);
+    }
+    snprintf(msg, sizeof(msg), "Replaced %d occurrences", total);
+    fl_message("%s", msg);
+}
+
 void global_search_cb(Fl_Widget*, void*) {
     if (!current_folder[0]) {
         fl_alert("No folder opened");
@@ -1027,16 +1567,17 @@ void global_search_cb(Fl_Widget*, void*) {
     const char* term = fl_input("Search keyword:", "");
     if (!term || !*term) return;
     std::string first;
-    int total = SearchReplace::findInFolder(current_folder, term, &first);
+    SearchReplace::Overlay docs = open_documents();
+    int total = SearchReplace::findInFolder(current_folder, term, &first, search_options, &docs);
     char msg[128];
     snprintf(msg, sizeof(msg), "Found %d matches in project.", total);
     fl_message("%s", msg);
     if (total > 0 && !first.empty()) {
-        load_file(first.c_str());
-        int first_pos = -1;
-        highlight_in_buffer(term, &first_pos);
+        show_document(first.c_str());
+        int first_pos = -1, first_len = 0;
+        highlight_in_buffer(term, &first_pos, &first_len);
         if (first_pos >= 0) {
-            buffer->select(first_pos, first_pos + strlen(term));
+            buffer->select(first_pos, first_pos + first_len);
             editor->insert_position(first_pos);
             int line = buffer->count_lines(0, first_pos);
             int lines_vis = editor->h() / (editor->textsize() + 4);
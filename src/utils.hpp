@@ -16,6 +16,9 @@ void quit_cb(Fl_Widget*, void*);
 void find_cb(Fl_Widget*, void*);
 void replace_cb(Fl_Widget*, void*);
 void global_search_cb(Fl_Widget*, void*);
+void batch_replace_cb(Fl_Widget*, void*);
+void match_case_cb(Fl_Widget*, void*);
+void whole_word_cb(Fl_Widget*, void*);
 void set_font_size(int sz);
 void update_title();
 void update_status();
@@ -39,6 +42,12 @@ void paste_cb(Fl_Widget*, void*);
 void select_all_cb(Fl_Widget*, void*);
 void update_linenumber_width();
 void style_init();
+void attach_document(Fl_Text_Buffer* doc, Fl_Text_Buffer* style);
+void show_untitled_document();
+bool load_tab_document(Tab* tab);
+void recover_unsaved_documents();
+void update_tab_watches();
+void resolve_disk_conflict_cb(void*);
 // Style table declarations - defined in utils.cpp
 extern Fl_Text_Display::Style_Table_Entry style_table[];
 extern const int style_table_size;